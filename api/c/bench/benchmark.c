@@ -0,0 +1,460 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+// End-to-end benchmarks of the command line workflows.
+//
+// Usage: evidense-bench [--device PORT] [--repeat N] [FILTER]
+//   Runs all workloads whose name contains FILTER in the current directory and
+//   prints one JSON object per workload to stdout. The workloads roundtrip/,
+//   run/ and save/ talk to the device, by default the simulator started with
+//   "hse-simulator evidense".
+
+#include "evibase.h"
+#include "evidense.h"
+#include "commonindex.h"
+#include "cmdrun.h"
+#include "cmdsave.h"
+#include "cmddata.h"
+#include "cmdexport.h"
+#include "json.h"
+#include "dict.h"
+#include "cJSON.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(_WIN64) || defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#define NULL_DEVICE "NUL"
+#define dup _dup
+#define fileno _fileno
+#define fdopen _fdopen
+#else
+#include <time.h>
+#include <unistd.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define BENCH_ROUNDTRIPS     1000
+#define BENCH_MEASUREMENTS   100
+#define BENCH_SAVES          100
+#define BENCH_REPEAT         5
+#define BENCH_BLANKS         2
+
+#define BENCH_RUN_FILE       "evidense-bench-run.json"
+#define BENCH_SAVE_FILE      "evidense-bench-save.json"
+#define BENCH_DATA_FILE      "evidense-bench-data.json"
+#define BENCH_CSV_FILE       "evidense-bench-data.csv"
+
+/**
+ * @brief Latencies and counts of one workload.
+ */
+typedef struct
+{
+    double * latencies; /**< Duration of each operation in microseconds. */
+    size_t ops;         /**< Operations recorded in latencies. */
+    size_t capacity;    /**< Size of latencies. */
+    size_t errors;      /**< Operations that failed. */
+    size_t items;       /**< Wells, measurements or commands processed. */
+    uint64_t bytes;     /**< Bytes of the files processed, 0 if not applicable. */
+    uint64_t ns;        /**< Time spent in the operations, preparations are not included. */
+} Samples_t;
+
+typedef struct
+{
+    const char * name;
+    const char * unit; /**< What Samples_t::items counts. */
+    size_t size;
+    Error_t (*run)(Evi_t * self, size_t size, Samples_t * samples);
+} Workload_t;
+
+static size_t repeat = BENCH_REPEAT;
+
+static uint64_t nowNs(void)
+{
+#if defined(_WIN64) || defined(_WIN32)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void samplesAdd(Samples_t * samples, uint64_t start, Error_t ret)
+{
+    uint64_t ns = nowNs() - start;
+
+    samples->ns += ns;
+    if (samples->ops == samples->capacity)
+    {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 256;
+        double * latencies = realloc(samples->latencies, capacity * sizeof(*latencies));
+        if (latencies == NULL)
+        {
+            samples->errors++;
+            return;
+        }
+        samples->latencies = latencies;
+        samples->capacity = capacity;
+    }
+    samples->latencies[samples->ops++] = (double)ns / 1e3;
+    if (ret != ERROR_EVI_OK)
+    {
+        samples->errors++;
+    }
+}
+
+// runs a command of the command line tool, argv[0] is the command
+#define RUN_COMMAND(samples, fn, self, ...) \
+    do \
+    { \
+        char * argv[] = { __VA_ARGS__ }; \
+        uint64_t start = nowNs(); \
+        Error_t error = fn(self, (int)(sizeof(argv) / sizeof(argv[0])), argv); \
+        samplesAdd(samples, start, error); \
+    } while (0)
+
+static uint64_t fileSize(const char * filename)
+{
+    struct stat st;
+    return stat(filename, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+// opens the session outside of the measured operations, runWorkload() closes it
+static Error_t deviceWarmUp(Evi_t * self)
+{
+    char value[EVI_MAX_LINE_LENGTH];
+    Error_t ret = eviSessionOpen(self);
+
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+    return eviGet(self, INDEX_SERIALNUMBER, value, sizeof(value));
+}
+
+static Error_t benchRoundtrip(Evi_t * self, size_t size, Samples_t * samples)
+{
+    Error_t ret = deviceWarmUp(self);
+
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        char value[EVI_MAX_LINE_LENGTH];
+        uint64_t start = nowNs();
+        samplesAdd(samples, start, eviGet(self, INDEX_SERIALNUMBER, value, sizeof(value)));
+        samples->items++;
+    }
+    return ERROR_EVI_OK;
+}
+
+static Error_t benchMeasure(Evi_t * self, size_t size, Samples_t * samples)
+{
+    Error_t ret = deviceWarmUp(self);
+
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        SingleMeasurement_t measurement;
+        uint64_t start = nowNs();
+        samplesAdd(samples, start, eviDenseMeasure(self, &measurement));
+        samples->items++;
+    }
+    return ERROR_EVI_OK;
+}
+
+// init, baseline, air and sample of every well, then export; the blanks are the first wells
+static Error_t benchRun(Evi_t * self, size_t size, Samples_t * samples)
+{
+    char blanks[16];
+    char comment[32];
+    Error_t ret = deviceWarmUp(self);
+
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+
+    snprintf(blanks, sizeof(blanks), "%d", BENCH_BLANKS);
+    RUN_COMMAND(samples, cmdRun, self, "run", "--file=" BENCH_RUN_FILE, "init", blanks);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        snprintf(comment, sizeof(comment), "well %zu", i + 1);
+        RUN_COMMAND(samples, cmdRun, self, "run", "--file=" BENCH_RUN_FILE, "measure");
+        RUN_COMMAND(samples, cmdRun, self, "run", "--file=" BENCH_RUN_FILE, "measure");
+        RUN_COMMAND(samples, cmdRun, self, "run", "--file=" BENCH_RUN_FILE, "measure", comment);
+        samples->items++;
+    }
+
+    RUN_COMMAND(samples, cmdRun, self, "run", "--file=" BENCH_RUN_FILE, "export");
+    samples->bytes = fileSize(BENCH_RUN_FILE);
+
+    {
+        char serial[EVI_MAX_LINE_LENGTH];
+        char state[EVI_MAX_LINE_LENGTH + 32];
+
+        if (eviGet(self, INDEX_SERIALNUMBER, serial, sizeof(serial)) == ERROR_EVI_OK)
+        {
+            snprintf(state, sizeof(state), "evifluor-SN%s-state.json", serial);
+            remove(state);
+        }
+    }
+    remove(BENCH_RUN_FILE);
+    remove("evidense-bench-run.csv");
+    return ERROR_EVI_OK;
+}
+
+static Error_t benchSave(Evi_t * self, size_t size, Samples_t * samples)
+{
+    SingleMeasurement_t measurement;
+    Error_t ret = deviceWarmUp(self);
+
+    if (ret == ERROR_EVI_OK)
+    {
+        ret = eviDenseMeasure(self, &measurement); // save reads the last measurement
+    }
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+
+    remove(BENCH_SAVE_FILE);
+    for (size_t i = 0; i < size; i++)
+    {
+        RUN_COMMAND(samples, cmdSave, self, "save", "--mode-raw", BENCH_SAVE_FILE);
+        samples->items++;
+    }
+    samples->bytes = fileSize(BENCH_SAVE_FILE);
+    remove(BENCH_SAVE_FILE);
+    return ERROR_EVI_OK;
+}
+
+// a measurement as written by "run", the channels are varied per well
+static const char * const dataTemplate =
+    "{\"baseline\":{\"230\":{\"sample\":4498163,\"reference\":3500136},\"260\":{\"sample\":4498062,\"reference\":3501621},"
+    "\"280\":{\"sample\":4501725,\"reference\":3498494},\"340\":{\"sample\":4499902,\"reference\":3500806}},"
+    "\"air\":{\"230\":{\"sample\":4500555,\"reference\":3498073},\"260\":{\"sample\":4500564,\"reference\":3498473},"
+    "\"280\":{\"sample\":4500673,\"reference\":3499753},\"340\":{\"sample\":4501467,\"reference\":3501461}},"
+    "\"sample\":{\"230\":{\"sample\":4498712,\"reference\":3501579},\"260\":{\"sample\":4501112,\"reference\":3501250},"
+    "\"280\":{\"sample\":4501187,\"reference\":3501055},\"340\":{\"sample\":4501058,\"reference\":3499125}},"
+    "\"date_time\":\"2024-01-01T00:00:00Z\","
+    "\"logging\":[\"fake logging message G\",\"fake logging message M\",\"fake logging message M\"]}";
+
+// writes a data file with count measurements, the first BENCH_BLANKS are blanks
+static Error_t dataGenerate(const char * filename, size_t count)
+{
+    static const char * const channels[] = {DICT_230, DICT_260, DICT_280, DICT_340};
+    cJSON * json = cJSON_CreateObject();
+    cJSON * measurements = cJSON_AddArrayToObject(json, DICT_MEASUREMENTS);
+    uint32_t seed = 12345;
+    char comment[32];
+
+    cJSON_AddStringToObject(json, DICT_SERIALNUMBER, "SIMULATOR");
+    cJSON_AddStringToObject(json, DICT_FIRMWAREVERSION, "9.9.9");
+    for (size_t i = 0; i < count; i++)
+    {
+        cJSON * measurement = cJSON_Parse(dataTemplate);
+        cJSON * sample = cJSON_GetObjectItem(measurement, DICT_SAMPLE);
+
+        if (i >= BENCH_BLANKS)
+        {
+            for (size_t c = 0; c < sizeof(channels) / sizeof(channels[0]); c++)
+            {
+                cJSON * value = cJSON_GetObjectItem(cJSON_GetObjectItem(sample, channels[c]), DICT_SAMPLE);
+                seed = seed * 1103515245u + 12345u;
+                cJSON_SetNumberValue(value, cJSON_GetNumberValue(value) - (double)((seed >> 8) % 500000));
+            }
+            snprintf(comment, sizeof(comment), "Sample #%zu", i + 1 - BENCH_BLANKS);
+        }
+        else
+        {
+            snprintf(comment, sizeof(comment), "Blank #%zu", i + 1);
+        }
+        cJSON_AddStringToObject(measurement, DICT_COMMENT, comment);
+        cJSON_AddItemToArray(measurements, measurement);
+    }
+
+    json_saveToFile((char *)filename, json);
+    cJSON_Delete(json);
+    return fileSize(filename) > 0 ? ERROR_EVI_OK : ERROR_EVI_FILE_IO_ERROR;
+}
+
+static Error_t benchDataCalculate(Evi_t * self, size_t size, Samples_t * samples)
+{
+    char blanks[16];
+
+    snprintf(blanks, sizeof(blanks), "%d", BENCH_BLANKS);
+    for (size_t i = 0; i < repeat; i++)
+    {
+        // a fresh file every time, calculate adds the results to it
+        Error_t ret = dataGenerate(BENCH_DATA_FILE, size);
+        if (ret != ERROR_EVI_OK)
+        {
+            return ret;
+        }
+        samples->bytes += fileSize(BENCH_DATA_FILE);
+        RUN_COMMAND(samples, cmdData, self, "data", "calculate", "--blanksStart", blanks, BENCH_DATA_FILE);
+        samples->items += size;
+    }
+    remove(BENCH_DATA_FILE);
+    return ERROR_EVI_OK;
+}
+
+static Error_t benchExport(Evi_t * self, size_t size, Samples_t * samples)
+{
+    char blanks[16];
+    Samples_t other = {0};
+    Error_t ret = dataGenerate(BENCH_DATA_FILE, size);
+
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+    snprintf(blanks, sizeof(blanks), "%d", BENCH_BLANKS);
+    RUN_COMMAND(&other, cmdData, self, "data", "calculate", "--blanksStart", blanks, BENCH_DATA_FILE);
+    ret = other.errors > 0 ? ERROR_EVI_FILE_IO_ERROR : ERROR_EVI_OK;
+    free(other.latencies);
+
+    for (size_t i = 0; i < repeat && ret == ERROR_EVI_OK; i++)
+    {
+        RUN_COMMAND(samples, cmdExport, self, "export", BENCH_DATA_FILE, BENCH_CSV_FILE);
+        samples->items += size;
+        samples->bytes += fileSize(BENCH_DATA_FILE);
+    }
+    remove(BENCH_DATA_FILE);
+    remove(BENCH_CSV_FILE);
+    return ret;
+}
+
+static const Workload_t workloads[] = {
+    {"roundtrip/get",         "command",     BENCH_ROUNDTRIPS,   benchRoundtrip},
+    {"roundtrip/measure",     "measurement", BENCH_MEASUREMENTS, benchMeasure},
+    {"run/96",                "well",        96,                 benchRun},
+    {"run/384",               "well",        384,                benchRun},
+    {"save/raw",              "measurement", BENCH_SAVES,        benchSave},
+    {"data/calculate/96",     "measurement", 96,                 benchDataCalculate},
+    {"data/calculate/1536",   "measurement", 1536,               benchDataCalculate},
+    {"data/calculate/24576",  "measurement", 24576,              benchDataCalculate},
+    {"export/96",             "measurement", 96,                 benchExport},
+    {"export/1536",           "measurement", 1536,               benchExport},
+    {"export/24576",          "measurement", 24576,              benchExport},
+};
+
+static int compareDouble(const void * a, const void * b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank of the sorted latencies
+static double percentile(const Samples_t * samples, double p)
+{
+    size_t rank = (size_t)(p / 100.0 * (double)samples->ops + 0.999999);
+
+    if (samples->ops == 0)
+    {
+        return 0.0;
+    }
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    return samples->latencies[(rank > samples->ops ? samples->ops : rank) - 1];
+}
+
+static int runWorkload(FILE * out, Evi_t * self, const Workload_t * workload)
+{
+    Samples_t samples = {0};
+    Error_t ret = workload->run(self, workload->size, &samples);
+    double seconds = (double)samples.ns / 1e9;
+    double sum = 0.0;
+
+    eviSessionClose(self);
+
+    if (ret != ERROR_EVI_OK)
+    {
+        fprintf(out, "{\"name\":\"%s\",\"error\":%d,\"text\":\"%s\"}\n", workload->name, (int)ret, eviError2String(ret));
+        fflush(out);
+        free(samples.latencies);
+        return 1;
+    }
+
+    qsort(samples.latencies, samples.ops, sizeof(double), compareDouble);
+    for (size_t i = 0; i < samples.ops; i++)
+    {
+        sum += samples.latencies[i];
+    }
+
+    fprintf(out, "{\"name\":\"%s\",\"unit\":\"%s\",\"items\":%zu,\"ops\":%zu,\"errors\":%zu,\"bytes\":%llu,\"seconds\":%.6f,"
+                 "\"throughput\":%.3f,\"mb_per_s\":%.3f,"
+                 "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}}\n",
+            workload->name, workload->unit, samples.items, samples.ops, samples.errors, (unsigned long long)samples.bytes, seconds,
+            seconds > 0.0 ? (double)samples.items / seconds : 0.0,
+            seconds > 0.0 ? (double)samples.bytes / seconds / 1e6 : 0.0,
+            samples.ops ? sum / (double)samples.ops : 0.0,
+            percentile(&samples, 50.0), percentile(&samples, 90.0), percentile(&samples, 99.0), percentile(&samples, 100.0));
+    fflush(out);
+    free(samples.latencies);
+    return samples.errors > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Evi_t evi = {0};
+    const char * filter = "";
+    FILE * out;
+    int failed = 0;
+
+    evi.portName = "SIMULATION";
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "--device") == 0) && (i + 1 < argc))
+        {
+            evi.portName = argv[++i];
+        }
+        else if ((strcmp(argv[i], "--repeat") == 0) && (i + 1 < argc))
+        {
+            repeat = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    // the commands print their results to stdout, the benchmark results go to the original stdout
+    out = fdopen(dup(fileno(stdout)), "w");
+    if (out == NULL || freopen(NULL_DEVICE, "w", stdout) == NULL)
+    {
+        fprintf(stderr, "Could not redirect stdout\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+    {
+        if (strstr(workloads[i].name, filter) != NULL)
+        {
+            failed |= runWorkload(out, &evi, &workloads[i]);
+        }
+    }
+
+    eviSessionFree(&evi);
+    fclose(out);
+    return failed;
+}
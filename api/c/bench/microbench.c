@@ -0,0 +1,577 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+// Microbenchmarks for the hot paths of the library.
+//
+// Usage: evidense-microbench [FILTER]
+//   Runs all benchmarks whose name contains FILTER and prints the time and,
+//   with glibc, the number of allocations per operation.
+
+#include "crc-16-ccitt.h"
+#include "measurement.h"
+#include "evibase.h"
+#include "json.h"
+#include "dict.h"
+#include "cJSON.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN64) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define BENCH_MIN_NS 200000000ull
+
+#define BENCH_JSON_FILE "evidense-microbench.json"
+
+// glibc supports replacing malloc() and friends, which counts the allocations
+// of the library, cJSON and the C library itself
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCATIONS
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * pointer, size_t size);
+extern void __libc_free(void * pointer);
+
+static size_t allocations;
+
+void * malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void * realloc(void * pointer, size_t size)
+{
+    allocations++;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void * pointer)
+{
+    __libc_free(pointer);
+}
+#endif
+
+typedef struct
+{
+    const char * name;
+    size_t bytes; /**< Bytes processed per iteration, 0 if not applicable. */
+    uint64_t (*run)(size_t iterations, size_t bytes);
+} Benchmark_t;
+
+static uint64_t nowNs(void)
+{
+#if defined(_WIN64) || defined(_WIN32)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// keeps the compiler from dropping the benchmarked work
+static volatile uint64_t sink;
+
+static unsigned char crcData[4096];
+
+static void crcDataInit(void)
+{
+    uint32_t x = 0x12345678;
+    for (size_t i = 0; i < sizeof(crcData); i++)
+    {
+        x = x * 1103515245u + 12345u;
+        crcData[i] = (unsigned char)(x >> 16);
+    }
+}
+
+#define CRC_BENCH(fn) \
+    static uint64_t bench_##fn(size_t iterations, size_t bytes) \
+    { \
+        crc_t crc = crc_init(); \
+        for (size_t i = 0; i < iterations; i++) \
+        { \
+            crc = fn(crc, crcData, bytes); \
+        } \
+        return crc_finalize(crc); \
+    }
+
+CRC_BENCH(crc_update_nibble)
+CRC_BENCH(crc_update_bytewise)
+CRC_BENCH(crc_update_slice8)
+CRC_BENCH(crc_update)
+
+static Measurement_t calcMeasurement;
+static Quadruple_t calcFactor;
+static Parameters_t calcParameters;
+
+static void calcDataInit(void)
+{
+    SingleMeasurement_t baseline = singleMeasurement_init(channel_init(4500208, 3501091), channel_init(4499446, 3499159), channel_init(4499731, 3499357), channel_init(4501160, 3501391));
+    SingleMeasurement_t air      = singleMeasurement_init(channel_init(4498574, 3498627), channel_init(4500772, 3498413), channel_init(4499381, 3499340), channel_init(4501264, 3499992));
+    SingleMeasurement_t sample   = singleMeasurement_init(channel_init(4123054, 3500855), channel_init(3998214, 3499562), channel_init(4198922, 3501857), channel_init(4491854, 3500290));
+
+    calcMeasurement = measurement_init(baseline, air, sample, NULL);
+    calcFactor = quadruple_init(0.00013, 0.00023, 0.00036, 0.00001);
+    calcParameters = parametersCreate();
+    parametersSetCenterWavelength280(&calcParameters, 279.3);
+}
+
+static uint64_t bench_calcSeparate(size_t iterations, size_t bytes)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        const Measurement_t * m = &calcMeasurement;
+        const double * length = &calcParameters.cuvettePathLength;
+        sum += measurement_dsDNA(m, &calcFactor, length, &calcParameters);
+        sum += measurement_ssDNA(m, &calcFactor, length, &calcParameters);
+        sum += measurement_ssRNA(m, &calcFactor, length, &calcParameters);
+        sum += measurement_a230(m, &calcFactor, &calcParameters);
+        sum += measurement_a260(m, &calcFactor, &calcParameters);
+        sum += measurement_a280(m, &calcFactor, &calcParameters);
+        sum += measurement_a340(m, &calcFactor, &calcParameters);
+        sum += measurement_purityRatio260_230(m, &calcFactor, &calcParameters);
+        sum += measurement_purityRatio260_280(m, &calcFactor, &calcParameters);
+    }
+    return (uint64_t)sum;
+}
+
+static uint64_t bench_calcFused(size_t iterations, size_t bytes)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        Results_t r = measurement_calculateAll(&calcMeasurement, &calcFactor, &calcParameters.cuvettePathLength, &calcParameters);
+        sum += r.dsDNA + r.ssDNA + r.ssRNA + r.absorbance.value230 + r.absorbance.value260 + r.absorbance.value280 + r.absorbance.value340 + r.purityRatio260_230 + r.purityRatio260_280;
+    }
+    return (uint64_t)sum;
+}
+
+#define CALC_BATCH 1024
+
+static Measurement_t batchMeasurements[CALC_BATCH];
+static uint32_t batchChannels[2][8][CALC_BATCH];
+static double batchResults[9][CALC_BATCH];
+static MeasurementBatch_t batch;
+static ResultsBatch_t batchOut;
+
+static void batchArrayInit(uint32_t channels[8][CALC_BATCH], SingleMeasurementArray_t * array)
+{
+    array->sample230    = channels[0];
+    array->reference230 = channels[1];
+    array->sample260    = channels[2];
+    array->reference260 = channels[3];
+    array->sample280    = channels[4];
+    array->reference280 = channels[5];
+    array->sample340    = channels[6];
+    array->reference340 = channels[7];
+}
+
+static void batchSet(uint32_t channels[8][CALC_BATCH], size_t i, const SingleMeasurement_t * m)
+{
+    channels[0][i] = m->channel230.sample;
+    channels[1][i] = m->channel230.reference;
+    channels[2][i] = m->channel260.sample;
+    channels[3][i] = m->channel260.reference;
+    channels[4][i] = m->channel280.sample;
+    channels[5][i] = m->channel280.reference;
+    channels[6][i] = m->channel340.sample;
+    channels[7][i] = m->channel340.reference;
+}
+
+// the same measurements twice, as an array of Measurement_t and in the layout of measurement_calculateBatch()
+static void batchDataInit(void)
+{
+    uint32_t seed = 12345;
+
+    for (size_t i = 0; i < CALC_BATCH; i++)
+    {
+        Measurement_t m = calcMeasurement;
+        seed = seed * 1103515245u + 12345u;
+        m.sample.channel230.sample -= (seed >> 8) % 400000;
+        m.sample.channel260.sample -= (seed >> 4) % 500000;
+        m.sample.channel280.sample -= (seed >> 12) % 300000;
+        m.sample.channel340.sample -= (seed >> 16) % 10000;
+        batchMeasurements[i] = m;
+        batchSet(batchChannels[0], i, &m.air);
+        batchSet(batchChannels[1], i, &m.sample);
+    }
+
+    batch.count = CALC_BATCH;
+    batchArrayInit(batchChannels[0], &batch.air);
+    batchArrayInit(batchChannels[1], &batch.sample);
+    batchOut.dsDNA              = batchResults[0];
+    batchOut.ssDNA              = batchResults[1];
+    batchOut.ssRNA              = batchResults[2];
+    batchOut.a230               = batchResults[3];
+    batchOut.a260               = batchResults[4];
+    batchOut.a280               = batchResults[5];
+    batchOut.a340               = batchResults[6];
+    batchOut.purityRatio260_230 = batchResults[7];
+    batchOut.purityRatio260_280 = batchResults[8];
+}
+
+static uint64_t bench_calcFusedBatch(size_t iterations, size_t bytes)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        for (size_t n = 0; n < CALC_BATCH; n++)
+        {
+            Results_t r = measurement_calculateAll(&batchMeasurements[n], &calcFactor, &calcParameters.cuvettePathLength, &calcParameters);
+            sum += r.dsDNA + r.purityRatio260_280;
+        }
+    }
+    return (uint64_t)sum;
+}
+
+static uint64_t bench_calcBatch(size_t iterations, size_t bytes)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        measurement_calculateBatch(&batch, &calcFactor, &calcParameters.cuvettePathLength, &calcParameters, &batchOut);
+        sum += batchOut.dsDNA[0] + batchOut.purityRatio260_280[CALC_BATCH - 1];
+    }
+    return (uint64_t)sum;
+}
+
+static uint64_t bench_calcAbsorbance(size_t iterations, size_t bytes)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        Quadruple_t a = measurement_calculateAbsorbance(&calcMeasurement.air, &calcMeasurement.sample, &calcFactor);
+        sum += a.value230 + a.value260 + a.value280 + a.value340;
+    }
+    return (uint64_t)sum;
+}
+
+// data files of the run command with 96 and 1536 measurements, the first is the blank
+static cJSON * jsonMeasurements96;
+static cJSON * jsonMeasurements1536;
+
+static cJSON * jsonMeasurementsCreate(size_t count)
+{
+    cJSON * measurements = cJSON_CreateArray();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Measurement_t * m = &batchMeasurements[i % CALC_BATCH];
+        cJSON * item = cJSON_CreateObject();
+
+        cJSON_AddItemToObject(item, DICT_BASELINE, singleMeasurement_toJson(&m->baseline));
+        cJSON_AddItemToObject(item, DICT_AIR, singleMeasurement_toJson(&m->air));
+        cJSON_AddItemToObject(item, DICT_SAMPLE, singleMeasurement_toJson(&m->sample));
+        cJSON_AddStringToObject(item, DICT_COMMENT, i == 0 ? "Blank #1" : "Sample");
+        cJSON_AddItemToArray(measurements, item);
+    }
+    return measurements;
+}
+
+static void jsonDataInit(void)
+{
+    jsonMeasurements96 = jsonMeasurementsCreate(96);
+    jsonMeasurements1536 = jsonMeasurementsCreate(1536);
+}
+
+static uint64_t calcMeasurements(cJSON * measurements, size_t iterations)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        sum += measurement_calculate(measurements, &calcParameters);
+    }
+    return sum;
+}
+
+static uint64_t bench_calcMeasurements96(size_t iterations, size_t bytes)
+{
+    return calcMeasurements(jsonMeasurements96, iterations);
+}
+
+static uint64_t bench_calcMeasurements1536(size_t iterations, size_t bytes)
+{
+    return calcMeasurements(jsonMeasurements1536, iterations);
+}
+
+// includes deleting the created object
+static uint64_t bench_singleToJson(size_t iterations, size_t bytes)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        cJSON * json = singleMeasurement_toJson(&calcMeasurement.sample);
+        sum += (uintptr_t)json;
+        cJSON_Delete(json);
+    }
+    return sum;
+}
+
+static uint64_t bench_singleFromJson(size_t iterations, size_t bytes)
+{
+    cJSON * json = singleMeasurement_toJson(&calcMeasurement.sample);
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < iterations; i++)
+    {
+        SingleMeasurement_t m;
+        singleMeasurement_fromJson(json, &m);
+        sum += m.channel260.sample;
+    }
+    cJSON_Delete(json);
+    return sum;
+}
+
+// a data file with 1536 calculated measurements
+static cJSON * jsonFile;
+
+static void jsonFileInit(void)
+{
+    cJSON * measurements = jsonMeasurementsCreate(1536);
+
+    jsonFile = cJSON_CreateObject();
+    cJSON_AddStringToObject(jsonFile, DICT_SERIALNUMBER, "SIMULATOR");
+    cJSON_AddStringToObject(jsonFile, DICT_FIRMWAREVERSION, "9.9.9");
+    measurement_calculate(measurements, &calcParameters);
+    cJSON_AddItemToObject(jsonFile, DICT_MEASUREMENTS, measurements);
+    json_saveToFile(BENCH_JSON_FILE, jsonFile);
+}
+
+static uint64_t bench_jsonSave(size_t iterations, size_t bytes)
+{
+    for (size_t i = 0; i < iterations; i++)
+    {
+        json_saveToFile(BENCH_JSON_FILE, jsonFile);
+    }
+    return iterations;
+}
+
+static uint64_t bench_jsonLoad(size_t iterations, size_t bytes)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        cJSON * json = json_loadFromFile(BENCH_JSON_FILE);
+        sum += cJSON_GetArraySize(cJSON_GetObjectItem(json, DICT_MEASUREMENTS));
+        cJSON_Delete(json);
+    }
+    return sum;
+}
+
+// responses as received from the device, copied into the response before each split
+static const char responseGet[]         = "V \"SIMULATOR\"";
+static const char responseMeasurement[] = "M 4500208 3501091 4499446 3499159 4499731 3499357 4501160 3501391";
+static const char responseLogging[]     = "Q \"fake logging message G 4498163 3500136 4498062 3501621 4501725 3498494 4499902 3500806\"";
+
+#define TOKENIZE_BENCH(name, text) \
+    static uint64_t bench_##name(size_t iterations, size_t bytes) \
+    { \
+        EvieResponse_t response; \
+        uint64_t sum = 0; \
+        for (size_t i = 0; i < iterations; i++) \
+        { \
+            memcpy(response.response, text, sizeof(text)); \
+            eviResponseTokenize(&response); \
+            sum += response.argc; \
+        } \
+        return sum; \
+    }
+
+TOKENIZE_BENCH(tokenizeGet, responseGet)
+TOKENIZE_BENCH(tokenizeMeasurement, responseMeasurement)
+TOKENIZE_BENCH(tokenizeLogging, responseLogging)
+
+static const Benchmark_t benchmarks[] = {
+    {"crc/nibble/32",     32,   bench_crc_update_nibble},
+    {"crc/bytewise/32",   32,   bench_crc_update_bytewise},
+    {"crc/slice8/32",     32,   bench_crc_update_slice8},
+    {"crc/default/32",    32,   bench_crc_update},
+    {"crc/nibble/255",    255,  bench_crc_update_nibble},
+    {"crc/bytewise/255",  255,  bench_crc_update_bytewise},
+    {"crc/slice8/255",    255,  bench_crc_update_slice8},
+    {"crc/default/255",   255,  bench_crc_update},
+    {"crc/nibble/4096",   4096, bench_crc_update_nibble},
+    {"crc/bytewise/4096", 4096, bench_crc_update_bytewise},
+    {"crc/slice8/4096",   4096, bench_crc_update_slice8},
+    {"crc/default/4096",  4096, bench_crc_update},
+    {"calc/separate",     0,    bench_calcSeparate},
+    {"calc/fused",        0,    bench_calcFused},
+    {"calc/fused/1024",   0,    bench_calcFusedBatch},
+    {"calc/batch/1024",   0,    bench_calcBatch},
+    {"calc/absorbance",   0,    bench_calcAbsorbance},
+    {"calc/json/96",      0,    bench_calcMeasurements96},
+    {"calc/json/1536",    0,    bench_calcMeasurements1536},
+    {"json/single/to",    0,    bench_singleToJson},
+    {"json/single/from",  0,    bench_singleFromJson},
+    {"json/file/save/1536", 0,  bench_jsonSave},
+    {"json/file/load/1536", 0,  bench_jsonLoad},
+    {"tokenize/get",         sizeof(responseGet) - 1,         bench_tokenizeGet},
+    {"tokenize/measurement", sizeof(responseMeasurement) - 1, bench_tokenizeMeasurement},
+    {"tokenize/logging",     sizeof(responseLogging) - 1,     bench_tokenizeLogging},
+};
+
+// All crc variants must give the same result for every length and alignment.
+static int crcVerify(void)
+{
+    crc_t check = crc_finalize(crc_update_slice8(crc_init(), "123456789", 9));
+    if (check != 0xe5cc)
+    {
+        fprintf(stderr, "crc check value 0x%04x, expected 0xe5cc\n", (unsigned)check);
+        return 1;
+    }
+
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t length = 0; length + offset <= 300; length++)
+        {
+            crc_t nibble   = crc_update_nibble(crc_init(), crcData + offset, length);
+            crc_t bytewise = crc_update_bytewise(crc_init(), crcData + offset, length);
+            crc_t slice8   = crc_update_slice8(crc_init(), crcData + offset, length);
+            if (nibble != bytewise || nibble != slice8)
+            {
+                fprintf(stderr, "crc mismatch for offset %zu length %zu\n", offset, length);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// The batch calculation must give bit-identical results to measurement_calculateAll().
+static int batchVerify(void)
+{
+    measurement_calculateBatch(&batch, &calcFactor, &calcParameters.cuvettePathLength, &calcParameters, &batchOut);
+    for (size_t n = 0; n < CALC_BATCH; n++)
+    {
+        Results_t r = measurement_calculateAll(&batchMeasurements[n], &calcFactor, &calcParameters.cuvettePathLength, &calcParameters);
+        double expected[9] = {r.dsDNA, r.ssDNA, r.ssRNA, r.absorbance.value230, r.absorbance.value260, r.absorbance.value280, r.absorbance.value340, r.purityRatio260_230, r.purityRatio260_280};
+        for (size_t k = 0; k < 9; k++)
+        {
+            if (memcmp(&expected[k], &batchResults[k][n], sizeof(double)) != 0)
+            {
+                fprintf(stderr, "batch mismatch for measurement %zu value %zu\n", n, k);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// The serialization must give back the measurement and the responses must split into their arguments.
+static int jsonVerify(void)
+{
+    EvieResponse_t response;
+    SingleMeasurement_t m = {0};
+    cJSON * json = singleMeasurement_toJson(&calcMeasurement.sample);
+    bool ok = singleMeasurement_fromJson(json, &m);
+
+    cJSON_Delete(json);
+    if (!ok || memcmp(&m, &calcMeasurement.sample, sizeof(m)) != 0)
+    {
+        fprintf(stderr, "json round trip mismatch\n");
+        return 1;
+    }
+
+    memcpy(response.response, responseMeasurement, sizeof(responseMeasurement));
+    eviResponseTokenize(&response);
+    if (response.argc != 9 || strcmp(response.argv[8], "3501391") != 0)
+    {
+        fprintf(stderr, "tokenize mismatch\n");
+        return 1;
+    }
+    memcpy(response.response, responseLogging, sizeof(responseLogging));
+    eviResponseTokenize(&response);
+    if (response.argc != 2 || strncmp(response.argv[1], "fake logging", 12) != 0)
+    {
+        fprintf(stderr, "tokenize mismatch for a quoted argument\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void runBenchmark(const Benchmark_t * benchmark)
+{
+    size_t iterations = 1;
+    uint64_t elapsed = 0;
+    size_t allocated = 0;
+
+    // grow the iteration count until a run takes long enough to be measured
+    for (;;)
+    {
+#ifdef BENCH_COUNT_ALLOCATIONS
+        size_t before = allocations;
+#endif
+        uint64_t start = nowNs();
+        sink = benchmark->run(iterations, benchmark->bytes);
+        elapsed = nowNs() - start;
+#ifdef BENCH_COUNT_ALLOCATIONS
+        allocated = allocations - before;
+#endif
+        if (elapsed >= BENCH_MIN_NS || iterations >= ((size_t)1 << 40))
+        {
+            break;
+        }
+        iterations *= elapsed < BENCH_MIN_NS / 16 ? 8 : 2;
+    }
+
+    double nsPerOp = (double)elapsed / (double)iterations;
+    fprintf(stdout, "%-24s %12.1f ns/op", benchmark->name, nsPerOp);
+    if (benchmark->bytes > 0)
+    {
+        fprintf(stdout, " %10.1f MB/s", (double)benchmark->bytes * 1e3 / nsPerOp);
+    }
+    else
+    {
+        fprintf(stdout, " %15s", "");
+    }
+#ifdef BENCH_COUNT_ALLOCATIONS
+    fprintf(stdout, " %10.2f allocs/op", (double)allocated / (double)iterations);
+#else
+    (void)allocated;
+#endif
+    fprintf(stdout, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char * filter = argc > 1 ? argv[1] : "";
+
+    crcDataInit();
+    calcDataInit();
+    batchDataInit();
+    jsonDataInit();
+    jsonFileInit();
+    if (crcVerify() != 0 || batchVerify() != 0 || jsonVerify() != 0)
+    {
+        remove(BENCH_JSON_FILE);
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        if (strstr(benchmarks[i].name, filter) != NULL)
+        {
+            runBenchmark(&benchmarks[i]);
+        }
+    }
+    remove(BENCH_JSON_FILE);
+    return 0;
+}
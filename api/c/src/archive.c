@@ -0,0 +1,596 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "archive.h"
+#include "dict.h"
+#include "helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+const char * const archiveResultKeys[ARCHIVE_RESULTS_COUNT] =
+{
+    DICT_DS_DNA, DICT_SS_DNA, DICT_SS_RNA, DICT_A230, DICT_A260, DICT_A280, DICT_A340, DICT_PURITY_260_230, DICT_PURITY_260_280
+};
+
+typedef struct
+{
+    char * data;
+    size_t length;
+    size_t size;
+} ArchiveStrings_t;
+
+// the archive is stored little-endian in the native record layout
+static bool archive_hostIsLittleEndian(void)
+{
+    const uint16_t value = 1;
+    return *(const uint8_t *)&value == 1;
+}
+
+// same as cJSON_GetObjectItem(), case-insensitive
+static bool archive_isKey(const char * name, const char * key)
+{
+    while (*name && *key)
+    {
+        if (tolower((unsigned char)*name) != tolower((unsigned char)*key))
+        {
+            return false;
+        }
+        name++;
+        key++;
+    }
+    return *name == *key;
+}
+
+static bool archive_isCoreKey(const char * name)
+{
+    return archive_isKey(name, DICT_BASELINE) || archive_isKey(name, DICT_AIR) || archive_isKey(name, DICT_SAMPLE) ||
+           archive_isKey(name, DICT_DATE_TIME) || archive_isKey(name, DICT_COMMENT) || archive_isKey(name, DICT_RESULTS);
+}
+
+static uint32_t archive_addString(ArchiveStrings_t * strings, const char * s)
+{
+    size_t length = strlen(s) + 1;
+    uint32_t offset = (uint32_t)strings->length;
+
+    if (strings->length + length >= ARCHIVE_NO_STRING)
+    {
+        return ARCHIVE_NO_STRING;
+    }
+
+    if (strings->length + length > strings->size)
+    {
+        size_t size = strings->size ? strings->size : 4096;
+        while (size < strings->length + length)
+        {
+            size *= 2;
+        }
+        char * grown = realloc(strings->data, size);
+        if (!grown)
+        {
+            return ARCHIVE_NO_STRING;
+        }
+        strings->data = grown;
+        strings->size = size;
+    }
+
+    memcpy(strings->data + strings->length, s, length);
+    strings->length += length;
+    return offset;
+}
+
+// days since 1970-01-01 of a date of the proleptic Gregorian calendar
+static int64_t archive_daysFromCivil(int64_t y, int64_t m, int64_t d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static void archive_formatTimestamp(int64_t timestamp, char * text, size_t size)
+{
+    int64_t days = timestamp >= 0 ? timestamp / 86400 : (timestamp - 86399) / 86400;
+    int64_t seconds = timestamp - days * 86400;
+    int64_t z = days + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int64_t d = doy - (153 * mp + 2) / 5 + 1;
+    int64_t m = mp + (mp < 10 ? 3 : -9);
+    int64_t y = yoe + era * 400 + (m <= 2);
+
+    snprintf(text, size, "%04d-%02d-%02dT%02d:%02d:%02dZ", (int)y, (int)m, (int)d,
+             (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+}
+
+// accepts the ISO 8601 format written by the run command only if it converts back to the same text
+static bool archive_parseTimestamp(const char * text, int64_t * timestamp)
+{
+    int y, m, d, hh, mm, ss;
+    int length = 0;
+    char check[32];
+
+    if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2dZ%n", &y, &m, &d, &hh, &mm, &ss, &length) != 6 || text[length] != '\0')
+    {
+        return false;
+    }
+
+    *timestamp = archive_daysFromCivil(y, m, d) * 86400 + hh * 3600 + mm * 60 + ss;
+    archive_formatTimestamp(*timestamp, check, sizeof(check));
+    return strcmp(check, text) == 0;
+}
+
+static bool archive_channelFromJson(cJSON * obj, uint32_t * value)
+{
+    double v;
+
+    if (!cJSON_IsNumber(obj))
+    {
+        return false;
+    }
+    v = cJSON_GetNumberValue(obj);
+    if (!(v >= 0.0 && v <= 4294967295.0) || floor(v) != v || signbit(v))
+    {
+        return false;
+    }
+    *value = (uint32_t)v;
+    return true;
+}
+
+// only objects that convert back to the same JSON are stored in the record
+static bool archive_singleMeasurementFromJson(cJSON * obj, SingleMeasurement_t * measurement)
+{
+    const char * const keys[] = {DICT_230, DICT_260, DICT_280, DICT_340};
+    Channel_t * channels[] = {&measurement->channel230, &measurement->channel260, &measurement->channel280, &measurement->channel340};
+    cJSON * iterator = NULL;
+    size_t i = 0;
+
+    if (!cJSON_IsObject(obj) || cJSON_GetArraySize(obj) != 4)
+    {
+        return false;
+    }
+
+    cJSON_ArrayForEach(iterator, obj)
+    {
+        cJSON * oSample = iterator->child;
+        cJSON * oReference = oSample ? oSample->next : NULL;
+
+        if (strcmp(iterator->string, keys[i]) != 0 || !cJSON_IsObject(iterator) || cJSON_GetArraySize(iterator) != 2 ||
+            strcmp(oSample->string, DICT_SAMPLE) != 0 || strcmp(oReference->string, DICT_REFERENCE) != 0 ||
+            !archive_channelFromJson(oSample, &channels[i]->sample) || !archive_channelFromJson(oReference, &channels[i]->reference))
+        {
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+static bool archive_resultsFromJson(cJSON * obj, double * results)
+{
+    cJSON * iterator = NULL;
+    size_t i = 0;
+
+    if (!cJSON_IsObject(obj) || cJSON_GetArraySize(obj) != ARCHIVE_RESULTS_COUNT)
+    {
+        return false;
+    }
+
+    cJSON_ArrayForEach(iterator, obj)
+    {
+        if (strcmp(iterator->string, archiveResultKeys[i]) != 0 || !cJSON_IsNumber(iterator))
+        {
+            return false;
+        }
+        results[i++] = cJSON_GetNumberValue(iterator);
+    }
+    return true;
+}
+
+static Error_t archive_recordFromJson(cJSON * item, ArchiveRecord_t * record, ArchiveStrings_t * strings)
+{
+    Error_t ret = ERROR_EVI_OK;
+    cJSON * extra = NULL;
+    cJSON * iterator = NULL;
+    char * text = NULL;
+
+    memset(record, 0, sizeof(*record));
+    record->comment = ARCHIVE_NO_STRING;
+    record->extra = ARCHIVE_NO_STRING;
+
+    if (!cJSON_IsObject(item))
+    {
+        // kept as is, archive_recordToJson() returns the extra JSON unchanged
+        text = cJSON_PrintUnformatted(item);
+        record->flags = ARCHIVE_RECORD_IRREGULAR;
+        goto cleanup;
+    }
+
+    extra = cJSON_CreateObject();
+    if (!extra)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+
+    while ((iterator = cJSON_DetachItemFromArray(item, 0)) != NULL)
+    {
+        const char * name = iterator->string;
+        bool stored = false;
+
+        if (strcmp(name, DICT_BASELINE) == 0 && !(record->flags & ARCHIVE_RECORD_BASELINE))
+        {
+            stored = archive_singleMeasurementFromJson(iterator, &record->baseline);
+            record->flags |= stored ? ARCHIVE_RECORD_BASELINE : 0;
+        }
+        else if (strcmp(name, DICT_AIR) == 0 && !(record->flags & ARCHIVE_RECORD_AIR))
+        {
+            stored = archive_singleMeasurementFromJson(iterator, &record->air);
+            record->flags |= stored ? ARCHIVE_RECORD_AIR : 0;
+        }
+        else if (strcmp(name, DICT_SAMPLE) == 0 && !(record->flags & ARCHIVE_RECORD_SAMPLE))
+        {
+            stored = archive_singleMeasurementFromJson(iterator, &record->sample);
+            record->flags |= stored ? ARCHIVE_RECORD_SAMPLE : 0;
+        }
+        else if (strcmp(name, DICT_RESULTS) == 0 && !(record->flags & ARCHIVE_RECORD_RESULTS))
+        {
+            stored = archive_resultsFromJson(iterator, record->results);
+            record->flags |= stored ? ARCHIVE_RECORD_RESULTS : 0;
+        }
+        else if (strcmp(name, DICT_DATE_TIME) == 0 && !(record->flags & ARCHIVE_RECORD_TIMESTAMP))
+        {
+            stored = cJSON_IsString(iterator) && archive_parseTimestamp(cJSON_GetStringValue(iterator), &record->timestamp);
+            record->flags |= stored ? ARCHIVE_RECORD_TIMESTAMP : 0;
+        }
+        else if (strcmp(name, DICT_COMMENT) == 0 && record->comment == ARCHIVE_NO_STRING && cJSON_IsString(iterator))
+        {
+            record->comment = archive_addString(strings, cJSON_GetStringValue(iterator));
+            if (record->comment == ARCHIVE_NO_STRING)
+            {
+                cJSON_Delete(iterator);
+                ret = ERROR_EVI_FILE_IO_ERROR;
+                goto cleanup;
+            }
+            stored = true;
+        }
+
+        if (stored)
+        {
+            cJSON_Delete(iterator);
+        }
+        else
+        {
+            if (archive_isCoreKey(name))
+            {
+                record->flags |= ARCHIVE_RECORD_IRREGULAR;
+            }
+            cJSON_AddItemToArray(extra, iterator);
+        }
+    }
+
+    if (extra->child)
+    {
+        text = cJSON_PrintUnformatted(extra);
+    }
+
+cleanup:
+    if (ret == ERROR_EVI_OK && text)
+    {
+        record->extra = archive_addString(strings, text);
+        if (record->extra == ARCHIVE_NO_STRING)
+        {
+            ret = ERROR_EVI_FILE_IO_ERROR;
+        }
+    }
+    free(text);
+    cJSON_Delete(extra);
+    return ret;
+}
+
+Error_t archive_fromJson(cJSON * json, const char * file)
+{
+    Error_t ret = ERROR_EVI_OK;
+    ArchiveHeader_t header;
+    ArchiveStrings_t strings = {0};
+    ArchiveRecord_t * records = NULL;
+    cJSON * oMeasurements = cJSON_IsObject(json) ? cJSON_GetObjectItemCaseSensitive(json, DICT_MEASUREMENTS) : NULL;
+    cJSON * iterator = NULL;
+    size_t count = 0;
+    char * document = NULL;
+    char * temp = NULL;
+    FILE * fout = NULL;
+
+    if (!archive_hostIsLittleEndian())
+    {
+        return ERROR_EVI_FILE_IO_ERROR;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.version = ARCHIVE_VERSION;
+    header.headerSize = sizeof(ArchiveHeader_t);
+    header.recordSize = sizeof(ArchiveRecord_t);
+    header.recordsOffset = sizeof(ArchiveHeader_t);
+
+    if (cJSON_IsArray(oMeasurements))
+    {
+        int type = oMeasurements->type;
+        cJSON * child = oMeasurements->child;
+
+        // the document keeps a null placeholder where the measurements belong
+        oMeasurements->type = cJSON_NULL;
+        oMeasurements->child = NULL;
+        document = cJSON_PrintUnformatted(json);
+        oMeasurements->type = type;
+        oMeasurements->child = child;
+
+        count = (size_t)cJSON_GetArraySize(oMeasurements);
+        records = calloc(count ? count : 1, sizeof(ArchiveRecord_t));
+        if (!records)
+        {
+            ret = ERROR_EVI_FILE_IO_ERROR;
+            goto cleanup;
+        }
+
+        count = 0;
+        cJSON_ArrayForEach(iterator, oMeasurements)
+        {
+            ret = archive_recordFromJson(iterator, &records[count++], &strings);
+            if (ret != ERROR_EVI_OK)
+            {
+                goto cleanup;
+            }
+        }
+    }
+    else
+    {
+        document = cJSON_PrintUnformatted(json);
+    }
+
+    header.document = document ? archive_addString(&strings, document) : ARCHIVE_NO_STRING;
+    header.recordCount = count;
+    header.stringsOffset = header.recordsOffset + count * sizeof(ArchiveRecord_t);
+    header.stringsSize = strings.length;
+
+    // the archive may be the only copy of the data, it is replaced only once the new one is complete
+    temp = malloc_printf("%s.tmp", file);
+    fout = temp ? fopen(temp, "wb") : NULL;
+    if (!fout)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fout) != 1 ||
+        (count > 0 && fwrite(records, sizeof(ArchiveRecord_t), count, fout) != count) ||
+        (strings.length > 0 && fwrite(strings.data, 1, strings.length, fout) != strings.length))
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+    }
+
+    if (fclose(fout) != 0)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+    }
+    if (ret == ERROR_EVI_OK && !eviReplaceFile(temp, file))
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+    }
+    if (ret != ERROR_EVI_OK)
+    {
+        remove(temp);
+    }
+
+cleanup:
+    free(temp);
+    free(document);
+    free(records);
+    free(strings.data);
+    return ret;
+}
+
+bool archive_isArchive(const char * file)
+{
+    char magic[sizeof(ARCHIVE_MAGIC)] = {0};
+    FILE * fin = fopen(file, "rb");
+    bool ret = false;
+
+    if (fin)
+    {
+        ret = fread(magic, 1, sizeof(magic), fin) == sizeof(magic) && memcmp(magic, ARCHIVE_MAGIC, sizeof(magic)) == 0;
+        fclose(fin);
+    }
+    return ret;
+}
+
+Error_t archive_open(const char * file, Archive_t * archive)
+{
+    Error_t ret = ERROR_EVI_OK;
+    const ArchiveHeader_t * header = NULL;
+    uint64_t size;
+
+    memset(archive, 0, sizeof(*archive));
+
+    ret = eviFileMap(file, &archive->mapping);
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+
+    size = archive->mapping.size;
+    header = archive->mapping.data;
+    if (!archive_hostIsLittleEndian() || size < sizeof(ArchiveHeader_t) ||
+        memcmp(header->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || header->version != ARCHIVE_VERSION)
+    {
+        goto invalid;
+    }
+
+    // records must be aligned for direct access and everything must lie inside the file
+    if (header->headerSize < sizeof(ArchiveHeader_t) || header->recordSize < sizeof(ArchiveRecord_t) ||
+        header->recordSize % 8 != 0 || header->recordsOffset % 8 != 0 || header->recordsOffset < header->headerSize ||
+        header->recordsOffset > size || header->recordCount > (size - header->recordsOffset) / header->recordSize ||
+        header->stringsOffset > size || header->stringsSize > size - header->stringsOffset ||
+        (header->stringsSize > 0 && ((const char *)header)[header->stringsOffset + header->stringsSize - 1] != '\0'))
+    {
+        goto invalid;
+    }
+
+    archive->header = header;
+    archive->strings = (const char *)header + header->stringsOffset;
+    return ERROR_EVI_OK;
+
+invalid:
+    eviFileUnmap(&archive->mapping);
+    return ERROR_EVI_FILE_IO_ERROR;
+}
+
+void archive_close(Archive_t * archive)
+{
+    eviFileUnmap(&archive->mapping);
+    memset(archive, 0, sizeof(*archive));
+}
+
+size_t archive_count(const Archive_t * archive)
+{
+    return (size_t)archive->header->recordCount;
+}
+
+const ArchiveRecord_t * archive_record(const Archive_t * archive, size_t index)
+{
+    return (const ArchiveRecord_t *)((const char *)archive->header + archive->header->recordsOffset + index * archive->header->recordSize);
+}
+
+const char * archive_string(const Archive_t * archive, uint32_t offset)
+{
+    if (offset == ARCHIVE_NO_STRING || offset >= archive->header->stringsSize)
+    {
+        return NULL;
+    }
+    return archive->strings + offset;
+}
+
+cJSON * archive_recordToJson(const Archive_t * archive, const ArchiveRecord_t * record)
+{
+    cJSON * extra = NULL;
+    cJSON * obj = NULL;
+    cJSON * iterator = NULL;
+
+    if (record->extra != ARCHIVE_NO_STRING)
+    {
+        const char * text = archive_string(archive, record->extra);
+        extra = text ? cJSON_Parse(text) : NULL;
+        if (!extra)
+        {
+            return NULL;
+        }
+        if (!cJSON_IsObject(extra))
+        {
+            return extra;
+        }
+    }
+
+    obj = cJSON_CreateObject();
+    if (record->flags & ARCHIVE_RECORD_BASELINE)
+    {
+        cJSON_AddItemToObject(obj, DICT_BASELINE, singleMeasurement_toJson(&record->baseline));
+    }
+    if (record->flags & ARCHIVE_RECORD_AIR)
+    {
+        cJSON_AddItemToObject(obj, DICT_AIR, singleMeasurement_toJson(&record->air));
+    }
+    if (record->flags & ARCHIVE_RECORD_SAMPLE)
+    {
+        cJSON_AddItemToObject(obj, DICT_SAMPLE, singleMeasurement_toJson(&record->sample));
+    }
+    if (record->flags & ARCHIVE_RECORD_TIMESTAMP)
+    {
+        char text[32];
+        archive_formatTimestamp(record->timestamp, text, sizeof(text));
+        cJSON_AddItemToObject(obj, DICT_DATE_TIME, cJSON_CreateString(text));
+    }
+    if (extra)
+    {
+        while ((iterator = cJSON_DetachItemFromArray(extra, 0)) != NULL)
+        {
+            cJSON_AddItemToArray(obj, iterator);
+        }
+        cJSON_Delete(extra);
+    }
+    if (record->comment != ARCHIVE_NO_STRING)
+    {
+        const char * comment = archive_string(archive, record->comment);
+        cJSON_AddItemToObject(obj, DICT_COMMENT, cJSON_CreateString(comment ? comment : ""));
+    }
+    if (record->flags & ARCHIVE_RECORD_RESULTS)
+    {
+        cJSON * oResults = cJSON_CreateObject();
+        for (size_t i = 0; i < ARCHIVE_RESULTS_COUNT; i++)
+        {
+            cJSON_AddItemToObject(oResults, archiveResultKeys[i], cJSON_CreateNumber(record->results[i]));
+        }
+        cJSON_AddItemToObject(obj, DICT_RESULTS, oResults);
+    }
+
+    return obj;
+}
+
+cJSON * archive_toJson(const Archive_t * archive)
+{
+    cJSON * json = NULL;
+    cJSON * oMeasurements = NULL;
+    size_t count = archive_count(archive);
+
+    if (archive->header->document != ARCHIVE_NO_STRING)
+    {
+        const char * text = archive_string(archive, archive->header->document);
+        json = text ? cJSON_Parse(text) : NULL;
+        if (!json)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        json = cJSON_CreateObject();
+    }
+
+    if (!cJSON_IsObject(json))
+    {
+        return json;
+    }
+
+    oMeasurements = cJSON_GetObjectItemCaseSensitive(json, DICT_MEASUREMENTS);
+    if (oMeasurements && (oMeasurements->type & 0xFF) == cJSON_NULL)
+    {
+        oMeasurements->type = cJSON_Array;
+    }
+    else if (count > 0)
+    {
+        oMeasurements = cJSON_AddArrayToObject(json, DICT_MEASUREMENTS);
+    }
+    else
+    {
+        return json;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        cJSON * item = archive_recordToJson(archive, archive_record(archive, i));
+        if (!item)
+        {
+            cJSON_Delete(json);
+            return NULL;
+        }
+        cJSON_AddItemToArray(oMeasurements, item);
+    }
+
+    return json;
+}
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+#include "singlemeasurement.h"
+#include "cJSON.h"
+
+/**
+ * Binary measurement archive
+ *
+ * Layout, all values little-endian:
+ *   ArchiveHeader_t
+ *   recordCount records of recordSize bytes, starting at recordsOffset
+ *   string table of stringsSize bytes, starting at stringsOffset
+ *
+ * Records have a fixed size, record i starts at recordsOffset + i * recordSize,
+ * so the record table is the index of the archive. Strings are stored
+ * null-terminated in the string table and referenced by their offset.
+ *
+ * Values that do not fit a record field, e.g. the logging of a measurement or
+ * a non-integer channel value, are kept as unformatted JSON in the string
+ * table, so an archive converts back to the original JSON document.
+ */
+
+#define ARCHIVE_MAGIC "EVIDARC"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_NO_STRING 0xFFFFFFFFu
+
+#define ARCHIVE_RECORD_BASELINE  0x0001u /**< ArchiveRecord_t::baseline is valid. */
+#define ARCHIVE_RECORD_AIR       0x0002u /**< ArchiveRecord_t::air is valid. */
+#define ARCHIVE_RECORD_SAMPLE    0x0004u /**< ArchiveRecord_t::sample is valid. */
+#define ARCHIVE_RECORD_RESULTS   0x0008u /**< ArchiveRecord_t::results is valid. */
+#define ARCHIVE_RECORD_TIMESTAMP 0x0010u /**< ArchiveRecord_t::timestamp is valid. */
+#define ARCHIVE_RECORD_IRREGULAR 0x0020u /**< A baseline, air, sample, date_time, comment or results member is stored in the extra JSON. */
+
+/**
+ * @brief Number of values in ArchiveRecord_t::results.
+ */
+#define ARCHIVE_RESULTS_COUNT 9
+
+/**
+ * @struct ArchiveHeader_t
+ * @brief File header of an archive.
+ */
+typedef struct
+{
+    char     magic[8];      /**< ARCHIVE_MAGIC, null-terminated. */
+    uint32_t version;       /**< ARCHIVE_VERSION. */
+    uint32_t headerSize;    /**< Size of this header in bytes. */
+    uint32_t recordSize;    /**< Size of a record in bytes, at least sizeof(ArchiveRecord_t). */
+    uint32_t document;      /**< String with the top-level members of the JSON document except the measurements, or ARCHIVE_NO_STRING. */
+    uint64_t recordCount;   /**< Number of records. */
+    uint64_t recordsOffset; /**< File offset of the first record. */
+    uint64_t stringsOffset; /**< File offset of the string table. */
+    uint64_t stringsSize;   /**< Size of the string table in bytes. */
+} ArchiveHeader_t;
+
+/**
+ * @struct ArchiveRecord_t
+ * @brief One measurement of an archive.
+ */
+typedef struct
+{
+    uint32_t flags;         /**< ARCHIVE_RECORD_* flags. */
+    uint32_t comment;       /**< Comment string or ARCHIVE_NO_STRING. */
+    uint32_t extra;         /**< String with the remaining members as a JSON object, or ARCHIVE_NO_STRING. */
+    uint32_t reserved;      /**< Always 0. */
+    int64_t  timestamp;     /**< Measurement time in seconds since 1970-01-01 UTC. */
+    SingleMeasurement_t baseline; /**< Baseline measurement. */
+    SingleMeasurement_t air;      /**< Air measurement. */
+    SingleMeasurement_t sample;   /**< Sample measurement. */
+    double   results[ARCHIVE_RESULTS_COUNT]; /**< dsDNA, ssDNA, ssRNA, A230, A260, A280, A340, purity 260/230 and purity 260/280. */
+} ArchiveRecord_t;
+
+/**
+ * @struct Archive_t
+ * @brief An archive opened for reading.
+ */
+typedef struct
+{
+    EviFileMapping_t mapping;      /**< Mapped archive file. */
+    const ArchiveHeader_t * header; /**< Header at the start of the mapping. */
+    const char * strings;          /**< Start of the string table. */
+} Archive_t;
+
+/**
+ * @brief JSON keys of ArchiveRecord_t::results, in order.
+ */
+extern const char * const archiveResultKeys[ARCHIVE_RESULTS_COUNT];
+
+/**
+ * @brief Checks whether a file starts with the archive magic.
+ *
+ * @param file Path of the file.
+ * @return true if the file is an archive.
+ */
+bool archive_isArchive(const char * file);
+
+/**
+ * @brief Maps an archive and validates its header.
+ *
+ * @param file Path of the archive.
+ * @param archive Receives the opened archive, close it with archive_close().
+ * @return ERROR_EVI_OK, ERROR_EVI_FILE_NOT_FOUND or ERROR_EVI_FILE_IO_ERROR if the file is not a valid archive.
+ */
+Error_t archive_open(const char * file, Archive_t * archive);
+
+/**
+ * @brief Unmaps an archive.
+ *
+ * @param archive Archive opened by archive_open().
+ */
+void archive_close(Archive_t * archive);
+
+/**
+ * @brief Returns the number of records of an archive.
+ *
+ * @param archive Opened archive.
+ * @return Number of records.
+ */
+size_t archive_count(const Archive_t * archive);
+
+/**
+ * @brief Returns a record of an archive.
+ *
+ * @param archive Opened archive.
+ * @param index Index of the record, less than archive_count().
+ * @return Pointer into the mapped file.
+ */
+const ArchiveRecord_t * archive_record(const Archive_t * archive, size_t index);
+
+/**
+ * @brief Returns a string of the string table.
+ *
+ * @param archive Opened archive.
+ * @param offset Offset of the string, may be ARCHIVE_NO_STRING.
+ * @return The string, or NULL for ARCHIVE_NO_STRING or an invalid offset.
+ */
+const char * archive_string(const Archive_t * archive, uint32_t offset);
+
+/**
+ * @brief Converts a record into the JSON object of a measurement.
+ *
+ * @param archive Opened archive.
+ * @param record Record of the archive.
+ * @return The measurement object, to be freed with cJSON_Delete(), or NULL if the extra JSON is corrupt.
+ */
+cJSON * archive_recordToJson(const Archive_t * archive, const ArchiveRecord_t * record);
+
+/**
+ * @brief Converts a whole archive into a JSON document.
+ *
+ * @param archive Opened archive.
+ * @return The document, to be freed with cJSON_Delete(), or NULL if the archive is corrupt.
+ */
+cJSON * archive_toJson(const Archive_t * archive);
+
+/**
+ * @brief Writes a JSON document as an archive.
+ *
+ * The members of the measurements are moved out of the document while
+ * converting, only the emptied items remain. An existing file is replaced
+ * only once the archive has been written completely.
+ *
+ * @param json Document with a "measurements" array.
+ * @param file Path of the archive to write.
+ * @return ERROR_EVI_OK or ERROR_EVI_FILE_IO_ERROR.
+ */
+Error_t archive_fromJson(cJSON * json, const char * file);
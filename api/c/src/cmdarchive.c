@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "cmdarchive.h"
+#include "archive.h"
+#include "json.h"
+#include "printerror.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static Error_t cmdArchivePack(const char * fileJson, const char * fileArchive)
+{
+    Error_t ret = ERROR_EVI_OK;
+    cJSON * json = json_loadFromFile(fileJson);
+
+    if (json == NULL)
+    {
+        return printError(ERROR_EVI_FILE_NOT_FOUND, "File %s not found.", fileJson);
+    }
+
+    ret = archive_fromJson(json, fileArchive);
+    if (ret != ERROR_EVI_OK)
+    {
+        printError(ret, "Could not write %s.\n", fileArchive);
+    }
+
+    cJSON_Delete(json);
+    return ret;
+}
+
+static Error_t cmdArchiveUnpack(const char * fileArchive, const char * fileJson)
+{
+    Error_t ret = ERROR_EVI_OK;
+    Archive_t archive;
+    cJSON * json = NULL;
+
+    ret = archive_open(fileArchive, &archive);
+    if (ret != ERROR_EVI_OK)
+    {
+        return printError(ret, "Could not read archive %s.", fileArchive);
+    }
+
+    json = archive_toJson(&archive);
+    archive_close(&archive);
+
+    if (json == NULL)
+    {
+        return printError(ERROR_EVI_FILE_IO_ERROR, "Archive %s is corrupt.", fileArchive);
+    }
+
+    if (!json_saveToFile(fileJson, json))
+    {
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "Could not write %s.\n", fileJson);
+    }
+    cJSON_Delete(json);
+    return ret;
+}
+
+Error_t cmdArchive(Evi_t *self, int argcCmd, char **argvCmd)
+{
+    if ((argcCmd == 4) && (strcmp(argvCmd[1], "pack") == 0))
+    {
+        return cmdArchivePack(argvCmd[2], argvCmd[3]);
+    }
+    else if ((argcCmd == 4) && (strcmp(argvCmd[1], "unpack") == 0))
+    {
+        return cmdArchiveUnpack(argvCmd[2], argvCmd[3]);
+    }
+
+    return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
+}
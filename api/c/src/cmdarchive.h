@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @brief Implements the `archive` command converting between JSON data files and binary archives.
+ *
+ * @param self Pointer to the device instance, not used by this command.
+ * @param argcCmd Number of command arguments stored in `argvCmd`.
+ * @param argvCmd Array of command arguments to parse.
+ * @return Error code indicating success or failure.
+ */
+Error_t cmdArchive(Evi_t * self, int argcCmd, char **argvCmd);
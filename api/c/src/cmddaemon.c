@@ -0,0 +1,598 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#define _GNU_SOURCE // struct ucred
+#endif
+
+#include "cmddaemon.h"
+#include "cmdrun.h"
+#include "printerror.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN64) || defined(_WIN32)
+
+const char * daemonSocketPath(const char * socketPath, char * buffer, size_t bufferSize)
+{
+    (void)buffer;
+    (void)bufferSize;
+    if (socketPath == NULL)
+    {
+        socketPath = getenv(DAEMON_SOCKET_ENV);
+    }
+    return socketPath ? socketPath : "evidense.sock";
+}
+
+Error_t cmdDaemon(Evi_t * self, const char * socketPath, DaemonExecute_t execute, int argcCmd, char **argvCmd)
+{
+    return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, "The daemon is not supported on this platform.\n");
+}
+
+Error_t daemonForward(const char * socketPath, const char * serial, int argcCmd, char **argvCmd)
+{
+    return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_OPTION, "The daemon is not supported on this platform.\n");
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A request is a uint32_t with the size of the following strings: the working
+// directory of the client, optionally "--serial" and the serial number, and
+// the arguments of the command, each null-terminated. The
+// client's stdout and stderr are passed along with the size. The response is
+// the int32_t result of the command.
+
+#define DAEMON_MAX_REQUEST    (64 * 1024)
+#define DAEMON_MAX_ARGS       256
+#define DAEMON_FLUSH_DELAY_MS 1000
+#define DAEMON_IO_TIMEOUT_S   5
+
+static volatile sig_atomic_t daemonStopRequested = 0;
+
+static void daemonSignal(int signal)
+{
+    (void)signal;
+    daemonStopRequested = 1;
+}
+
+static bool daemonRead(int fd, void * buffer, size_t size)
+{
+    char * p = buffer;
+
+    while (size > 0)
+    {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool daemonWrite(int fd, const void * buffer, size_t size)
+{
+    const char * p = buffer;
+
+    while (size > 0)
+    {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool daemonAddress(const char * socketPath, struct sockaddr_un * address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address->sun_path))
+    {
+        return false;
+    }
+    strcpy(address->sun_path, socketPath);
+    return true;
+}
+
+static int daemonConnect(const char * socketPath)
+{
+    struct sockaddr_un address;
+    int fd;
+
+    if (!daemonAddress(socketPath, &address))
+    {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int daemonListen(const char * socketPath)
+{
+    struct sockaddr_un address;
+    mode_t mask;
+    int fd;
+
+    if (!daemonAddress(socketPath, &address))
+    {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // only the user may connect, the socket file gets mode 0600
+    mask = umask(077);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        int other;
+
+        if (errno != EADDRINUSE)
+        {
+            umask(mask);
+            goto error;
+        }
+
+        // a socket file nobody listens on is left over from a crashed daemon
+        other = daemonConnect(socketPath);
+        if (other >= 0)
+        {
+            close(other);
+            umask(mask);
+            goto error;
+        }
+        unlink(socketPath);
+        if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            umask(mask);
+            goto error;
+        }
+    }
+    umask(mask);
+
+    if (listen(fd, 16) != 0)
+    {
+        unlink(socketPath);
+        goto error;
+    }
+    return fd;
+
+error:
+    close(fd);
+    return -1;
+}
+
+// The commands run with the rights of the daemon, e.g., update the firmware
+// or write files, so only its own user may send them.
+static bool daemonPeerAllowed(int client)
+{
+#if defined(SO_PEERCRED)
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    return getsockopt(client, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && credentials.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+
+    return getpeereid(client, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+static bool daemonReceive(int client, char ** request, uint32_t * size, int fds[2])
+{
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov = {.iov_base = size, .iov_len = sizeof(*size)};
+    struct msghdr message = {0};
+    struct cmsghdr * cmsg;
+    ssize_t n;
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    do
+    {
+        n = recvmsg(client, &message, 0);
+    } while (n < 0 && errno == EINTR);
+
+    cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+    {
+        memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+    }
+
+    if (n != sizeof(*size) || fds[0] < 0 || fds[1] < 0 || *size == 0 || *size > DAEMON_MAX_REQUEST)
+    {
+        return false;
+    }
+
+    *request = malloc(*size);
+    if (*request == NULL || !daemonRead(client, *request, *size) || (*request)[*size - 1] != '\0')
+    {
+        return false;
+    }
+    return true;
+}
+
+// A command for another device than the one held by the daemon runs in a
+// session of its own, which is closed afterwards.
+static Error_t daemonExecute(Evi_t * self, DaemonExecute_t execute, const char * serial, int argc, char ** argv)
+{
+    Error_t ret;
+    char portName[256];
+    Evi_t other = {0};
+
+    if (serial == NULL)
+    {
+        return execute(self, argc, argv);
+    }
+    if (eviFindDeviceBySerial(serial, portName, sizeof(portName), self->verbose) != ERROR_EVI_OK)
+    {
+        return printError(ERROR_EVI_INSTRUMENT_NOT_FOUND, "No device with serial number %s.\n", serial);
+    }
+    if (self->portName != NULL && strcmp(self->portName, portName) == 0)
+    {
+        return execute(self, argc, argv);
+    }
+
+    other.verbose = self->verbose;
+    other.useChecksum = self->useChecksum;
+    other.timeout = self->timeout;
+    other.portName = portName;
+    ret = execute(&other, argc, argv);
+    eviSessionFree(&other);
+    return ret;
+}
+
+static void daemonHandle(Evi_t * self, DaemonExecute_t execute, int client, bool * stop)
+{
+    Error_t ret = ERROR_EVI_OK;
+    int fds[2] = {-1, -1};
+    char * request = NULL;
+    uint32_t size = 0;
+    char * argv[DAEMON_MAX_ARGS + 1];
+    int argc = 0;
+    char ** args = argv;
+    const char * serial = NULL;
+    int savedStdout = -1;
+    int savedStderr = -1;
+    int savedCwd = -1;
+    int32_t result;
+
+    if (!daemonPeerAllowed(client))
+    {
+        printError(ERROR_EVI_INVALID_PARAMETER, "Rejected a client of another user.\n");
+        goto cleanup;
+    }
+
+    if (!daemonReceive(client, &request, &size, fds))
+    {
+        goto cleanup;
+    }
+
+    // the first string is the working directory of the client
+    for (uint32_t i = (uint32_t)strlen(request) + 1; i < size && argc < DAEMON_MAX_ARGS; i += (uint32_t)strlen(request + i) + 1)
+    {
+        argv[argc++] = request + i;
+    }
+    argv[argc] = NULL;
+
+    if (argc >= 2 && strcmp(argv[0], "--serial") == 0)
+    {
+        serial = argv[1];
+        args += 2;
+        argc -= 2;
+    }
+
+    // the command writes to the terminal or pipes of the client
+    fflush(stdout);
+    fflush(stderr);
+    savedStdout = dup(STDOUT_FILENO);
+    savedStderr = dup(STDERR_FILENO);
+    savedCwd = open(".", O_RDONLY);
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+
+    if (argc == 0)
+    {
+        ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
+    }
+    else if (strcmp(args[0], "daemon") == 0)
+    {
+        if (argc == 2 && strcmp(args[1], "stop") == 0)
+        {
+            *stop = true;
+        }
+        else
+        {
+            ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, "The daemon is already running.\n");
+        }
+    }
+    else if (chdir(request) != 0)
+    {
+        ret = printError(ERROR_EVI_FILE_NOT_FOUND, "Directory %s not found.\n", request);
+    }
+    else
+    {
+        ret = daemonExecute(self, execute, serial, argc, args);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(savedStdout, STDOUT_FILENO);
+    dup2(savedStderr, STDERR_FILENO);
+    if (savedCwd >= 0 && fchdir(savedCwd) != 0)
+    {
+        printError(ERROR_EVI_FILE_IO_ERROR, "Could not restore the working directory.\n");
+    }
+
+    result = (int32_t)ret;
+    daemonWrite(client, &result, sizeof(result));
+
+cleanup:
+    if (savedStdout >= 0)
+    {
+        close(savedStdout);
+    }
+    if (savedStderr >= 0)
+    {
+        close(savedStderr);
+    }
+    if (savedCwd >= 0)
+    {
+        close(savedCwd);
+    }
+    if (fds[0] >= 0)
+    {
+        close(fds[0]);
+    }
+    if (fds[1] >= 0)
+    {
+        close(fds[1]);
+    }
+    free(request);
+}
+
+// The default socket is in a directory only the user can access: the
+// runtime directory of the session, or a private directory below /tmp.
+const char * daemonSocketPath(const char * socketPath, char * buffer, size_t bufferSize)
+{
+    const char * runtime = getenv("XDG_RUNTIME_DIR");
+    char directory[64];
+    struct stat st;
+
+    if (socketPath == NULL)
+    {
+        socketPath = getenv(DAEMON_SOCKET_ENV);
+    }
+    if (socketPath != NULL)
+    {
+        return socketPath;
+    }
+
+    if (runtime != NULL && runtime[0] == '/')
+    {
+        snprintf(buffer, bufferSize, "%s/evidense.sock", runtime);
+        return buffer;
+    }
+
+    // another user may have created the directory first
+    snprintf(directory, sizeof(directory), "/tmp/evidense-%u", (unsigned)getuid());
+    if ((mkdir(directory, 0700) != 0 && errno != EEXIST) || lstat(directory, &st) != 0 ||
+        !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077) != 0)
+    {
+        return NULL;
+    }
+    snprintf(buffer, bufferSize, "%s/daemon.sock", directory);
+    return buffer;
+}
+
+Error_t cmdDaemon(Evi_t * self, const char * socketPath, DaemonExecute_t execute, int argcCmd, char **argvCmd)
+{
+    struct sigaction action = {0};
+    bool stop = false;
+    int listener;
+
+    if (socketPath == NULL)
+    {
+        return printError(ERROR_EVI_FILE_IO_ERROR, "No private directory for the daemon socket, use --socket PATH.\n");
+    }
+    if (argcCmd == 2 && strcmp(argvCmd[1], "stop") == 0)
+    {
+        return daemonForward(socketPath, NULL, argcCmd, argvCmd);
+    }
+    else if (argcCmd != 1)
+    {
+        return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
+    }
+
+    listener = daemonListen(socketPath);
+    if (listener < 0)
+    {
+        return printError(ERROR_EVI_FILE_IO_ERROR, "Could not listen on %s, is a daemon already running?\n", socketPath);
+    }
+
+    // no SA_RESTART, poll() returns on a signal
+    action.sa_handler = daemonSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // a missing device is not fatal, every command opens the session again
+    eviSessionOpen(self);
+    cmdRunCacheState(true);
+
+    fprintf_s(stdout, "Listening on %s\n", socketPath);
+    fflush(stdout);
+
+    while (!stop && !daemonStopRequested)
+    {
+        struct pollfd pfd = {.fd = listener, .events = POLLIN};
+        int n = poll(&pfd, 1, DAEMON_FLUSH_DELAY_MS);
+
+        if (n == 0)
+        {
+            // idle, write the run state in case a process reads the state file directly
+            cmdRunFlushState();
+        }
+        else if (n > 0)
+        {
+            int client = accept(listener, NULL, NULL);
+            if (client >= 0)
+            {
+                struct timeval timeout = {.tv_sec = DAEMON_IO_TIMEOUT_S};
+                setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                daemonHandle(self, execute, client, &stop);
+                close(client);
+            }
+        }
+    }
+
+    cmdRunCacheState(false);
+    eviSessionClose(self);
+    close(listener);
+    unlink(socketPath);
+
+    return ERROR_EVI_OK;
+}
+
+Error_t daemonForward(const char * socketPath, const char * serial, int argcCmd, char **argvCmd)
+{
+    Error_t ret = ERROR_EVI_OK;
+    char cwd[4096];
+    char * request = NULL;
+    uint32_t size = 0;
+    int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))] = {0};
+    struct iovec iov = {.iov_base = &size, .iov_len = sizeof(size)};
+    struct msghdr message = {0};
+    struct cmsghdr * cmsg;
+    int32_t result;
+    size_t length;
+    int fd;
+
+    if (socketPath == NULL)
+    {
+        return printError(ERROR_EVI_FILE_IO_ERROR, "No private directory for the daemon socket, use --socket PATH.\n");
+    }
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        return printError(ERROR_EVI_FILE_IO_ERROR, "Could not get the working directory.\n");
+    }
+
+    length = strlen(cwd) + 1;
+    if (serial != NULL)
+    {
+        length += sizeof("--serial") + strlen(serial) + 1;
+    }
+    for (int i = 0; i < argcCmd; i++)
+    {
+        length += strlen(argvCmd[i]) + 1;
+    }
+    if (length > DAEMON_MAX_REQUEST || argcCmd + 2 > DAEMON_MAX_ARGS)
+    {
+        return printError(ERROR_EVI_INVALID_PARAMETER, "Command line too long for the daemon.\n");
+    }
+
+    request = malloc(length);
+    if (request == NULL)
+    {
+        return printError(ERROR_EVI_FILE_IO_ERROR, NULL);
+    }
+    size = 0;
+    memcpy(request, cwd, strlen(cwd) + 1);
+    size += (uint32_t)strlen(cwd) + 1;
+    if (serial != NULL)
+    {
+        memcpy(request + size, "--serial", sizeof("--serial"));
+        size += (uint32_t)sizeof("--serial");
+        memcpy(request + size, serial, strlen(serial) + 1);
+        size += (uint32_t)strlen(serial) + 1;
+    }
+    for (int i = 0; i < argcCmd; i++)
+    {
+        memcpy(request + size, argvCmd[i], strlen(argvCmd[i]) + 1);
+        size += (uint32_t)strlen(argvCmd[i]) + 1;
+    }
+
+    fd = daemonConnect(socketPath);
+    if (fd < 0)
+    {
+        free(request);
+        return printError(ERROR_EVI_FILE_IO_ERROR, "No daemon listening on %s.\n", socketPath);
+    }
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    fflush(stdout);
+    fflush(stderr);
+
+    if (sendmsg(fd, &message, MSG_NOSIGNAL) != sizeof(size) || !daemonWrite(fd, request, size))
+    {
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "Could not send the command to the daemon.\n");
+    }
+    else if (!daemonRead(fd, &result, sizeof(result)))
+    {
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "The daemon closed the connection.\n");
+    }
+    else
+    {
+        ret = (Error_t)result;
+    }
+
+    close(fd);
+    free(request);
+    return ret;
+}
+
+#endif
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @brief Environment variable with the socket path used when --socket is omitted.
+ */
+#define DAEMON_SOCKET_ENV "EVIDENSE_SOCKET"
+
+/**
+ * @brief Executes one command line, the same way main() does.
+ *
+ * @param self Pointer to the device instance held by the daemon.
+ * @param argcCmd Number of command arguments stored in `argvCmd`.
+ * @param argvCmd Command and its arguments.
+ * @return Error code of the command, used as exit code.
+ */
+typedef Error_t (*DaemonExecute_t)(Evi_t * self, int argcCmd, char **argvCmd);
+
+/**
+ * @brief Returns the socket path of the daemon.
+ *
+ * @param socketPath Path given with --socket, or NULL.
+ * @param buffer Buffer for the default path.
+ * @param bufferSize Size of buffer.
+ * @return socketPath, the value of DAEMON_SOCKET_ENV or a default path in
+ *         $XDG_RUNTIME_DIR or in a directory below /tmp only the user can
+ *         access, NULL if that directory is not safe.
+ */
+const char * daemonSocketPath(const char * socketPath, char * buffer, size_t bufferSize);
+
+/**
+ * @brief Implements the `daemon` command.
+ *
+ * `daemon` keeps the device session and the run state open and executes the
+ * commands forwarded by clients until it is stopped with `daemon stop`,
+ * SIGINT or SIGTERM.
+ *
+ * @param self Pointer to the device instance kept open by the daemon.
+ * @param socketPath Path of the UNIX socket.
+ * @param execute Function executing a forwarded command.
+ * @param argcCmd Number of command arguments stored in `argvCmd`.
+ * @param argvCmd Array of command arguments to parse.
+ * @return Error code indicating success or failure.
+ */
+Error_t cmdDaemon(Evi_t * self, const char * socketPath, DaemonExecute_t execute, int argcCmd, char **argvCmd);
+
+/**
+ * @brief Forwards a command to a running daemon.
+ *
+ * The daemon writes the output of the command directly to stdout and stderr
+ * of the calling process. A serial number is forwarded unresolved, the daemon
+ * looks the device up itself.
+ *
+ * @param socketPath Path of the UNIX socket.
+ * @param serial USB serial number given with --serial, or NULL.
+ * @param argcCmd Number of command arguments stored in `argvCmd`.
+ * @param argvCmd Command and its arguments.
+ * @return Error code of the command, or ERROR_EVI_FILE_IO_ERROR if the daemon is not reachable.
+ */
+Error_t daemonForward(const char * socketPath, const char * serial, int argcCmd, char **argvCmd);
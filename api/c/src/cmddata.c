@@ -6,10 +6,24 @@
 #include "json.h"
 #include "dict.h"
 #include "measurement.h"
+#include "archive.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+static cJSON *dataLoadArchive(const char *file)
+{
+    Archive_t archive;
+    cJSON *json = NULL;
+
+    if (archive_open(file, &archive) == ERROR_EVI_OK)
+    {
+        json = archive_toJson(&archive);
+        archive_close(&archive);
+    }
+    return json;
+}
+
 static Error_t cmdCalculate(Evi_t *self, int argcCmd, char **argvCmd)
 {
     Error_t ret = ERROR_EVI_OK;
@@ -51,8 +65,9 @@ static Error_t cmdCalculate(Evi_t *self, int argcCmd, char **argvCmd)
     if (i < argcCmd)
     {
         char *file = argvCmd[i];
+        bool isArchive = archive_isArchive(file);
 
-        cJSON *json = json_loadFromFile(file);
+        cJSON *json = isArchive ? dataLoadArchive(file) : json_loadFromFile(file);
 
         if (json != NULL)
         {
@@ -62,7 +77,18 @@ static Error_t cmdCalculate(Evi_t *self, int argcCmd, char **argvCmd)
             if (oMeasurements)
             {
                 measurement_calculate(oMeasurements, &parameters);
-                json_saveToFile(file, json);
+                if (isArchive)
+                {
+                    ret = archive_fromJson(json, file);
+                }
+                else if (!json_saveToFile(file, json))
+                {
+                    ret = ERROR_EVI_FILE_IO_ERROR;
+                }
+                if (ret != ERROR_EVI_OK)
+                {
+                    printError(ret, "Could not write %s.\n", file);
+                }
             }
 
             cJSON_Delete(json);
@@ -76,8 +102,81 @@ static Error_t cmdCalculate(Evi_t *self, int argcCmd, char **argvCmd)
     return ret;
 }
 
+static void dataPrintValues(double dsDNA, double ssDNA, double ssRNA, double purity260_230, double purity260_280, const char *comment)
+{
+    fprintf_s(stdout, "%f %f %f  %f %f ", dsDNA, ssDNA, ssRNA, purity260_230, purity260_280);
+    if (comment)
+    {
+        fprintf_s(stdout, "%s ", comment);
+    }
+    fprintf_s(stdout, "\n");
+}
+
+static void dataPrintMeasurement(cJSON *iterator)
+{
+    cJSON *oCalculated = cJSON_GetObjectItem(iterator, DICT_RESULTS);
+    cJSON *oComment = cJSON_GetObjectItem(iterator, DICT_COMMENT);
+    if (oCalculated)
+    {
+        cJSON *oDsDNA         = cJSON_GetObjectItem(oCalculated, DICT_DS_DNA);
+        cJSON *oSsDNA         = cJSON_GetObjectItem(oCalculated, DICT_SS_DNA);
+        cJSON *oSsRNA         = cJSON_GetObjectItem(oCalculated, DICT_SS_RNA);
+        cJSON *oPurity260_230 = cJSON_GetObjectItem(oCalculated, DICT_PURITY_260_230);
+        cJSON *oPurity260_280 = cJSON_GetObjectItem(oCalculated, DICT_PURITY_260_280);
+
+        dataPrintValues(oDsDNA         ? cJSON_GetNumberValue(oDsDNA)         : 0.0,
+                        oSsDNA         ? cJSON_GetNumberValue(oSsDNA)         : 0.0,
+                        oSsRNA         ? cJSON_GetNumberValue(oSsRNA)         : 0.0,
+                        oPurity260_230 ? cJSON_GetNumberValue(oPurity260_230) : 0.0,
+                        oPurity260_280 ? cJSON_GetNumberValue(oPurity260_280) : 0.0,
+                        oComment ? cJSON_GetStringValue(oComment) : NULL);
+    }
+}
+
+static Error_t cmdDataPrintArchive(Evi_t *self, char *file)
+{
+    Archive_t archive;
+    Error_t ret = archive_open(file, &archive);
+
+    if (ret != ERROR_EVI_OK)
+    {
+        printError(ret, "Could not read archive %s.", file);
+        return ret;
+    }
+
+    for (size_t i = 0; i < archive_count(&archive); i++)
+    {
+        const ArchiveRecord_t *record = archive_record(&archive, i);
+
+        if (record->flags & ARCHIVE_RECORD_IRREGULAR)
+        {
+            cJSON *item = archive_recordToJson(&archive, record);
+            if (item == NULL)
+            {
+                ret = printError(ERROR_EVI_FILE_IO_ERROR, "Archive %s is corrupt.", file);
+                break;
+            }
+            dataPrintMeasurement(item);
+            cJSON_Delete(item);
+        }
+        else if (record->flags & ARCHIVE_RECORD_RESULTS)
+        {
+            dataPrintValues(record->results[0], record->results[1], record->results[2], record->results[7], record->results[8],
+                            archive_string(&archive, record->comment));
+        }
+    }
+
+    archive_close(&archive);
+    return ret;
+}
+
 static Error_t cmdDataPrint(Evi_t *self, char *file)
 {
+    if (archive_isArchive(file))
+    {
+        return cmdDataPrintArchive(self, file);
+    }
+
     cJSON *json = json_loadFromFile(file);
 
     if (json != NULL)
@@ -88,29 +187,7 @@ static Error_t cmdDataPrint(Evi_t *self, char *file)
             cJSON *iterator = NULL;
             cJSON_ArrayForEach(iterator, oMeasurments)
             {
-                cJSON *oCalculated = cJSON_GetObjectItem(iterator, DICT_RESULTS);
-                cJSON *oComment = cJSON_GetObjectItem(iterator, DICT_COMMENT);
-                if (oCalculated)
-                {
-                    cJSON *oDsDNA         = cJSON_GetObjectItem(oCalculated, DICT_DS_DNA);
-                    cJSON *oSsDNA         = cJSON_GetObjectItem(oCalculated, DICT_SS_DNA);
-                    cJSON *oSsRNA         = cJSON_GetObjectItem(oCalculated, DICT_SS_RNA);
-                    cJSON *oPurity260_230 = cJSON_GetObjectItem(oCalculated, DICT_PURITY_260_230);
-                    cJSON *oPurity260_280 = cJSON_GetObjectItem(oCalculated, DICT_PURITY_260_280);
-
-
-                    fprintf_s(stdout, "%f %f %f  %f %f ",
-                            oDsDNA         ? cJSON_GetNumberValue(oDsDNA)         : 0.0,
-                            oSsDNA         ? cJSON_GetNumberValue(oSsDNA)         : 0.0,
-                            oSsRNA         ? cJSON_GetNumberValue(oSsRNA)         : 0.0,
-                            oPurity260_230 ? cJSON_GetNumberValue(oPurity260_230) : 0.0,
-                            oPurity260_280 ? cJSON_GetNumberValue(oPurity260_280) : 0.0);
-                    if (oComment)
-                    {
-                        fprintf_s(stdout, "%s ", cJSON_GetStringValue(oComment));
-                    }
-                    fprintf_s(stdout, "\n");
-                }
+                dataPrintMeasurement(iterator);
             }
         }
         cJSON_Delete(json);
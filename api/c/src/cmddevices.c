@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "cmddevices.h"
+#include "evimanager.h"
+#include "evidense.h"
+#include "printerror.h"
+#include <stdio.h>
+#include <string.h>
+
+static Error_t cmdDevicesMeasure_(Evi_t * self, void * user)
+{
+    return eviDenseMeasure(self, (SingleMeasurement_t *)user);
+}
+
+static Error_t cmdDevicesMeasure(Evi_t * self, const EviDeviceInfo_t * devices, size_t count)
+{
+    EviManager_t * manager = NULL;
+    SingleMeasurement_t measurements[EVI_MAX_DEVICES] = {0};
+    void * users[EVI_MAX_DEVICES];
+    Error_t results[EVI_MAX_DEVICES];
+    Error_t ret;
+
+    ret = eviManagerOpen(&manager, self, devices, count);
+    if (ret != ERROR_EVI_OK)
+    {
+        return printError(ret, NULL);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        users[i] = &measurements[i];
+    }
+
+    // all devices measure at the same time
+    ret = eviManagerRunAll(manager, cmdDevicesMeasure_, users, results);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const SingleMeasurement_t * m = &measurements[i];
+        if (results[i] == ERROR_EVI_OK)
+        {
+            fprintf(stdout, "%s %i %i %i %i %i %i %i %i\n", devices[i].serial, m->channel230.sample, m->channel230.reference, m->channel260.sample, m->channel260.reference, m->channel280.sample, m->channel280.reference, m->channel340.sample, m->channel340.reference);
+        }
+        else
+        {
+            printError(results[i], "Measurement on %s failed: %s\n", devices[i].serial, eviError2String(results[i]));
+        }
+    }
+
+    eviManagerClose(manager);
+    return ret;
+}
+
+Error_t cmdDevices(Evi_t * self, int argcCmd, char **argvCmd)
+{
+    EviDeviceInfo_t devices[EVI_MAX_DEVICES];
+    size_t count = 0;
+    Error_t ret;
+
+    if (argcCmd > 2 || (argcCmd == 2 && strcmp(argvCmd[1], "measure") != 0))
+    {
+        return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
+    }
+
+    // no connected device is an empty list, not an error
+    ret = eviEnumerateDevices(devices, EVI_MAX_DEVICES, &count, self->verbose);
+    if (ret != ERROR_EVI_OK && ret != ERROR_EVI_INSTRUMENT_NOT_FOUND)
+    {
+        return printError(ret, NULL);
+    }
+
+    if (argcCmd == 2)
+    {
+        if (count == 0)
+        {
+            return printError(ERROR_EVI_INSTRUMENT_NOT_FOUND, "No devices found.\n");
+        }
+        return cmdDevicesMeasure(self, devices, count);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        fprintf(stdout, "%s %s\n", devices[i].serial, devices[i].portName);
+    }
+    return ERROR_EVI_OK;
+}
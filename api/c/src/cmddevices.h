@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @brief Implements the `devices` command listing all connected devices or measuring on all of them.
+ *
+ * @param self Pointer to the device instance providing the settings for all devices.
+ * @param argcCmd Number of command arguments stored in `argvCmd`.
+ * @param argvCmd Array of command arguments to parse.
+ * @return Error code indicating success or failure.
+ */
+Error_t cmdDevices(Evi_t * self, int argcCmd, char **argvCmd);
@@ -3,63 +3,198 @@
 
 #include "cmdexport.h"
 #include "json.h"
+#include "archive.h"
 #include "dict.h"
 #include "printerror.h"
 #include <stdio.h>
+#include <stdint.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
 
-void exportRawMeasurement(ExportOptions_t * options, cJSON *object, FILE * csv, const char * const key, bool last)
+#define CSV_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Buffered CSV output, flushed in large writes.
+ */
+typedef struct
 {
-    cJSON * measurement = cJSON_GetObjectItem(object, key);
-    if(measurement)
+    FILE * file;
+    size_t length;
+    bool   error;
+    char   buffer[CSV_BUFFER_SIZE];
+} CsvWriter_t;
+
+static void csvFlush(CsvWriter_t * csv)
+{
+    if(csv->length > 0 && fwrite(csv->buffer, 1, csv->length, csv->file) != csv->length)
+    {
+        csv->error = true;
+    }
+    csv->length = 0;
+}
+
+static void csvPutData(CsvWriter_t * csv, const char * data, size_t length)
+{
+    if(csv->length + length > CSV_BUFFER_SIZE)
     {
-        cJSON * sample = NULL;
-        cJSON * reference = NULL;
-        cJSON *o = cJSON_GetObjectItem(object, key);
-        if(o)
+        csvFlush(csv);
+        if(length > CSV_BUFFER_SIZE)
         {
-            sample    = cJSON_GetObjectItem(o, DICT_SAMPLE);
-            reference = cJSON_GetObjectItem(o, DICT_REFERENCE);
+            if(fwrite(data, 1, length, csv->file) != length)
+            {
+                csv->error = true;
+            }
+            return;
         }
+    }
+    memcpy(csv->buffer + csv->length, data, length);
+    csv->length += length;
+}
 
-        fprintf_s(csv, "%i%c", sample ? (int)cJSON_GetNumberValue(sample) : 0, options->delimiter);
-        fprintf_s(csv, "%i", reference ? (int)cJSON_GetNumberValue(reference) : 0);
+static void csvPutChar(CsvWriter_t * csv, char c)
+{
+    if(csv->length == CSV_BUFFER_SIZE)
+    {
+        csvFlush(csv);
+    }
+    csv->buffer[csv->length++] = c;
+}
 
-        if(!last)
+static void csvPutString(CsvWriter_t * csv, const char * s)
+{
+    if(s)
+    {
+        csvPutData(csv, s, strlen(s));
+    }
+}
+
+// digits of value in reverse order, returns the number of digits
+static size_t csvDigits(char * digits, uint64_t value)
+{
+    size_t n = 0;
+
+    do
+    {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+
+    return n;
+}
+
+// same output as "%i"
+static void csvPutInt(CsvWriter_t * csv, int value)
+{
+    char digits[24];
+    int64_t v = value;
+    size_t n;
+
+    if(v < 0)
+    {
+        csvPutChar(csv, '-');
+        v = -v;
+    }
+    n = csvDigits(digits, (uint64_t)v);
+    while(n > 0)
+    {
+        csvPutChar(csv, digits[--n]);
+    }
+}
+
+// same output as "%f"
+static void csvPutDouble(CsvWriter_t * csv, double value)
+{
+    double magnitude = fabs(value);
+
+    // Below 1e6 the scaled value is exact to 2^-12, so unless it is close to
+    // a rounding boundary it rounds like the exact decimal expansion.
+    if(magnitude < 1e6)
+    {
+        double scaled = magnitude * 1e6;
+        double integral = floor(scaled);
+        double fraction = scaled - integral;
+
+        if(fabs(fraction - 0.5) > 1e-3)
         {
-            fprintf_s(csv, "%c", options->delimiter);
+            char digits[24];
+            uint64_t n = (uint64_t)integral + (fraction > 0.5 ? 1 : 0);
+            size_t count = csvDigits(digits, n);
+
+            if(signbit(value))
+            {
+                csvPutChar(csv, '-');
+            }
+            // at least one digit before the decimal point
+            while(count < 7)
+            {
+                digits[count++] = '0';
+            }
+            while(count > 6)
+            {
+                csvPutChar(csv, digits[--count]);
+            }
+            csvPutChar(csv, '.');
+            while(count > 0)
+            {
+                csvPutChar(csv, digits[--count]);
+            }
+            return;
         }
     }
+
+    char text[512];
+    int length = snprintf(text, sizeof(text), "%f", value);
+    csvPutData(csv, text, length > 0 ? (size_t)length : 0);
 }
 
-void exportRawMeasurements(ExportOptions_t * options, cJSON *object, FILE * csv, const char * const key)
+static void csvPutDelimiter(ExportOptions_t * options, CsvWriter_t * csv)
 {
-    cJSON * measurements = cJSON_GetObjectItem(object, key);
-
-    exportRawMeasurement(options, measurements, csv, DICT_230, false);
-    exportRawMeasurement(options, measurements, csv, DICT_260, false);
-    exportRawMeasurement(options, measurements, csv, DICT_280, false);
-    exportRawMeasurement(options, measurements, csv, DICT_340, true);
+    csvPutChar(csv, options->delimiter);
 }
 
-void exportRaw(ExportOptions_t * options, cJSON *object, FILE * csv)
+static void csvPutComment(ExportOptions_t * options, cJSON * object, CsvWriter_t * csv)
 {
-    cJSON *iterator = NULL;
     cJSON *oComment = cJSON_GetObjectItem(object, DICT_COMMENT);
 
-    fprintf_s(csv, "%s%c", oComment ? cJSON_GetStringValue(oComment) : "", options->delimiter);
+    csvPutString(csv, oComment ? cJSON_GetStringValue(oComment) : "");
+    csvPutDelimiter(options, csv);
+}
+
+void exportRawMeasurement(ExportOptions_t * options, cJSON *object, CsvWriter_t * csv, const char * const key, bool last)
+{
+    cJSON * measurement = cJSON_GetObjectItem(object, key);
+    if(measurement)
+    {
+        cJSON * sample    = cJSON_GetObjectItem(measurement, DICT_SAMPLE);
+        cJSON * reference = cJSON_GetObjectItem(measurement, DICT_REFERENCE);
+
+        csvPutInt(csv, sample ? (int)cJSON_GetNumberValue(sample) : 0);
+        csvPutDelimiter(options, csv);
+        csvPutInt(csv, reference ? (int)cJSON_GetNumberValue(reference) : 0);
+
+        if(!last)
+        {
+            csvPutDelimiter(options, csv);
+        }
+    }
+}
 
+void exportRaw(ExportOptions_t * options, cJSON *object, CsvWriter_t * csv)
+{
+    cJSON *iterator = NULL;
     cJSON *oValues = cJSON_GetObjectItem(object, DICT_VALUES);
     bool first = true;
 
+    csvPutComment(options, object, csv);
+
     cJSON_ArrayForEach(iterator, oValues)
     {
         if(!first)
         {
-            fprintf_s(csv, "%s%c", oComment ? cJSON_GetStringValue(oComment) : "", options->delimiter);
+            csvPutComment(options, object, csv);
         }
 
         exportRawMeasurement(options, iterator, csv, DICT_230, false);
@@ -67,50 +202,55 @@ void exportRaw(ExportOptions_t * options, cJSON *object, FILE * csv)
         exportRawMeasurement(options, iterator, csv, DICT_280, false);
         exportRawMeasurement(options, iterator, csv, DICT_340, true);
 
-        fprintf_s(csv, "\n");
+        csvPutChar(csv, '\n');
         first = false;
     }
 }
 
-void exportMeasurement(ExportOptions_t * options, cJSON *iterator, FILE * csv)
+// reference and sample of one channel, each followed by the delimiter
+static void exportChannel(ExportOptions_t * options, cJSON * oMeasurement, const char * const key, CsvWriter_t * csv)
+{
+    cJSON *oLed = oMeasurement ? cJSON_GetObjectItem(oMeasurement, key) : NULL;
+    cJSON *oReference = oLed ? cJSON_GetObjectItem(oLed, DICT_REFERENCE) : NULL;
+    cJSON *oSample = oLed ? cJSON_GetObjectItem(oLed, DICT_SAMPLE) : NULL;
+
+    if(oReference)
+    {
+        csvPutInt(csv, (int)cJSON_GetNumberValue(oReference));
+    }
+    csvPutDelimiter(options, csv);
+    if(oSample)
+    {
+        csvPutInt(csv, (int)cJSON_GetNumberValue(oSample));
+    }
+    csvPutDelimiter(options, csv);
+}
+
+static void exportMeasurementSingle(ExportOptions_t * options, cJSON * iterator, const char * const key, CsvWriter_t * csv)
+{
+    cJSON *oMeasurement = cJSON_GetObjectItem(iterator, key);
+
+    exportChannel(options, oMeasurement, DICT_230, csv);
+    exportChannel(options, oMeasurement, DICT_260, csv);
+    exportChannel(options, oMeasurement, DICT_280, csv);
+    exportChannel(options, oMeasurement, DICT_340, csv);
+}
+
+void exportMeasurement(ExportOptions_t * options, cJSON *iterator, CsvWriter_t * csv)
 {
-    cJSON *oComment = cJSON_GetObjectItem(iterator, DICT_COMMENT);
     cJSON * oCalculated = cJSON_GetObjectItem(iterator, DICT_RESULTS);
-    cJSON *oMeasurement = NULL;
-    cJSON *oLed = NULL;
-    cJSON *oReference = NULL;
-    cJSON *oSample = NULL;
     cJSON *oValue = NULL;
 
-    fprintf_s(csv, "%s%c", oComment ? cJSON_GetStringValue(oComment) : "", options->delimiter);
+    csvPutComment(options, iterator, csv);
 
-    #define EXPORT_CHANNEL(KEY1, KEY2, LAST) \
-        oMeasurement = cJSON_GetObjectItem(iterator, KEY1); \
-        oLed = oMeasurement ? cJSON_GetObjectItem(oMeasurement, KEY2) : NULL; \
-        oReference = oLed ? cJSON_GetObjectItem(oLed, DICT_REFERENCE) : NULL; \
-        oSample = oLed ? cJSON_GetObjectItem(oLed, DICT_SAMPLE) : NULL; \
-        if(oReference) fprintf_s(csv, "%i", (int)cJSON_GetNumberValue(oReference)); \
-        fprintf_s(csv, "%c", options->delimiter); \
-        if(oSample) fprintf_s(csv, "%i", (int)cJSON_GetNumberValue(oSample)); \
-        if(!(LAST)) fprintf_s(csv, "%c", options->delimiter);
+    exportMeasurementSingle(options, iterator, DICT_BASELINE, csv);
+    exportMeasurementSingle(options, iterator, DICT_AIR, csv);
+    exportMeasurementSingle(options, iterator, DICT_SAMPLE, csv);
 
     #define EXPORT_RESULT(KEY, LAST) \
         oValue = oCalculated ? cJSON_GetObjectItem(oCalculated, KEY) : NULL; \
-        if(oValue) fprintf_s(csv, "%f", cJSON_GetNumberValue(oValue)); \
-        if(!(LAST)) fprintf_s(csv, "%c", options->delimiter);
-
-    EXPORT_CHANNEL(DICT_BASELINE, DICT_230, false);
-    EXPORT_CHANNEL(DICT_BASELINE, DICT_260, false);
-    EXPORT_CHANNEL(DICT_BASELINE, DICT_280, false);
-    EXPORT_CHANNEL(DICT_BASELINE, DICT_340, false);
-    EXPORT_CHANNEL(DICT_AIR, DICT_230, false);
-    EXPORT_CHANNEL(DICT_AIR, DICT_260, false);
-    EXPORT_CHANNEL(DICT_AIR, DICT_280, false);
-    EXPORT_CHANNEL(DICT_AIR, DICT_340, false);
-    EXPORT_CHANNEL(DICT_SAMPLE, DICT_230, false);
-    EXPORT_CHANNEL(DICT_SAMPLE, DICT_260, false);
-    EXPORT_CHANNEL(DICT_SAMPLE, DICT_280, false);
-    EXPORT_CHANNEL(DICT_SAMPLE, DICT_340, false);
+        if(oValue) csvPutDouble(csv, cJSON_GetNumberValue(oValue)); \
+        if(!(LAST)) csvPutDelimiter(options, csv);
 
     EXPORT_RESULT(DICT_DS_DNA, false);
     EXPORT_RESULT(DICT_SS_DNA, false);
@@ -122,122 +262,267 @@ void exportMeasurement(ExportOptions_t * options, cJSON *iterator, FILE * csv)
     EXPORT_RESULT(DICT_PURITY_260_230, false);
     EXPORT_RESULT(DICT_PURITY_260_280, true);
 
-    #undef EXPORT_CHANNEL
     #undef EXPORT_RESULT
 
-    fprintf_s(csv, "\n");
+    csvPutChar(csv, '\n');
 }
 
-void exportMeasurementSingleLedHeader(ExportOptions_t * options, FILE * csv, const char * const key1, const char * const key2, bool last)
+static void exportArchiveChannel(ExportOptions_t * options, const Channel_t * channel, bool valid, CsvWriter_t * csv)
 {
-    if(key1 == NULL)
+    if(valid)
     {
-        fprintf_s(csv, "%s %s%c", key2, DICT_SAMPLE, options->delimiter);
-        fprintf_s(csv, "%s %s", key2, DICT_REFERENCE);
+        csvPutInt(csv, (int)channel->reference);
     }
-    else
+    csvPutDelimiter(options, csv);
+    if(valid)
+    {
+        csvPutInt(csv, (int)channel->sample);
+    }
+    csvPutDelimiter(options, csv);
+}
+
+static void exportArchiveSingle(ExportOptions_t * options, const SingleMeasurement_t * measurement, bool valid, CsvWriter_t * csv)
+{
+    exportArchiveChannel(options, &measurement->channel230, valid, csv);
+    exportArchiveChannel(options, &measurement->channel260, valid, csv);
+    exportArchiveChannel(options, &measurement->channel280, valid, csv);
+    exportArchiveChannel(options, &measurement->channel340, valid, csv);
+}
+
+// same row as exportMeasurement() for the JSON form of the record
+static void exportArchiveMeasurement(ExportOptions_t * options, const Archive_t * archive, const ArchiveRecord_t * record, CsvWriter_t * csv)
+{
+    csvPutString(csv, archive_string(archive, record->comment));
+    csvPutDelimiter(options, csv);
+
+    exportArchiveSingle(options, &record->baseline, (record->flags & ARCHIVE_RECORD_BASELINE) != 0, csv);
+    exportArchiveSingle(options, &record->air, (record->flags & ARCHIVE_RECORD_AIR) != 0, csv);
+    exportArchiveSingle(options, &record->sample, (record->flags & ARCHIVE_RECORD_SAMPLE) != 0, csv);
+
+    for(size_t i = 0; i < ARCHIVE_RESULTS_COUNT; i++)
     {
-        fprintf_s(csv, "%s %s %s%c", key1, key2, DICT_SAMPLE, options->delimiter);
-        fprintf_s(csv, "%s %s %s", key1, key2, DICT_REFERENCE);
+        if(record->flags & ARCHIVE_RECORD_RESULTS)
+        {
+            csvPutDouble(csv, record->results[i]);
+        }
+        if(i + 1 < ARCHIVE_RESULTS_COUNT)
+        {
+            csvPutDelimiter(options, csv);
+        }
     }
 
-    if(!last)
+    csvPutChar(csv, '\n');
+}
+
+static void exportHeader(ExportOptions_t * options, CsvWriter_t * csv);
+
+// the records are read from the mapped archive, only irregular records are converted to JSON
+static Error_t exportArchive(ExportOptions_t * options, CsvWriter_t * csv)
+{
+    Archive_t archive;
+    Error_t ret = archive_open(options->filenameJson, &archive);
+
+    if(ret != ERROR_EVI_OK)
     {
-        fprintf_s(csv, "%c", options->delimiter);
+        return ret;
+    }
+
+    exportHeader(options, csv);
+
+    for(size_t i = 0; i < archive_count(&archive); i++)
+    {
+        const ArchiveRecord_t * record = archive_record(&archive, i);
+
+        if(options->mode == MODE_MEASUREMENT && !(record->flags & ARCHIVE_RECORD_IRREGULAR))
+        {
+            exportArchiveMeasurement(options, &archive, record, csv);
+        }
+        else
+        {
+            cJSON * iterator = archive_recordToJson(&archive, record);
+            if(!iterator)
+            {
+                ret = ERROR_EVI_FILE_NOT_FOUND;
+                break;
+            }
+            if(options->mode == MODE_RAW)
+            {
+                exportRaw(options, iterator, csv);
+            }
+            else
+            {
+                exportMeasurement(options, iterator, csv);
+            }
+            cJSON_Delete(iterator);
+        }
+    }
+
+    archive_close(&archive);
+    return ret;
+}
+
+void exportMeasurementSingleLedHeader(ExportOptions_t * options, CsvWriter_t * csv, const char * const key1, const char * const key2, bool last)
+{
+    const char * const suffixes[] = {DICT_SAMPLE, DICT_REFERENCE};
+
+    for(size_t i = 0; i < 2; i++)
+    {
+        if(key1 != NULL)
+        {
+            csvPutString(csv, key1);
+            csvPutChar(csv, ' ');
+        }
+        csvPutString(csv, key2);
+        csvPutChar(csv, ' ');
+        csvPutString(csv, suffixes[i]);
+        if(i == 0 || !last)
+        {
+            csvPutDelimiter(options, csv);
+        }
     }
 }
 
-void exportRawHeader(ExportOptions_t * options, FILE * csv)
+void exportRawHeader(ExportOptions_t * options, CsvWriter_t * csv)
 {
-    fprintf_s(csv, "%s%c", DICT_COMMENT, options->delimiter);
+    csvPutString(csv, DICT_COMMENT);
+    csvPutDelimiter(options, csv);
     exportMeasurementSingleLedHeader(options, csv, NULL, DICT_230, false);
     exportMeasurementSingleLedHeader(options, csv, NULL, DICT_260, false);
     exportMeasurementSingleLedHeader(options, csv, NULL, DICT_280, false);
     exportMeasurementSingleLedHeader(options, csv, NULL, DICT_340, true);
 
-    fprintf_s(csv, "\n");
+    csvPutChar(csv, '\n');
 }
 
-void exportMeasurementSingleHeader(ExportOptions_t * options, FILE * csv, const char * const key)
+void exportMeasurementSingleHeader(ExportOptions_t * options, CsvWriter_t * csv, const char * const key)
 {
-    fprintf_s(csv, "%s %s %s%c", key, DICT_230, DICT_REFERENCE, options->delimiter);
-    fprintf_s(csv, "%s %s %s%c", key, DICT_230, DICT_SAMPLE, options->delimiter);
-    fprintf_s(csv, "%s %s %s%c", key, DICT_260, DICT_REFERENCE, options->delimiter);
-    fprintf_s(csv, "%s %s %s%c", key, DICT_260, DICT_SAMPLE, options->delimiter);
-    fprintf_s(csv, "%s %s %s%c", key, DICT_280, DICT_REFERENCE, options->delimiter);
-    fprintf_s(csv, "%s %s %s%c", key, DICT_280, DICT_SAMPLE, options->delimiter);
-    fprintf_s(csv, "%s %s %s%c", key, DICT_340, DICT_REFERENCE, options->delimiter);
-    fprintf_s(csv, "%s %s %s", key, DICT_340, DICT_SAMPLE);
+    const char * const channels[] = {DICT_230, DICT_260, DICT_280, DICT_340};
+
+    for(size_t i = 0; i < 4; i++)
+    {
+        csvPutString(csv, key);
+        csvPutChar(csv, ' ');
+        csvPutString(csv, channels[i]);
+        csvPutChar(csv, ' ');
+        csvPutString(csv, DICT_REFERENCE);
+        csvPutDelimiter(options, csv);
+        csvPutString(csv, key);
+        csvPutChar(csv, ' ');
+        csvPutString(csv, channels[i]);
+        csvPutChar(csv, ' ');
+        csvPutString(csv, DICT_SAMPLE);
+        if(i < 3)
+        {
+            csvPutDelimiter(options, csv);
+        }
+    }
 }
 
-void exportMeasurementHeader(ExportOptions_t * options, FILE * csv)
+void exportMeasurementHeader(ExportOptions_t * options, CsvWriter_t * csv)
 {
-    fprintf_s(csv, "%s%c", DICT_COMMENT, options->delimiter);
+    const char * const results[] = {DICT_DS_DNA, DICT_SS_DNA, DICT_SS_RNA, DICT_A230, DICT_A260, DICT_A280, DICT_A340, DICT_PURITY_260_230, DICT_PURITY_260_280};
+
+    csvPutString(csv, DICT_COMMENT);
+    csvPutDelimiter(options, csv);
     exportMeasurementSingleHeader(options, csv, DICT_BASELINE);
-    fprintf_s(csv, "%c", options->delimiter);
+    csvPutDelimiter(options, csv);
     exportMeasurementSingleHeader(options, csv, DICT_AIR);
-    fprintf_s(csv, "%c", options->delimiter);
+    csvPutDelimiter(options, csv);
     exportMeasurementSingleHeader(options, csv, DICT_SAMPLE);
-    fprintf_s(csv, "%c%s%c%s%c%s%c%s%c%s%c%s%c%s%c%s%c%s", options->delimiter,
-        DICT_DS_DNA, options->delimiter,
-        DICT_SS_DNA, options->delimiter,
-        DICT_SS_RNA, options->delimiter,
-        DICT_A230, options->delimiter,
-        DICT_A260, options->delimiter,
-        DICT_A280, options->delimiter,
-        DICT_A340, options->delimiter,
-        DICT_PURITY_260_230, options->delimiter,
-        DICT_PURITY_260_280);
-    fprintf_s(csv, "\n");
+    for(size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++)
+    {
+        csvPutDelimiter(options, csv);
+        csvPutString(csv, results[i]);
+    }
+    csvPutChar(csv, '\n');
 }
 
-Error_t exportData(ExportOptions_t *options)
+static void exportHeader(ExportOptions_t * options, CsvWriter_t * csv)
 {
-    Error_t ret  = ERROR_EVI_OK;
-    cJSON* json = json_loadFromFile(options->filenameJson);
-
-    if(json)
+    switch(options->mode)
     {
-        FILE * csv = fopen(options->filenameCsv, "w");
-        if(csv)
-        {
-            cJSON *oMeasurments = cJSON_GetObjectItem(json, DICT_MEASUREMENTS);
-            cJSON *iterator = NULL;
-            switch(options->mode)
-            {
-                case MODE_RAW:
-                    exportRawHeader(options, csv);
-                    break;
-                case MODE_MEASUREMENT:
-                    exportMeasurementHeader(options, csv);
-                    break;
-            }
+        case MODE_RAW:
+            exportRawHeader(options, csv);
+            break;
+        case MODE_MEASUREMENT:
+            exportMeasurementHeader(options, csv);
+            break;
+    }
+}
 
-            cJSON_ArrayForEach(iterator, oMeasurments)
-            {
-                switch(options->mode)
-                {
-                    case MODE_RAW:
-                        exportRaw(options, iterator, csv);
-                        break;
-                    case MODE_MEASUREMENT:
-                        exportMeasurement(options, iterator, csv);
-                        break;
-                }
+static Error_t exportJson(ExportOptions_t * options, JsonArrayReader_t * reader, CsvWriter_t * csv)
+{
+    cJSON *iterator = NULL;
 
-            }
-            fclose(csv);
-        }
-        else
+    exportHeader(options, csv);
+
+    while((iterator = json_arrayReaderNext(reader)) != NULL)
+    {
+        switch(options->mode)
         {
-            ret = ERROR_EVI_FILE_IO_ERROR;
+            case MODE_RAW:
+                exportRaw(options, iterator, csv);
+                break;
+            case MODE_MEASUREMENT:
+                exportMeasurement(options, iterator, csv);
+                break;
         }
-        cJSON_Delete(json);
+        cJSON_Delete(iterator);
     }
-    else
+
+    return reader->error ? ERROR_EVI_FILE_NOT_FOUND : ERROR_EVI_OK;
+}
+
+Error_t exportData(ExportOptions_t *options)
+{
+    Error_t ret  = ERROR_EVI_OK;
+    JsonArrayReader_t reader = {0};
+    CsvWriter_t * csv = NULL;
+    bool isArchive = archive_isArchive(options->filenameJson);
+
+    // the measurements are read one at a time, so memory use does not depend on the file size
+    if(!isArchive && !json_arrayReaderOpen(&reader, options->filenameJson, DICT_MEASUREMENTS))
     {
         ret = ERROR_EVI_FILE_NOT_FOUND;
+        goto cleanup;
+    }
+
+    csv = malloc(sizeof(CsvWriter_t));
+    if(!csv)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+    csv->length = 0;
+    csv->error = false;
+    csv->file = fopen(options->filenameCsv, "w");
+    if(!csv->file)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+
+    ret = isArchive ? exportArchive(options, csv) : exportJson(options, &reader, csv);
+
+    csvFlush(csv);
+    if(fclose(csv->file) != 0)
+    {
+        csv->error = true;
     }
+
+    if(ret != ERROR_EVI_OK)
+    {
+        // as before, an unreadable input file gives no CSV file
+        remove(options->filenameCsv);
+    }
+    else if(csv->error)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+    }
+
+cleanup:
+    free(csv);
+    json_arrayReaderClose(&reader);
     return ret;
 }
 
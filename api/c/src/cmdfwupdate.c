@@ -6,13 +6,32 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+static void cmdFwUpdateProgress(size_t done, size_t total, void *user)
+{
+    size_t * shown = user;
+    size_t percent = done * 100 / total;
+
+    // stderr keeps the progress out of redirected output
+    if (percent != *shown)
+    {
+        *shown = percent;
+        fprintf_s(stderr, "\rWriting firmware: %3u%%%s", (unsigned)percent, done == total ? "\n" : "");
+        fflush(stderr);
+    }
+}
+
 Error_t cmdFwUpdate(Evi_t *self, const char * file)
 {
     Error_t ret;
-    ret = eviFwUpdate(self, file);
+    size_t shown = (size_t)-1;
+    ret = eviFwUpdateEx(self, file, cmdFwUpdateProgress, &shown, 0);
 
     if (ret != ERROR_EVI_OK)
     {
+        if (shown != (size_t)-1 && shown != 100)
+        {
+            fprintf_s(stderr, "\n");
+        }
         printError(ret, NULL);
     }
     return ret;
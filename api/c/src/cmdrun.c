@@ -20,6 +20,7 @@
 #include <stdarg.h>
 
 #if defined(_WIN64) || defined(_WIN32)
+#include <direct.h>
 #else
 #include <unistd.h>
 #endif
@@ -45,6 +46,12 @@ typedef enum
 #define DICT_CONTEXT_LOG_TIME             "time"
 #define DICT_CONTEXT_LOG_TEXT             "text"
 
+#define DICT_CONTEXT_INCREMENTAL          "incremental"
+#define DICT_CONTEXT_CENTER_WAVELENGTH280 "centerWavelength280"
+#define DICT_CONTEXT_BLANKS               "blanks"
+#define DICT_CONTEXT_BLANKS_SUM           "sum"
+#define DICT_CONTEXT_BLANKS_COUNT         "count"
+
 #define DICT_CONTEXT_DATA                 "data"
 
 #define DICT_CONTEXT_DATA_BASELINE        "baseline"
@@ -52,12 +59,7 @@ typedef enum
 
 static void loggingClear(Evi_t * self)
 {
-    char line[EVI_MAX_LINE_LENGTH];
-    Error_t ret  = ERROR_EVI_OK;
-    while(ret == ERROR_EVI_OK)
-    {
-        ret = eviLogging(self, line, sizeof(line));
-    }
+    eviLoggingDrain(self, NULL, NULL);
 }
 
 static cJSON * contextCreate(cJSON * context)
@@ -98,6 +100,113 @@ static void contextSave(cJSON * context, char * filename)
     fclose(fout);
 }
 
+typedef struct
+{
+    bool enabled;
+    char * filename;  // absolute path of the cached state file
+    cJSON * context;
+    bool dirty;
+    struct stat stat; // state file after the last load or save
+} StateCache_t;
+
+static StateCache_t stateCache = {0};
+
+static char * statePath(const char * filename)
+{
+    char cwd[4096];
+
+    if (filename[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        return strdup(filename);
+    }
+    return malloc_printf("%s/%s", cwd, filename);
+}
+
+static bool stateUnchanged(const char * filename)
+{
+    struct stat st;
+
+    if (stat(filename, &st) != 0)
+    {
+        return false;
+    }
+    return st.st_ino == stateCache.stat.st_ino && st.st_size == stateCache.stat.st_size && st.st_mtime == stateCache.stat.st_mtime;
+}
+
+static void stateCacheDrop(void)
+{
+    cmdRunFlushState();
+    cJSON_Delete(stateCache.context);
+    free(stateCache.filename);
+    stateCache.context = NULL;
+    stateCache.filename = NULL;
+}
+
+void cmdRunCacheState(bool enable)
+{
+    if (!enable)
+    {
+        stateCacheDrop();
+    }
+    stateCache.enabled = enable;
+}
+
+void cmdRunFlushState(void)
+{
+    if (stateCache.context != NULL && stateCache.dirty)
+    {
+        contextSave(stateCache.context, stateCache.filename);
+        stat(stateCache.filename, &stateCache.stat);
+        stateCache.dirty = false;
+    }
+}
+
+static cJSON * contextAcquire(char * filename)
+{
+    char * path;
+
+    if (!stateCache.enabled)
+    {
+        return contextLoad(filename);
+    }
+
+    path = statePath(filename);
+    if (stateCache.context != NULL && strcmp(path, stateCache.filename) == 0 && (stateCache.dirty || stateUnchanged(path)))
+    {
+        free(path);
+        return stateCache.context;
+    }
+
+    if (stateCache.context != NULL && strcmp(path, stateCache.filename) == 0)
+    {
+        // changed by someone else, the file wins
+        stateCache.dirty = false;
+    }
+    stateCacheDrop();
+
+    stateCache.filename = path;
+    stateCache.context = contextLoad(path);
+    if (stat(path, &stateCache.stat) != 0)
+    {
+        memset(&stateCache.stat, 0, sizeof(stateCache.stat));
+    }
+    return stateCache.context;
+}
+
+static void contextRelease(cJSON * context, char * filename)
+{
+    if (!stateCache.enabled)
+    {
+        contextSave(context, filename);
+        cJSON_Delete(context);
+        return;
+    }
+
+    // run init replaces the context
+    stateCache.context = context;
+    stateCache.dirty = true;
+}
+
 static void contextAddLog(cJSON * context, const char * text, ...)
 {
     char * ts  = malloc_timeStamp(TimeStampTypeISO8601);
@@ -260,12 +369,85 @@ static void contextGetSingleMeasurement(cJSON * context, const char * string, Si
     singleMeasurement_fromJson(oSingleMeasurement, singleMeasurement);
 }
 
-static void dataAddMeasurement(Evi_t* self, cJSON * context, const SingleMeasurement_t * baseline, const SingleMeasurement_t * air, const SingleMeasurement_t * sample, const char * comment, bool append)
+// Measurements of a run are appended to a journal next to the data file,
+// one JSON object per line. dataFinalize() copies the lines the data file
+// does not hold yet into it; the journal is removed by the next init.
+// Runs initialized by this version keep the blank factors and parameters in
+// the state, so each new measurement is calculated on its own.
+static bool contextIsIncremental(cJSON * context)
 {
-    const char * file = contextGetDataFile(context);
-    cJSON * data = dataLoadJson(self, file, append);
+    return cJSON_IsTrue(cJSON_GetObjectItem(context, DICT_CONTEXT_INCREMENTAL));
+}
+
+static Parameters_t contextGetParameters(cJSON * context)
+{
+    Parameters_t parameters = parametersCreate();
+    cJSON * o = cJSON_GetObjectItem(context, DICT_CONTEXT_CENTER_WAVELENGTH280);
+
+    parameters.blanksStart = contextGetNrOfBlanks(context);
+    parameters.blanksEnd = 0;
+    if(cJSON_IsNumber(o))
+    {
+        parametersSetCenterWavelength280(&parameters, cJSON_GetNumberValue(o));
+    }
+    return parameters;
+}
+
+static void contextAddBlank(cJSON * context, const Measurement_t * blank)
+{
+    cJSON * oBlanks = cJSON_GetObjectItem(context, DICT_CONTEXT_BLANKS);
+    Quadruple_t sum = quadruple_initAllTheSame(0.0);
+
+    if(oBlanks == NULL)
+    {
+        oBlanks = cJSON_CreateObject();
+        cJSON_AddItemToObject(context, DICT_CONTEXT_BLANKS, oBlanks);
+    }
+    else
+    {
+        quadruple_fromJson(cJSON_GetObjectItem(oBlanks, DICT_CONTEXT_BLANKS_SUM), &sum);
+    }
+
+    // same order of additions as measurement_calculateFactors()
+    Quadruple_t factor = measurement_factorAbsorbanceBufferBlank(blank);
+    sum = quadruple_add(&sum, &factor);
+
+    cJSON_DeleteItemFromObject(oBlanks, DICT_CONTEXT_BLANKS_SUM);
+    cJSON_AddItemToObject(oBlanks, DICT_CONTEXT_BLANKS_SUM, quadruple_toJson(&sum));
+    contextSetNumber(oBlanks, DICT_CONTEXT_BLANKS_COUNT, contextGetNumber(oBlanks, DICT_CONTEXT_BLANKS_COUNT) + 1);
+}
+
+static bool contextGetFactors(cJSON * context, Factors_t * factors)
+{
+    cJSON * oBlanks = cJSON_GetObjectItem(context, DICT_CONTEXT_BLANKS);
+    int nrOfBlanks = contextGetNrOfBlanks(context);
+    Quadruple_t sum;
+
+    if(oBlanks == NULL || nrOfBlanks <= 0 || (int)contextGetNumber(oBlanks, DICT_CONTEXT_BLANKS_COUNT) != nrOfBlanks)
+    {
+        return false;
+    }
+
+    if(!quadruple_fromJson(cJSON_GetObjectItem(oBlanks, DICT_CONTEXT_BLANKS_SUM), &sum))
+    {
+        return false;
+    }
+
+    Quadruple_t qCount = quadruple_initAllTheSame(nrOfBlanks);
+    factors->fAbsorbanceBufferBlank = quadruple_div(&sum, &qCount);
+    return true;
+}
+
+static char * dataJournalFile(const char * file)
+{
+    return malloc_replace_suffix(file, "jsonl");
+}
+
+static Error_t dataAddMeasurement(Evi_t* self, cJSON * context, const SingleMeasurement_t * baseline, const SingleMeasurement_t * air, const SingleMeasurement_t * sample, const char * comment)
+{
+    Error_t ret = ERROR_EVI_OK;
+    char * journal = dataJournalFile(contextGetDataFile(context));
 
-    cJSON* oMeasurements = cJSON_GetObjectItem(data, DICT_MEASUREMENTS);
     cJSON* obj = cJSON_CreateObject();
     cJSON_AddItemToObject(obj, DICT_BASELINE, singleMeasurement_toJson(baseline));
     cJSON_AddItemToObject(obj, DICT_AIR, singleMeasurement_toJson(air));
@@ -279,15 +461,21 @@ static void dataAddMeasurement(Evi_t* self, cJSON * context, const SingleMeasure
 
     cJSON * log = cJSON_CreateArray();
 
-    char line[EVI_MAX_LINE_LENGTH];
-    Error_t ret  = ERROR_EVI_OK;
-    while(ret == ERROR_EVI_OK)
     {
-        ret = eviLogging(self, line, sizeof(line));
-        if(ret == ERROR_EVI_OK)
+        // the ring grows, lines are only dropped when out of memory
+        EviLogRing_t ring;
+        eviLogRingInit(&ring, NULL, 0);
+        eviLoggingDrain(self, &ring, NULL);
+        for(size_t i = 0; i < ring.count; i++)
         {
-            cJSON_AddItemToArray(log, cJSON_CreateString(line));
+            cJSON_AddItemToArray(log, cJSON_CreateString(eviLogRingLine(&ring, i)));
         }
+        if(ring.dropped > 0)
+        {
+            cJSON_AddNumberToObject(obj, DICT_LOGGING_DROPPED, (double)ring.dropped);
+            contextAddLog(context, "measure() %u log lines dropped", (unsigned)ring.dropped);
+        }
+        eviLogRingFree(&ring);
     }
 
     if(log)
@@ -300,10 +488,30 @@ static void dataAddMeasurement(Evi_t* self, cJSON * context, const SingleMeasure
         cJSON_AddItemToObject(obj, DICT_COMMENT, cJSON_CreateString(comment));
     }
 
-    cJSON_AddItemToArray(oMeasurements, obj);
+    if(contextIsIncremental(context))
+    {
+        Factors_t factors;
 
-    json_saveToFile(file, data);
-    cJSON_Delete(data);
+        if(contextGetCount(context) < contextGetNrOfBlanks(context))
+        {
+            Measurement_t blank = measurement_init(*baseline, *air, *sample, NULL);
+            contextAddBlank(context, &blank);
+        }
+        else if(contextGetFactors(context, &factors))
+        {
+            Parameters_t parameters = contextGetParameters(context);
+            measurement_calculateEntry(obj, &factors, &parameters);
+        }
+    }
+
+    if(!json_appendLineToFile(journal, obj))
+    {
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "Could not write %s\n", journal);
+    }
+
+    cJSON_Delete(obj);
+    free(journal);
+    return ret;
 }
 
 static void dataSetNumber(cJSON * parent, const char * key, double value)
@@ -322,6 +530,7 @@ static void dataSetNumber(cJSON * parent, const char * key, double value)
 
 static Error_t dataInitializeFile(Evi_t * self, const char * file)
 {
+    Error_t ret = ERROR_EVI_OK;
     cJSON * json = dataLoadJson(self, file, false);
 
     if(json == NULL)
@@ -329,12 +538,15 @@ static Error_t dataInitializeFile(Evi_t * self, const char * file)
         return ERROR_EVI_INVALID_PARAMETER;
     }
 
-    json_saveToFile(file, json);
+    if(!json_saveToFile(file, json))
+    {
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "Could not write %s\n", file);
+    }
     cJSON_Delete(json);
-    return ERROR_EVI_OK;
+    return ret;
 }
 
-static Error_t dataWriteCenterWavelength280(Evi_t * self, const char * file)
+static Error_t dataWriteCenterWavelength280(Evi_t * self, const char * file, double * centerWavelength280)
 {
     Error_t ret = ERROR_EVI_OK;
     char value[EVI_MAX_LINE_LENGTH] = {};
@@ -368,12 +580,16 @@ static Error_t dataWriteCenterWavelength280(Evi_t * self, const char * file)
         cJSON_AddItemToObject(adjustments, DICT_CENTER_WAVELENGTHS, centerWavelengths);
     }
 
-    dataSetNumber(centerWavelengths, DICT_280, atof(value) / 1000.0);
+    *centerWavelength280 = atof(value) / 1000.0;
+    dataSetNumber(centerWavelengths, DICT_280, *centerWavelength280);
 
-    json_saveToFile(file, json);
+    if(!json_saveToFile(file, json))
+    {
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "Could not write %s\n", file);
+    }
     cJSON_Delete(json);
 
-    return ERROR_EVI_OK;
+    return ret;
 }
 
 static char * createComment(cJSON * context)
@@ -391,23 +607,81 @@ static char * createComment(cJSON * context)
     }
 }
 
-static void reCalculate(cJSON * context, Options_t * options)
+static Error_t dataFinalize(cJSON * context)
 {
-    cJSON *json = json_loadFromFile(contextGetDataFile(context));
-    if (json != NULL)
+    const char * file = contextGetDataFile(context);
+    char * journal = dataJournalFile(file);
+    cJSON * json = NULL;
+    cJSON * lines = NULL;
+    Error_t ret = ERROR_EVI_OK;
+
+    json = json_loadFromFile(file);
+    if (json == NULL)
+    {
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "Could not read %s\n", file);
+        goto cleanup;
+    }
+
+    cJSON *oMeasurements = cJSON_GetObjectItem(json, DICT_MEASUREMENTS);
+    lines = json_loadLinesFromFile(journal);
+    if (lines != NULL)
+    {
+        // the data file is saved together with the number of journal lines
+        // it holds, so finalize can be repeated after any interruption
+        cJSON * oMerged = cJSON_GetObjectItem(json, DICT_JOURNAL_MERGED);
+        size_t merged = cJSON_IsNumber(oMerged) && oMerged->valuedouble > 0 ? (size_t)oMerged->valuedouble : 0;
+        size_t count = 0;
+        cJSON * item = NULL;
+        while ((item = cJSON_DetachItemFromArray(lines, 0)) != NULL)
+        {
+            if (count++ < merged)
+            {
+                cJSON_Delete(item);
+            }
+            else
+            {
+                cJSON_AddItemToArray(oMeasurements, item);
+            }
+        }
+        cJSON_DeleteItemFromObject(json, DICT_JOURNAL_MERGED);
+        cJSON_AddNumberToObject(json, DICT_JOURNAL_MERGED, (double)count);
+    }
+
+    Factors_t factors;
+    if(contextIsIncremental(context) && contextGetFactors(context, &factors))
+    {
+        // only the blanks and measurements made before the last blank lack results
+        Parameters_t parameters = contextGetParameters(context);
+        cJSON * iterator = NULL;
+        cJSON_ArrayForEach(iterator, oMeasurements)
+        {
+            if(cJSON_GetObjectItem(iterator, DICT_CALCULATED) == NULL)
+            {
+                measurement_calculateEntry(iterator, &factors, &parameters);
+            }
+        }
+    }
+    else
     {
-        cJSON *oMeasurements = cJSON_GetObjectItem(json, DICT_MEASUREMENTS);
         Parameters_t  parameters = parametersCreate();
         parametersApplyAdjustmentsFromJson(json, &parameters);
         parameters.blanksStart = contextGetNrOfBlanks(context);
         parameters.blanksEnd = 0;
-        bool ret = measurement_calculate(oMeasurements, &parameters);
-        if(ret == true)
-        {
-            json_saveToFile(contextGetDataFile(context), json);
-        }
-        cJSON_Delete(json);
+        measurement_calculate(oMeasurements, &parameters);
+    }
+
+    if (!json_saveToFile(file, json))
+    {
+        // the journal still holds the measurements, finalize can be repeated
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "Could not write %s\n", file);
+        goto cleanup;
     }
+
+cleanup:
+    cJSON_Delete(lines);
+    cJSON_Delete(json);
+    free(journal);
+    return ret;
 }
 
 static Error_t measure(Evi_t* self, cJSON * context, Options_t * options, const char * comment)
@@ -469,7 +743,7 @@ static Error_t measure(Evi_t* self, cJSON * context, Options_t * options, const
                     _comment = createComment(context);
                 }
 
-                dataAddMeasurement(self, context, &baseline, &air, &sample, comment ? comment : _comment, true);
+                ret = dataAddMeasurement(self, context, &baseline, &air, &sample, comment ? comment : _comment);
 
                 if(_comment != NULL)
                 {
@@ -493,8 +767,6 @@ static Error_t measure(Evi_t* self, cJSON * context, Options_t * options, const
             break;
     }
 
-    reCalculate(context, options);
-
     return ret;
 }
 
@@ -558,7 +830,7 @@ Error_t cmdRun(Evi_t* self, int argcCmd, char** argvCmd)
     argvCmdSave = argvCmd + i;
 
     {
-        cJSON * context = contextLoad(options.filename_state);
+        cJSON * context = contextAcquire(options.filename_state);
 
         if(argcCmdSave >= 1)
         {
@@ -603,6 +875,7 @@ Error_t cmdRun(Evi_t* self, int argcCmd, char** argvCmd)
                     contextSetNrOfBlanks(context, atoi(argvCmdSave[1]));
                     contextSetCount(context, 0);
                     contextSetState(context, StateBaseline);
+                    cJSON_AddItemToObject(context, DICT_CONTEXT_INCREMENTAL, cJSON_CreateTrue());
 
                     if(options.filename_data == NULL)
                     {
@@ -628,13 +901,25 @@ Error_t cmdRun(Evi_t* self, int argcCmd, char** argvCmd)
                         contextSetDataFile(context, options.filename_data);
                     }
 
+                    {
+                        // a journal left over from an earlier run with the same file
+                        char * journal = dataJournalFile(contextGetDataFile(context));
+                        remove(journal);
+                        free(journal);
+                    }
+
                     ret = dataInitializeFile(self, contextGetDataFile(context));
                     contextAddLog(context, "Initialize data file ret:%i", ret);
 
                     if((ret == ERROR_EVI_OK) && (noPurityRatio260280Correction == false))
                     {
-                        ret = dataWriteCenterWavelength280(self, contextGetDataFile(context));
+                        double centerWavelength280 = 0.0;
+                        ret = dataWriteCenterWavelength280(self, contextGetDataFile(context), &centerWavelength280);
                         contextAddLog(context, "Read center wavelength 280 ret:%i", ret);
+                        if(ret == ERROR_EVI_OK)
+                        {
+                            contextSetNumber(context, DICT_CONTEXT_CENTER_WAVELENGTH280, centerWavelength280);
+                        }
                     }
                     else
                     {
@@ -666,7 +951,7 @@ Error_t cmdRun(Evi_t* self, int argcCmd, char** argvCmd)
                 {
                     comment = argvCmdSave[1];
                 }
-                measure(self, context, &options, comment);
+                ret = measure(self, context, &options, comment);
             }
             else if(strcmp(argvCmdSave[0], "checkempty") == 0)
             {
@@ -681,9 +966,20 @@ Error_t cmdRun(Evi_t* self, int argcCmd, char** argvCmd)
                     }
                 }
             }
+            else if(strcmp(argvCmdSave[0], "finalize") == 0)
+            {
+                ret = dataFinalize(context);
+                contextAddLog(context, "finalize ret:%i", ret);
+            }
             else if(strcmp(argvCmdSave[0], "export") == 0)
             {
                 ExportOptions_t options = {};
+                ret = dataFinalize(context);
+                contextAddLog(context, "finalize ret:%i", ret);
+                if(ret != ERROR_EVI_OK)
+                {
+                    goto save;
+                }
                 options.delimiter = ';';
                 options.mode      = MODE_MEASUREMENT;
                 options.filenameJson = (char*)contextGetDataFile(context);
@@ -701,8 +997,8 @@ Error_t cmdRun(Evi_t* self, int argcCmd, char** argvCmd)
             ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
         }
 
-        contextSave(context, options.filename_state);
-        cJSON_Delete(context);
+save:
+        contextRelease(context, options.filename_state);
     }
 
 exit:
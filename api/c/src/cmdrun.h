@@ -15,3 +15,18 @@
  */
 Error_t cmdRun(Evi_t * self, int argcCmd, char **argvCmd);
 
+/**
+ * @brief Keeps the run state in memory across cmdRun() calls.
+ *
+ * Used by the daemon: the state file is only read when it changes on disk
+ * and written by cmdRunFlushState(), not after every step. Disabling writes
+ * pending changes and drops the cached state.
+ *
+ * @param enable True to cache the run state, false to load and save it on every call.
+ */
+void cmdRunCacheState(bool enable);
+
+/**
+ * @brief Writes a cached run state with pending changes to its state file.
+ */
+void cmdRunFlushState(void);
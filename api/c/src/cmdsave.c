@@ -79,29 +79,15 @@ static cJSON* measurementToJson(const SingleMeasurement_t * measurement)
     return obj;
 }
 
-static Error_t addSingleMeasurement(Evi_t* self, char* key, int index, cJSON* obj)
+static void addSingleMeasurement(const SingleMeasurement_t * measurement, char* key, cJSON* obj)
 {
-    Error_t  ret = ERROR_EVI_OK;
-
-    SingleMeasurement_t measuremnt = {0};
-
-    ret = eviDenseLastMeasurements(self, index, &measuremnt);
-    if (ret == ERROR_EVI_OK)
+    if(key == NULL)
     {
-        if(key == NULL)
-        {
-            cJSON_AddItemToArray(obj, measurementToJson(&measuremnt));
-        }
-        else
-        {
-            cJSON_AddItemToObject(obj, key, measurementToJson(&measuremnt));
-        }
-        return ret;
+        cJSON_AddItemToArray(obj, measurementToJson(measurement));
     }
     else
     {
-        printError(ret, "Could not read measurement");
-        return ret;
+        cJSON_AddItemToObject(obj, key, measurementToJson(measurement));
     }
 }
 
@@ -170,41 +156,41 @@ static Error_t addMeasurement(Evi_t* self, Options_t * options, cJSON* json)
     if (ret != ERROR_EVI_OK)
         return ret;
 
-    int lastMeasurementsCount = atoi(value);
-    if (lastMeasurementsCount == 2 && options->raw == false)
+    uint32_t lastMeasurementsCount;
+    if (!eviParseUint32(value, &lastMeasurementsCount) || lastMeasurementsCount > EVI_DENSE_MAX_LAST_MEASUREMENTS)
     {
-        ret = addSingleMeasurement(self, DICT_BASELINE, 1, obj);
-        if (ret != ERROR_EVI_OK)
-            return ret;
+        printError(ERROR_EVI_PROTOCOL_ERROR, "Invalid measurement count %s", value);
+        return ERROR_EVI_PROTOCOL_ERROR;
+    }
 
-        ret = addSingleMeasurement(self, DICT_SAMPLE, 0, obj);
-        if (ret != ERROR_EVI_OK)
-            return ret;
+    // measurements[i] is the i-th last measurement
+    SingleMeasurement_t measurements[EVI_DENSE_MAX_LAST_MEASUREMENTS] = {0};
+    ret = eviDenseLastMeasurementsBatch(self, 0, lastMeasurementsCount, measurements);
+    if (ret != ERROR_EVI_OK)
+    {
+        printError(ret, "Could not read measurement");
+        return ret;
+    }
+
+    if (lastMeasurementsCount == 2 && options->raw == false)
+    {
+        addSingleMeasurement(&measurements[1], DICT_BASELINE, obj);
+        addSingleMeasurement(&measurements[0], DICT_SAMPLE, obj);
     }
     else if (lastMeasurementsCount == 3 && options->raw == false)
     {
-        ret = addSingleMeasurement(self, DICT_BASELINE, 2, obj);
-        if (ret != ERROR_EVI_OK)
-            return ret;
-
-        ret = addSingleMeasurement(self, DICT_AIR, 1, obj);
-        if (ret != ERROR_EVI_OK)
-            return ret;
-
-        ret = addSingleMeasurement(self, DICT_SAMPLE, 0, obj);
-        if (ret != ERROR_EVI_OK)
-            return ret;
+        addSingleMeasurement(&measurements[2], DICT_BASELINE, obj);
+        addSingleMeasurement(&measurements[1], DICT_AIR, obj);
+        addSingleMeasurement(&measurements[0], DICT_SAMPLE, obj);
     }
     else
     {
         cJSON* oValues = cJSON_CreateArray();
         cJSON_AddItemToObject(obj, DICT_VALUES, oValues);
 
-        for(int i = lastMeasurementsCount-1; i>=0; i--)
+        for(int i = (int)lastMeasurementsCount-1; i>=0; i--)
         {
-            ret = addSingleMeasurement(self, NULL, i, oValues);
-            if (ret != ERROR_EVI_OK)
-                return ret;
+            addSingleMeasurement(&measurements[i], NULL, oValues);
         }
     }
 
@@ -225,21 +211,21 @@ cJSON* dataLoadJson(Evi_t* self, const char * filename, bool append)
     // create new JSON file
     if (json == NULL)
     {
-        Error_t ret = ERROR_EVI_OK;
-        char    value[100];
+        const uint32_t indices[] = {INDEX_SERIALNUMBER, INDEX_VERSION};
+        char    values[2][100] = {0};
 
         json = cJSON_CreateObject();
 
-        ret = eviGet(self, INDEX_SERIALNUMBER, value, sizeof(value));
-        if (ret == ERROR_EVI_OK)
+        // a failed value is left empty and skipped
+        eviGetPipelined(self, indices, 2, values[0], sizeof(values[0]));
+        if (values[0][0] != 0)
         {
-            cJSON_AddItemToObject(json, DICT_SERIALNUMBER, cJSON_CreateString(value));
+            cJSON_AddItemToObject(json, DICT_SERIALNUMBER, cJSON_CreateString(values[0]));
         }
 
-        ret = eviGet(self, INDEX_VERSION, value, sizeof(value));
-        if (ret == ERROR_EVI_OK)
+        if (values[1][0] != 0)
         {
-            cJSON_AddItemToObject(json, DICT_FIRMWAREVERSION, cJSON_CreateString(value));
+            cJSON_AddItemToObject(json, DICT_FIRMWAREVERSION, cJSON_CreateString(values[1]));
         }
 
         cJSON_AddItemToObject(json, DICT_MEASUREMENTS, cJSON_CreateArray());
@@ -314,9 +300,9 @@ Error_t cmdSave(Evi_t* self, int argcCmd, char** argvCmd)
 
     json = dataLoadJson(self, options.filename, options.append);
     ret  = addMeasurement(self, &options, json);
-    if (ret == ERROR_EVI_OK)
+    if (ret == ERROR_EVI_OK && !json_saveToFile(options.filename, json))
     {
-        json_saveToFile(options.filename, json);
+        ret = printError(ERROR_EVI_FILE_IO_ERROR, "Could not write %s\n", options.filename);
     }
 exit:
     if (json)
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "cmdstats.h"
+#include "evistats.h"
+#include "printerror.h"
+#include <stdio.h>
+#include <string.h>
+
+static void cmdStatsPrint(const char * name, const EviHistogram_t * histogram)
+{
+    if (histogram->count == 0)
+    {
+        return;
+    }
+
+    // all durations in milliseconds
+    fprintf(stdout, "%-10s %8u %10.3f %10.3f %10.3f %10.3f\n", name, histogram->count,
+            (double)histogram->total / histogram->count / 1000.0,
+            eviHistogramPercentile(histogram, 50.0) / 1000.0,
+            eviHistogramPercentile(histogram, 99.0) / 1000.0,
+            histogram->max / 1000.0);
+}
+
+Error_t cmdStats(int argcCmd, char **argvCmd)
+{
+    EviStats_t stats;
+
+    if (argcCmd == 2 && strcmp(argvCmd[1], "reset") == 0)
+    {
+        eviStatsReset();
+        return ERROR_EVI_OK;
+    }
+    else if (argcCmd != 1)
+    {
+        return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
+    }
+
+    eviStatsGet(&stats);
+
+    fprintf(stdout, "%-10s %8s %10s %10s %10s %10s\n", "phase", "count", "mean", "p50", "p99", "max");
+    for (int i = 0; i < EVI_PHASE_COUNT; i++)
+    {
+        cmdStatsPrint(eviStatsPhaseName((EviPhase_t)i), &stats.phases[i]);
+    }
+
+    fprintf(stdout, "\n%-10s %8s %10s %10s %10s %10s\n", "command", "count", "mean", "p50", "p99", "max");
+    for (size_t i = 0; i < EVI_STATS_COMMANDS; i++)
+    {
+        cmdStatsPrint(eviStatsCommandName(i), &stats.commands[i]);
+    }
+
+    fprintf(stdout, "\n");
+    for (int i = 0; i < EVI_COUNTER_COUNT; i++)
+    {
+        fprintf(stdout, "%-19s %u\n", eviStatsCounterName((EviCounter_t)i), stats.counters[i]);
+    }
+    return ERROR_EVI_OK;
+}
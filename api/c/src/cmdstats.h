@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @brief Implements the `stats` command printing or clearing the command path statistics.
+ *
+ * @param argcCmd Number of command arguments stored in `argvCmd`.
+ * @param argvCmd Array of command arguments to parse.
+ * @return Error code indicating success or failure.
+ */
+Error_t cmdStats(int argcCmd, char **argvCmd);
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "cmdtrace.h"
+#include "evitrace.h"
+#include "printerror.h"
+#include <stdio.h>
+#include <string.h>
+
+Error_t cmdTrace(int argcCmd, char **argvCmd)
+{
+    Error_t ret;
+
+    if (argcCmd == 3 && strcmp(argvCmd[1], "save") == 0)
+    {
+        ret = eviTraceSave(argvCmd[2]);
+        if (ret == ERROR_EVI_INVALID_PARAMETER)
+        {
+            return printError(ret, "Tracing is not started, use --trace FILE.\n");
+        }
+    }
+    else if (argcCmd == 4 && strcmp(argvCmd[1], "export") == 0)
+    {
+        ret = eviTraceExportChrome(argvCmd[2], argvCmd[3]);
+        if (ret == ERROR_EVI_PROTOCOL_ERROR)
+        {
+            return printError(ret, "%s is not a trace file.\n", argvCmd[2]);
+        }
+    }
+    else
+    {
+        return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
+    }
+
+    if (ret != ERROR_EVI_OK)
+    {
+        printError(ret, NULL);
+    }
+    return ret;
+}
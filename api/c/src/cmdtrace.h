@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @brief Implements the `trace` command saving the protocol trace or converting a trace file to JSON.
+ *
+ * @param argcCmd Number of command arguments stored in `argvCmd`.
+ * @param argvCmd Array of command arguments to parse.
+ * @return Error code indicating success or failure.
+ */
+Error_t cmdTrace(int argcCmd, char **argvCmd);
@@ -87,6 +87,24 @@ static inline crc_t crc_init(void)
 crc_t crc_update(crc_t crc, const void *data, size_t data_len);
 
 
+/**
+ * Variants of crc_update() with identical results.
+ *
+ * crc_update_nibble() uses the 16 entry table generated by pycrc,
+ * crc_update_bytewise() a 256 entry table and crc_update_slice8() processes
+ * eight bytes per step with eight 256 entry tables. crc_update() uses the
+ * fastest of them.
+ *
+ * \param[in] crc      The current crc value.
+ * \param[in] data     Pointer to a buffer of \a data_len bytes.
+ * \param[in] data_len Number of bytes in the \a data buffer.
+ * \return             The updated crc value.
+ */
+crc_t crc_update_nibble(crc_t crc, const void *data, size_t data_len);
+crc_t crc_update_bytewise(crc_t crc, const void *data, size_t data_len);
+crc_t crc_update_slice8(crc_t crc, const void *data, size_t data_len);
+
+
 /**
  * Calculate the final crc value.
  *
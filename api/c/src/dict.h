@@ -41,6 +41,8 @@
 #define DICT_CONCENTRATION "concentration"
 #define DICT_DATE_TIME       "date_time"
 #define DICT_LOGGING         "logging"
+#define DICT_LOGGING_DROPPED "loggingDropped"
+#define DICT_JOURNAL_MERGED  "journalMerged"
 #define DICT_ADJUSTMENTS     "adjustments"
 #define DICT_CENTER_WAVELENGTHS "centerwavelengths"
 
@@ -3,15 +3,24 @@
 
 #include "evibase.h"
 #include "eviconfig.h"
-#include "crc-16-ccitt.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <termios.h>
 #include <dirent.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
@@ -67,6 +76,10 @@ int findTty(const char * name, int maxDepth, int currentDepth, char * devicePath
                 break;
             }
 
+            // links like subsystem or driver lead to other devices
+            if (entry->d_type != DT_DIR)
+                continue;
+
             ret = findTty(path, maxDepth, currentDepth + 1, devicePath, devicePathLength);
         }
     }
@@ -76,14 +89,18 @@ int findTty(const char * name, int maxDepth, int currentDepth, char * devicePath
 
 int getDeviceVidPid(const char *dev_path, uint16_t *vid, uint16_t *pid)
 {
-    char path[256];
+    char path[1024];
     snprintf(path, sizeof(path), "%s/idVendor", dev_path);
 
     FILE *f_vid = fopen(path, "r");
     if (!f_vid) {
         return -1;
     }
-    fscanf(f_vid, "%4hx", vid);  // Read 4 hex digits for VID
+    if (fscanf(f_vid, "%4hx", vid) != 1)  // Read 4 hex digits for VID
+    {
+        fclose(f_vid);
+        return -1;
+    }
     fclose(f_vid);
 
     snprintf(path, sizeof(path), "%s/idProduct", dev_path);
@@ -92,70 +109,235 @@ int getDeviceVidPid(const char *dev_path, uint16_t *vid, uint16_t *pid)
     if (!f_pid) {
         return -1;
     }
-    fscanf(f_pid, "%4hx", pid);  // Read 4 hex digits for PID
+    if (fscanf(f_pid, "%4hx", pid) != 1)  // Read 4 hex digits for PID
+    {
+        fclose(f_pid);
+        return -1;
+    }
     fclose(f_pid);
 
     return 0;
 }
 
-int listDir(const char *name, int maxDepth, int currentDepth, char * devicePath, int devicePathLength)
+int getDeviceSerial(const char *dev_path, char *serial, size_t serialSize)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/serial", dev_path);
+
+    serial[0] = 0;
+    FILE *f_serial = fopen(path, "r");
+    if (!f_serial) {
+        return -1;
+    }
+    if (fgets(serial, serialSize, f_serial) != NULL)
+    {
+        serial[strcspn(serial, "\r\n")] = 0;
+    }
+    fclose(f_serial);
+
+    return 0;
+}
+
+#define DEVICE_CACHE_SIZE 16
+
+typedef struct
+{
+    uint16_t vid;
+    uint16_t pid;
+    char serial[64];
+    char tty[64];
+} DeviceCacheEntry_t;
+
+typedef struct
+{
+    DeviceCacheEntry_t entries[DEVICE_CACHE_SIZE];
+    size_t count;
+    bool valid;
+    int watch;
+} DeviceCache_t;
+
+static DeviceCache_t deviceCache = {.count = 0, .valid = false, .watch = -1};
+
+// The cache and its watch are shared by all threads, e.g., the workers of a
+// manager, and guarded by a lock created on first use.
+static void * volatile deviceCacheLock;
+
+// Tty devices come and go in /dev when an instrument is plugged or unplugged.
+static void deviceCacheWatch(void)
+{
+    if (deviceCache.watch != -1)
+    {
+        return;
+    }
+
+    deviceCache.watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (deviceCache.watch == -1)
+    {
+        return;
+    }
+
+    if (inotify_add_watch(deviceCache.watch, "/dev", IN_CREATE | IN_DELETE) == -1)
+    {
+        close(deviceCache.watch);
+        deviceCache.watch = -1;
+    }
+}
+
+static bool deviceCacheChanged(void)
+{
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+
+    if (deviceCache.watch == -1)
+    {
+        return false;
+    }
+
+    while (read(deviceCache.watch, events, sizeof(events)) > 0)
+    {
+        changed = true;
+    }
+    return changed;
+}
+
+static void deviceCacheScan(bool verbose)
 {
-    int ret = -1;
     DIR *dir;
     struct dirent *entry;
+    const char * root = "/sys/bus/usb/devices";
 
-    if(currentDepth >= maxDepth)
-        return -1;
+    deviceCacheWatch();
+    // drain events queued before the scan, the scan sees their result
+    deviceCacheChanged();
 
-    if (!(dir = opendir(name)))
-        return -1;
+    deviceCache.count = 0;
+    deviceCache.valid = false;
 
-    while ((entry = readdir(dir)) != NULL && ret != 0)
+    if (!(dir = opendir(root)))
+        return;
+
+    while ((entry = readdir(dir)) != NULL && deviceCache.count < DEVICE_CACHE_SIZE)
     {
-        if (entry->d_type == DT_DIR || entry->d_type == DT_LNK)
-        {
-            char path[1024] = {0};
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-                continue;
+        char path[1024] = {0};
+        uint16_t devVid;
+        uint16_t devPid;
 
-            snprintf(path, sizeof(path), "%s/%s", name, entry->d_name);
+        // interfaces (e.g. 1-1:1.0) have no idVendor, devices have no ':'
+        if (entry->d_name[0] == '.' || strchr(entry->d_name, ':') != NULL)
+            continue;
 
-            uint16_t devVid;
-            uint16_t devPid;
-            if(getDeviceVidPid(path, &devVid, &devPid) == 0)
+        snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+        if (getDeviceVidPid(path, &devVid, &devPid) != 0)
+            continue;
+
+        if (devVid == EVI_COMMON_VID && devPid == EVI_COMMON_PID)
+        {
+            DeviceCacheEntry_t * device = &deviceCache.entries[deviceCache.count];
+            if (findTty(path, 4, 0, device->tty, sizeof(device->tty)) == 0)
             {
-                if(devVid == EVI_COMMON_VID && devPid == EVI_COMMON_PID)
+                device->tty[sizeof(device->tty) - 1] = 0;
+                device->vid = devVid;
+                device->pid = devPid;
+                getDeviceSerial(path, device->serial, sizeof(device->serial));
+                if (verbose)
                 {
-                    ret = findTty(name, 4, 0, devicePath, devicePathLength);
-                    if(ret == 0)
-                    {
-                        break;
-                    }
+                    fprintf(stderr, "DEVICES: %s %04x:%04x %s /dev/%s\n", entry->d_name, devVid, devPid, device->serial, device->tty);
                 }
+                deviceCache.count++;
             }
-
-            ret = listDir(path, maxDepth, currentDepth + 1, devicePath, devicePathLength);
         }
     }
     closedir(dir);
-    return ret;
+
+    // without a watch an empty result is not trusted, a device may appear anytime
+    deviceCache.valid = deviceCache.count > 0 || deviceCache.watch != -1;
+}
+
+static const DeviceCacheEntry_t * deviceCacheLookup(uint16_t vid, uint16_t pid, const char * serial, bool verbose)
+{
+    if (deviceCacheChanged())
+    {
+        deviceCache.valid = false;
+    }
+
+    if (!deviceCache.valid)
+    {
+        deviceCacheScan(verbose);
+    }
+
+    for (size_t i = 0; i < deviceCache.count; i++)
+    {
+        const DeviceCacheEntry_t * device = &deviceCache.entries[i];
+        if (device->vid == vid && device->pid == pid && (serial == NULL || strcmp(device->serial, serial) == 0))
+        {
+            return device;
+        }
+    }
+    return NULL;
 }
 
+void eviInvalidateDeviceCache(void)
+{
+    EviMutex_t * lock = eviMutexCreateOnce(&deviceCacheLock);
+
+    // without a lock nothing could have been cached
+    if (lock == NULL)
+    {
+        return;
+    }
+    eviMutexLock(lock);
+    deviceCache.valid = false;
+    eviMutexUnlock(lock);
+}
 
 Error_t eviFindDevice(char *portName, size_t *portNameSize, bool verbose)
 {
-    char path[64] = {0};
-    int found = listDir("/sys/bus/usb/devices", 4, 0, path, sizeof(path));
-    
-    if(found == 0)
+    EviMutex_t * lock = eviMutexCreateOnce(&deviceCacheLock);
+    const DeviceCacheEntry_t * device;
+    Error_t ret = ERROR_EVI_INSTRUMENT_NOT_FOUND;
+
+    if (lock == NULL)
+    {
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+
+    eviMutexLock(lock);
+    device = deviceCacheLookup(EVI_COMMON_VID, EVI_COMMON_PID, NULL, verbose);
+    if(device != NULL)
+    {
+        *portNameSize = snprintf(portName, *portNameSize, "/dev/%s", device->tty);
+        ret = ERROR_EVI_OK;
+    }
+    eviMutexUnlock(lock);
+    return ret;
+}
+
+Error_t eviEnumerateDevices(EviDeviceInfo_t *devices, size_t maxDevices, size_t *count, bool verbose)
+{
+    EviMutex_t * lock = eviMutexCreateOnce(&deviceCacheLock);
+
+    *count = 0;
+    if (lock == NULL)
     {
-        *portNameSize = snprintf(portName, *portNameSize, "/dev/%s", path);
-        return ERROR_EVI_OK;
+        return ERROR_EVI_OUT_OF_MEMORY;
     }
-    else
+
+    eviMutexLock(lock);
+    // refreshes the cache if devices were plugged or unplugged
+    deviceCacheLookup(EVI_COMMON_VID, EVI_COMMON_PID, NULL, verbose);
+
+    for (size_t i = 0; i < deviceCache.count && *count < maxDevices; i++)
     {
-        return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+        const DeviceCacheEntry_t * device = &deviceCache.entries[i];
+        if (device->vid == EVI_COMMON_VID && device->pid == EVI_COMMON_PID)
+        {
+            snprintf(devices[*count].portName, sizeof(devices[*count].portName), "/dev/%s", device->tty);
+            strcpy_s(devices[*count].serial, sizeof(devices[*count].serial), device->serial);
+            (*count)++;
+        }
     }
+    eviMutexUnlock(lock);
+    return *count > 0 ? ERROR_EVI_OK : ERROR_EVI_INSTRUMENT_NOT_FOUND;
 }
 
 int eviPortOpen(char *portName)
@@ -181,9 +363,15 @@ int eviPortOpen(char *portName)
 
             if (connect(hComm, (struct sockaddr*)&servaddr, sizeof(servaddr)) != 0)
             {
-                printf("connection with the server failed...\n");
-                exit(0);
+                // the caller decides whether a missing simulator is fatal
+                fprintf(stderr, "connection with the server failed...\n");
+                close(hComm);
+                return -1;
             }
+
+            // pipelined commands are small writes that must not wait for the acknowledgement of the previous one
+            int noDelay = 1;
+            setsockopt(hComm, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
             return hComm;
         }
         else
@@ -205,11 +393,11 @@ int eviPortOpen(char *portName)
         return -1;
     }
 
-    // Configure read and write operations to time out after 100 ms.
+    // Reads never block, eviPortRead() waits for data with poll().
     struct termios options;
     tcgetattr(hComm, &options);
     options.c_cc[VMIN] = 0;
-    options.c_cc[VTIME] = 1;
+    options.c_cc[VTIME] = 0;
 
     if (tcsetattr(hComm, TCSANOW, &options) == -1)
     {
@@ -237,6 +425,11 @@ int eviPortOpen(char *portName)
     return hComm;
 }
 
+bool eviPortIsValid(int hComm)
+{
+    return hComm != -1;
+}
+
 void eviPortClose(int hComm)
 {
     if (hComm != -1)
@@ -272,83 +465,344 @@ bool eviPortWrite(int hComm, char *buffer, bool verbose)
     return true;
 }
 
-uint32_t eviPortRead(int hComm, char *buffer, size_t size, bool verbose)
+int32_t eviPortRead(int hComm, char *buffer, size_t size, uint32_t timeout, bool verbose)
 {
+    struct pollfd fds = {.fd = hComm, .events = POLLIN};
     ssize_t received;
-    size_t count = 0;
-    char rx[EVI_MAX_LINE_LENGTH];
-    bool waitForStart = true;
-    bool done = false;
-    bool useChecksum = false;
-    int checkSumSeparator = -1;
-
-    do
-    {
-        memset(rx, 0, EVI_MAX_LINE_LENGTH);
-        received = read(hComm, rx, EVI_MAX_LINE_LENGTH);
-        if (received == -1)
+    int ready;
+
+    ready = poll(&fds, 1, (int)timeout);
+    if (ready == -1)
+    {
+        if (errno == EINTR)
         {
-            fprintf(stderr, "Could not read from port\n");
             return 0;
         }
+        fprintf(stderr, "Could not read from port\n");
+        return -1;
+    }
 
-        if (verbose && received > 0)
-        {
-            fprintf(stderr, "RX: %s\n", rx);
-        }
+    if (ready == 0)
+    {
+        return 0;
+    }
 
-        for (size_t i = 0; i < (size_t)received && !done; i++)
+    received = read(hComm, buffer, size);
+    if (received == -1)
+    {
+        if (errno == EAGAIN || errno == EINTR)
         {
-            if (waitForStart)
-            {
-                if (rx[i] == EVI_START_NO_CHK || rx[i] == EVI_START_WITH_CHK)
-                {
-                    waitForStart = false;
-                    if (rx[i] == EVI_START_WITH_CHK)
-                    {
-                        useChecksum = true;
-                    }
-                }
-            }
-            else
-            {
-                if (rx[i] == EVI_STOP1 || rx[i] == EVI_STOP2)
-                {
-                    done = true;
-                    buffer[count] = 0;
-                }
-                else
-                {
-                    buffer[count] = rx[i];
-                    if (buffer[count] == EVI_CHECKSUM_SEPARATOR)
-                    {
-                        checkSumSeparator = count;
-                    }
-                    count++;
-                }
-            }
+            return 0;
         }
-    } while (!done);
+        fprintf(stderr, "Could not read from port\n");
+        return -1;
+    }
 
-    if (useChecksum)
+    // readable but no data: the device or the simulator is gone
+    if (received == 0)
     {
-        crc_t crcReceived;
-        crc_t crc = crc_init();
-        crc = crc_update(crc, buffer, checkSumSeparator);
-        crc = crc_finalize(crc);
-        crcReceived = atoi(buffer + checkSumSeparator + 1);
-        if (crc == crcReceived)
-        {
-            buffer[checkSumSeparator] = 0;
-        }
-        else
+        fprintf(stderr, "Port closed\n");
+        return -1;
+    }
+
+    if (verbose)
+    {
+        fprintf(stderr, "RX: %.*s\n", (int)received, buffer);
+    }
+
+    return (int32_t)received;
+}
+
+uint64_t eviTimeMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+}
+
+uint64_t eviTimeUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+Error_t eviFileMap(const char * file, EviFileMapping_t * mapping)
+{
+    Error_t ret = ERROR_EVI_OK;
+    struct stat st;
+    int fd;
+
+    memset(mapping, 0, sizeof(*mapping));
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0)
+    {
+        return ERROR_EVI_FILE_NOT_FOUND;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+
+    mapping->size = (size_t)st.st_size;
+    if (mapping->size > 0)
+    {
+        void * data = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
         {
-            fprintf(stderr, "CRC differ: received message %s, calculated crc=%i", buffer, (uint32_t)crcReceived);
-            return 0;
+            mapping->size = 0;
+            ret = ERROR_EVI_FILE_IO_ERROR;
+            goto cleanup;
         }
+        mapping->data = data;
+    }
+
+cleanup:
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+    return ret;
+}
+
+void eviFileUnmap(EviFileMapping_t * mapping)
+{
+    if (mapping->data)
+    {
+        munmap((void *)mapping->data, mapping->size);
+    }
+    memset(mapping, 0, sizeof(*mapping));
+}
+
+bool eviReplaceFile(const char * from, const char * to)
+{
+    // atomic within a file system
+    return rename(from, to) == 0;
+}
+
+struct EviThread
+{
+    pthread_t thread;
+    void (*function)(void *argument);
+    void * argument;
+};
+
+struct EviMutex
+{
+    pthread_mutex_t mutex;
+};
+
+struct EviCondition
+{
+    pthread_cond_t condition;
+};
+
+static void * eviThreadMain(void * argument)
+{
+    EviThread_t * thread = argument;
+    thread->function(thread->argument);
+    return NULL;
+}
+
+EviThread_t * eviThreadStart(void (*function)(void *argument), void * argument)
+{
+    EviThread_t * thread = malloc(sizeof(*thread));
+
+    if (thread == NULL)
+    {
+        return NULL;
+    }
+
+    thread->function = function;
+    thread->argument = argument;
+    if (pthread_create(&thread->thread, NULL, eviThreadMain, thread) != 0)
+    {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void eviThreadJoin(EviThread_t * thread)
+{
+    if (thread)
+    {
+        pthread_join(thread->thread, NULL);
+        free(thread);
+    }
+}
+
+EviMutex_t * eviMutexCreate(void)
+{
+    EviMutex_t * mutex = malloc(sizeof(*mutex));
+
+    if (mutex)
+    {
+        pthread_mutex_init(&mutex->mutex, NULL);
+    }
+    return mutex;
+}
+
+void eviMutexLock(EviMutex_t * mutex)
+{
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void eviMutexUnlock(EviMutex_t * mutex)
+{
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+void eviMutexDestroy(EviMutex_t * mutex)
+{
+    if (mutex)
+    {
+        pthread_mutex_destroy(&mutex->mutex);
+        free(mutex);
+    }
+}
+
+EviCondition_t * eviConditionCreate(void)
+{
+    EviCondition_t * condition = malloc(sizeof(*condition));
+
+    if (condition)
+    {
+        pthread_cond_init(&condition->condition, NULL);
+    }
+    return condition;
+}
+
+void eviConditionWait(EviCondition_t * condition, EviMutex_t * mutex)
+{
+    pthread_cond_wait(&condition->condition, &mutex->mutex);
+}
+
+void eviConditionBroadcast(EviCondition_t * condition)
+{
+    pthread_cond_broadcast(&condition->condition);
+}
+
+void eviConditionDestroy(EviCondition_t * condition)
+{
+    if (condition)
+    {
+        pthread_cond_destroy(&condition->condition);
+        free(condition);
+    }
+}
+
+struct EviSignal
+{
+    int pipe[2];
+};
+
+EviSignal_t * eviSignalCreate(void)
+{
+    EviSignal_t * signal = malloc(sizeof(*signal));
+
+    if (signal == NULL)
+    {
+        return NULL;
+    }
+
+    if (pipe(signal->pipe) != 0)
+    {
+        free(signal);
+        return NULL;
     }
 
-    return count;
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(signal->pipe[i], F_SETFL, fcntl(signal->pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(signal->pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    return signal;
+}
+
+void eviSignalRaise(EviSignal_t * signal)
+{
+    char c = 0;
+    // a full pipe is raised already
+    if (write(signal->pipe[1], &c, 1) < 0)
+    {
+    }
+}
+
+void eviSignalClear(EviSignal_t * signal)
+{
+    char buffer[64];
+    while (read(signal->pipe[0], buffer, sizeof(buffer)) > 0)
+    {
+    }
+}
+
+intptr_t eviSignalHandle(const EviSignal_t * signal)
+{
+    return signal->pipe[0];
+}
+
+void eviSignalDestroy(EviSignal_t * signal)
+{
+    if (signal)
+    {
+        close(signal->pipe[0]);
+        close(signal->pipe[1]);
+        free(signal);
+    }
+}
+
+void * eviAtomicExchangePointer(void * volatile * target, void * value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+void * eviAtomicCompareExchangePointer(void * volatile * target, void * expected, void * value)
+{
+    __atomic_compare_exchange_n(target, &expected, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
+void * eviAtomicLoadPointer(void * volatile * target)
+{
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+void eviAtomicStorePointer(void * volatile * target, void * value)
+{
+    __atomic_store_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+int32_t eviAtomicAdd(volatile int32_t * target, int32_t value)
+{
+    return __atomic_add_fetch(target, value, __ATOMIC_SEQ_CST);
+}
+
+int32_t eviAtomicLoad(volatile int32_t * target)
+{
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+void eviAtomicStore(volatile int32_t * target, int32_t value)
+{
+    __atomic_store_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+void eviAtomicCopy(volatile void * destination, const volatile void * source, size_t size)
+{
+    volatile uint32_t * d = destination;
+    const volatile uint32_t * s = source;
+
+    for (size_t i = 0; i < size / sizeof(uint32_t); i++)
+    {
+        __atomic_store_n(&d[i], __atomic_load_n(&s[i], __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+}
+
+void eviAtomicFence(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
 }
 
 errno_t strncat_s(char *restrict dest, rsize_t destsz, const char *restrict src, rsize_t count)
@@ -402,5 +856,9 @@ int sprintf_s(char *str, size_t snprintf, const char *format, ...)
 
 void Sleep(uint32_t dwMilliseconds)
 {
-    sleep(dwMilliseconds);
+    struct timespec duration = {.tv_sec = dwMilliseconds / 1000, .tv_nsec = (long)(dwMilliseconds % 1000) * 1000000L};
+
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR)
+    {
+    }
 }
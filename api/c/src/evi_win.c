@@ -3,7 +3,6 @@
 
 #include "evibase.h"
 #include "eviconfig.h"
-#include "crc-16-ccitt.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -62,6 +61,7 @@ static bool devicePortName(HDEVINFO deviceInfoSet, PSP_DEVINFO_DATA deviceInfoDa
                 if (dataType == REG_SZ)
                 {
                     strncpy(portName, (char*)outputBuffer, *portNameSize);
+                    portName[*portNameSize - 1] = 0;
                 }
                 else if (dataType == REG_DWORD)
                 {
@@ -132,7 +132,26 @@ static uint16_t deviceProductIdentifier(char * instanceIdentifier, bool * ok)
     return result;
 }
 
-Error_t eviFindDevice(char * portName, size_t * portNameSize, bool verbose)
+// The cached port is shared by all threads, e.g., the workers of a manager,
+// and guarded by a lock created on first use.
+static char cachedPortName[MAX_PATH + 1] = {0};
+static void * volatile cachedPortLock;
+
+void eviInvalidateDeviceCache(void)
+{
+    EviMutex_t * lock = eviMutexCreateOnce(&cachedPortLock);
+
+    // without a lock nothing could have been cached
+    if (lock == NULL)
+    {
+        return;
+    }
+    eviMutexLock(lock);
+    cachedPortName[0] = 0;
+    eviMutexUnlock(lock);
+}
+
+static Error_t deviceFind(char * portName, size_t * portNameSize, bool verbose)
 {
     SetupTokens_t setupTokens[] = { {GUID_DEVCLASS_PORTS, DIGCF_PRESENT },
         { GUID_DEVCLASS_MODEM, DIGCF_PRESENT },
@@ -189,6 +208,109 @@ Error_t eviFindDevice(char * portName, size_t * portNameSize, bool verbose)
     return found ? ERROR_EVI_OK : ERROR_EVI_INSTRUMENT_NOT_FOUND;
 }
 
+Error_t eviFindDevice(char * portName, size_t * portNameSize, bool verbose)
+{
+    EviMutex_t * lock = eviMutexCreateOnce(&cachedPortLock);
+    Error_t ret = ERROR_EVI_OK;
+
+    if (lock == NULL)
+    {
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+    if (*portNameSize == 0)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+
+    eviMutexLock(lock);
+    if (cachedPortName[0] != 0)
+    {
+        strncpy(portName, cachedPortName, *portNameSize);
+        portName[*portNameSize - 1] = 0;
+    }
+    else
+    {
+        ret = deviceFind(portName, portNameSize, verbose);
+        if (ret == ERROR_EVI_OK)
+        {
+            strncpy(cachedPortName, portName, MAX_PATH);
+            cachedPortName[MAX_PATH] = 0;
+        }
+    }
+    eviMutexUnlock(lock);
+
+    return ret;
+}
+
+Error_t eviEnumerateDevices(EviDeviceInfo_t *devices, size_t maxDevices, size_t *count, bool verbose)
+{
+    SetupTokens_t setupTokens[] = { {GUID_DEVCLASS_PORTS, DIGCF_PRESENT },
+        { GUID_DEVCLASS_MODEM, DIGCF_PRESENT },
+        { GUID_DEVINTERFACE_COMPORT, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE },
+        { GUID_DEVINTERFACE_MODEM, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE }
+    };
+
+    int setupTokensCount = sizeof(setupTokens) / sizeof(setupTokens[0]);
+
+    *count = 0;
+    for (int i = 0; i < setupTokensCount && *count < maxDevices; ++i)
+    {
+        HDEVINFO deviceInfoSet = SetupDiGetClassDevs(&setupTokens[i].guid, NULL, NULL, setupTokens[i].flags);
+        if (deviceInfoSet == INVALID_HANDLE_VALUE)
+        {
+            continue;
+        }
+
+        SP_DEVINFO_DATA deviceInfoData;
+        memset(&deviceInfoData, 0, sizeof(deviceInfoData));
+        deviceInfoData.cbSize = sizeof(deviceInfoData);
+
+        DWORD index = 0;
+        while (*count < maxDevices && SetupDiEnumDeviceInfo(deviceInfoSet, index++, &deviceInfoData))
+        {
+            bool ok;
+            uint16_t vid;
+            uint16_t pid;
+            char * instanceIdentifier = deviceInstanceIdentifier(deviceInfoData.DevInst);
+            vid = deviceVendorIdentifier(instanceIdentifier, &ok);
+            pid = deviceProductIdentifier(instanceIdentifier, &ok);
+
+            if(verbose)
+            {
+                fprintf(stderr, "DEVICES: %s\n", instanceIdentifier);
+            }
+
+            if(vid == EVI_COMMON_VID && pid == EVI_COMMON_PID)
+            {
+                EviDeviceInfo_t * device = &devices[*count];
+                size_t portNameSize = sizeof(device->portName);
+                if(devicePortName(deviceInfoSet, &deviceInfoData, device->portName, &portNameSize))
+                {
+                    // USB\VID_1CBE&PID_0002\SERIAL
+                    const char * serial = strrchr(instanceIdentifier, '\\');
+                    bool duplicate = false;
+
+                    strcpy_s(device->serial, sizeof(device->serial), serial ? serial + 1 : "");
+
+                    // a port is listed by several setup classes
+                    for (size_t j = 0; j < *count; j++)
+                    {
+                        duplicate = duplicate || strcmp(devices[j].portName, device->portName) == 0;
+                    }
+                    if (!duplicate)
+                    {
+                        (*count)++;
+                    }
+                }
+            }
+            free(instanceIdentifier);
+        }
+        SetupDiDestroyDeviceInfoList(deviceInfoSet);
+    }
+
+    return *count > 0 ? ERROR_EVI_OK : ERROR_EVI_INSTRUMENT_NOT_FOUND;
+}
+
 EVI_HANDLE eviPortOpen(char * portName)
 {
     EVI_HANDLE hComm = {};
@@ -204,7 +326,18 @@ EVI_HANDLE eviPortOpen(char * portName)
         addr.sin_family = AF_INET;
         addr.sin_port = htons(5000);
 
-        connect(hComm.socket, (SOCKADDR *)(&addr), sizeof(addr));
+        if (connect(hComm.socket, (SOCKADDR *)(&addr), sizeof(addr)) == SOCKET_ERROR)
+        {
+            fprintf(stderr, "connection with the server failed...\n");
+            closesocket(hComm.socket);
+            hComm.socket = INVALID_SOCKET;
+        }
+        else
+        {
+            // pipelined commands are small writes that must not wait for the acknowledgement of the previous one
+            BOOL noDelay = TRUE;
+            setsockopt(hComm.socket, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+        }
         return hComm;
     }
     else
@@ -282,6 +415,15 @@ EVI_HANDLE eviPortOpen(char * portName)
     return hComm;
 }
 
+bool eviPortIsValid(EVI_HANDLE hComm)
+{
+    if(hComm.isSocket)
+    {
+        return hComm.socket != INVALID_SOCKET;
+    }
+    return hComm.valid;
+}
+
 void eviPortClose(EVI_HANDLE hComm)
 {
     if(hComm.isSocket)
@@ -329,92 +471,357 @@ bool eviPortWrite(EVI_HANDLE hComm, LPTSTR buffer, bool verbose)
     return true;
 }
 
-uint32_t eviPortRead(EVI_HANDLE hComm, LPTSTR buffer, size_t size, bool verbose)
+int32_t eviPortRead(EVI_HANDLE hComm, LPTSTR buffer, size_t size, uint32_t timeout, bool verbose)
 {
-    DWORD received;
-    DWORD count = 0;
-    char rx[EVI_MAX_LINE_LENGTH];
-    bool waitForStart = true;
-    bool done = false;
-    bool useChecksum = false;
-    int checkSumSeparator = -1;
+    DWORD received = 0;
 
-    do
+    if(hComm.isSocket)
     {
-        memset(rx, 0, EVI_MAX_LINE_LENGTH);
-        if(hComm.isSocket)
+        fd_set fds;
+        struct timeval tv = {.tv_sec = timeout / 1000, .tv_usec = (timeout % 1000) * 1000};
+        FD_ZERO(&fds);
+        FD_SET(hComm.socket, &fds);
+
+        int ready = select(0, &fds, NULL, NULL, &tv);
+        if(ready == SOCKET_ERROR)
         {
-            received = recv(hComm.socket, rx, EVI_MAX_LINE_LENGTH, 0);
-            if(received <= 0)
-            {
-                return -1;
-            }
+            fprintf(stderr, "could not read from port\n");
+            return -1;
         }
-        else
+        if(ready == 0)
         {
-            BOOL success = ReadFile(hComm.handle, rx, EVI_MAX_LINE_LENGTH, &received, NULL);
-            if (!success)
-            {
-                fprintf(stderr, "could not read from port\n");
-                return -1;
-            }
+            return 0;
         }
 
-        if(verbose && received > 0)
+        int n = recv(hComm.socket, buffer, (int)size, 0);
+        if(n <= 0)
         {
-            fprintf(stderr, "RX: %s\n", rx);
-        }		
+            return -1;
+        }
+        received = (DWORD)n;
+    }
+    else
+    {
+        // return as soon as a byte arrived, or after timeout without data
+        COMMTIMEOUTS timeouts = {0};
+        timeouts.ReadIntervalTimeout = MAXDWORD;
+        timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+        timeouts.ReadTotalTimeoutConstant = timeout;
+        timeouts.WriteTotalTimeoutConstant = 1;
+        timeouts.WriteTotalTimeoutMultiplier = 0;
+
+        if (!SetCommTimeouts(hComm.handle, &timeouts))
+        {
+            fprintf(stderr, "could not set timeouts\n");
+            return -1;
+        }
 
-        for (DWORD i = 0; i < received && !done; i++)
+        BOOL success = ReadFile(hComm.handle, buffer, (DWORD)size, &received, NULL);
+        if (!success)
         {
-            if (waitForStart)
-            {
-                if (rx[i] == EVI_START_NO_CHK || rx[i] == EVI_START_WITH_CHK)
-                {
-                    waitForStart = false;
-                    if(rx[i] == EVI_START_WITH_CHK)
-                    {
-                        useChecksum = true;
-                    }
-                }
-            }
-            else
-            {
-                if (rx[i] == EVI_STOP1 || rx[i] == EVI_STOP2)
-                {
-                    done = true;
-                    buffer[count] = 0;
-                }
-                else
-                {
-                    buffer[count] = rx[i];
-                    if(buffer[count] == EVI_CHECKSUM_SEPARATOR)
-                    {
-                        checkSumSeparator = count;
-                    }
-                    count++;
-                }
-            }
+            fprintf(stderr, "could not read from port\n");
+            return -1;
         }
-    } while (!done);
+    }
+
+    if(verbose && received > 0)
+    {
+        fprintf(stderr, "RX: %.*s\n", (int)received, buffer);
+    }
+
+    return (int32_t)received;
+}
+
+uint64_t eviTimeMs(void)
+{
+    return GetTickCount64();
+}
+
+uint64_t eviTimeUs(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
 
-    if(useChecksum)
+    if (frequency.QuadPart == 0)
     {
-        crc_t crcReceived;
-        crc_t crc = crc_init();
-        crc = crc_update(crc, buffer, checkSumSeparator);
-        crc = crc_finalize(crc);
-        crcReceived = atoi(buffer+checkSumSeparator+1);
-        if(crc == crcReceived)
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / frequency.QuadPart) * 1000000u + (uint64_t)(now.QuadPart % frequency.QuadPart) * 1000000u / (uint64_t)frequency.QuadPart;
+}
+
+Error_t eviFileMap(const char * file, EviFileMapping_t * mapping)
+{
+    Error_t ret = ERROR_EVI_OK;
+    LARGE_INTEGER size;
+    HANDLE hFile;
+
+    memset(mapping, 0, sizeof(*mapping));
+
+    hFile = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return ERROR_EVI_FILE_NOT_FOUND;
+    }
+
+    if (!GetFileSizeEx(hFile, &size))
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+
+    mapping->size = (size_t)size.QuadPart;
+    if (mapping->size > 0)
+    {
+        HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping == NULL)
         {
-            buffer[checkSumSeparator] = 0;
+            mapping->size = 0;
+            ret = ERROR_EVI_FILE_IO_ERROR;
+            goto cleanup;
         }
-        else
+
+        mapping->data = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (mapping->data == NULL)
         {
-            fprintf(stderr, "CRC differ: received message %s, calculated crc=%i", buffer, crcReceived);
-            return 0;
+            CloseHandle(hMapping);
+            mapping->size = 0;
+            ret = ERROR_EVI_FILE_IO_ERROR;
+            goto cleanup;
         }
+        mapping->handle = hMapping;
     }
 
-    return count;
+cleanup:
+    // the view stays valid after closing the file handle
+    CloseHandle(hFile);
+    return ret;
+}
+
+void eviFileUnmap(EviFileMapping_t * mapping)
+{
+    if (mapping->data)
+    {
+        UnmapViewOfFile(mapping->data);
+    }
+    if (mapping->handle)
+    {
+        CloseHandle((HANDLE)mapping->handle);
+    }
+    memset(mapping, 0, sizeof(*mapping));
+}
+
+bool eviReplaceFile(const char * from, const char * to)
+{
+    // rename() fails if to exists
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+struct EviThread
+{
+    HANDLE thread;
+    void (*function)(void *argument);
+    void * argument;
+};
+
+struct EviMutex
+{
+    CRITICAL_SECTION section;
+};
+
+struct EviCondition
+{
+    CONDITION_VARIABLE condition;
+};
+
+static DWORD WINAPI eviThreadMain(LPVOID argument)
+{
+    EviThread_t * thread = argument;
+    thread->function(thread->argument);
+    return 0;
+}
+
+EviThread_t * eviThreadStart(void (*function)(void *argument), void * argument)
+{
+    EviThread_t * thread = malloc(sizeof(*thread));
+
+    if (thread == NULL)
+    {
+        return NULL;
+    }
+
+    thread->function = function;
+    thread->argument = argument;
+    thread->thread = CreateThread(NULL, 0, eviThreadMain, thread, 0, NULL);
+    if (thread->thread == NULL)
+    {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void eviThreadJoin(EviThread_t * thread)
+{
+    if (thread)
+    {
+        WaitForSingleObject(thread->thread, INFINITE);
+        CloseHandle(thread->thread);
+        free(thread);
+    }
+}
+
+EviMutex_t * eviMutexCreate(void)
+{
+    EviMutex_t * mutex = malloc(sizeof(*mutex));
+
+    if (mutex)
+    {
+        InitializeCriticalSection(&mutex->section);
+    }
+    return mutex;
+}
+
+void eviMutexLock(EviMutex_t * mutex)
+{
+    EnterCriticalSection(&mutex->section);
+}
+
+void eviMutexUnlock(EviMutex_t * mutex)
+{
+    LeaveCriticalSection(&mutex->section);
+}
+
+void eviMutexDestroy(EviMutex_t * mutex)
+{
+    if (mutex)
+    {
+        DeleteCriticalSection(&mutex->section);
+        free(mutex);
+    }
+}
+
+EviCondition_t * eviConditionCreate(void)
+{
+    EviCondition_t * condition = malloc(sizeof(*condition));
+
+    if (condition)
+    {
+        InitializeConditionVariable(&condition->condition);
+    }
+    return condition;
+}
+
+void eviConditionWait(EviCondition_t * condition, EviMutex_t * mutex)
+{
+    SleepConditionVariableCS(&condition->condition, &mutex->section, INFINITE);
+}
+
+void eviConditionBroadcast(EviCondition_t * condition)
+{
+    WakeAllConditionVariable(&condition->condition);
+}
+
+void eviConditionDestroy(EviCondition_t * condition)
+{
+    free(condition);
+}
+
+struct EviSignal
+{
+    HANDLE event;
+};
+
+EviSignal_t * eviSignalCreate(void)
+{
+    EviSignal_t * signal = malloc(sizeof(*signal));
+
+    if (signal == NULL)
+    {
+        return NULL;
+    }
+
+    signal->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (signal->event == NULL)
+    {
+        free(signal);
+        return NULL;
+    }
+    return signal;
+}
+
+void eviSignalRaise(EviSignal_t * signal)
+{
+    SetEvent(signal->event);
+}
+
+void eviSignalClear(EviSignal_t * signal)
+{
+    ResetEvent(signal->event);
+}
+
+intptr_t eviSignalHandle(const EviSignal_t * signal)
+{
+    return (intptr_t)signal->event;
+}
+
+void eviSignalDestroy(EviSignal_t * signal)
+{
+    if (signal)
+    {
+        CloseHandle(signal->event);
+        free(signal);
+    }
+}
+
+void * eviAtomicExchangePointer(void * volatile * target, void * value)
+{
+    return InterlockedExchangePointer(target, value);
+}
+
+void * eviAtomicCompareExchangePointer(void * volatile * target, void * expected, void * value)
+{
+    return InterlockedCompareExchangePointer(target, value, expected);
+}
+
+void * eviAtomicLoadPointer(void * volatile * target)
+{
+    return InterlockedCompareExchangePointer(target, NULL, NULL);
+}
+
+void eviAtomicStorePointer(void * volatile * target, void * value)
+{
+    InterlockedExchangePointer(target, value);
+}
+
+int32_t eviAtomicAdd(volatile int32_t * target, int32_t value)
+{
+    return InterlockedExchangeAdd((volatile LONG *)target, value) + value;
+}
+
+int32_t eviAtomicLoad(volatile int32_t * target)
+{
+    return InterlockedCompareExchange((volatile LONG *)target, 0, 0);
+}
+
+void eviAtomicStore(volatile int32_t * target, int32_t value)
+{
+    InterlockedExchange((volatile LONG *)target, value);
+}
+
+void eviAtomicCopy(volatile void * destination, const volatile void * source, size_t size)
+{
+    volatile LONG * d = destination;
+    const volatile LONG * s = source;
+
+    // aligned volatile accesses of 32 bits are atomic
+    for (size_t i = 0; i < size / sizeof(LONG); i++)
+    {
+        d[i] = s[i];
+    }
+}
+
+void eviAtomicFence(void)
+{
+    MemoryBarrier();
 }
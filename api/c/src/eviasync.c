@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "eviasync.h"
+#include "evimanager.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    EviQueueNode_t node; // first member, queued as completion
+    EviAsync_t * async;
+    Evi_t * evi;
+    char cmd[EVI_MAX_LINE_LENGTH];
+    Error_t (*execute)(EvieResponse_t *response, void *user);
+    void * user;
+    EviCompletion_t completion;
+    void * completionUser;
+    Error_t result;
+} EviAsyncCommand_t;
+
+typedef struct
+{
+    Evi_t * evi;
+    EviWorker_t * worker;
+} EviAsyncDevice_t;
+
+// Workers push finished commands onto the completion queue and raise the
+// signal only if it is not raised already, so a burst of completions costs a
+// single wake-up of the event loop.
+struct EviAsync
+{
+    EviSignal_t * signal;
+    EviQueue_t completed;
+    volatile int32_t raised;
+    size_t pending;
+    EviAsyncDevice_t * devices;
+    size_t deviceCount;
+};
+
+EviAsync_t * eviAsyncCreate(void)
+{
+    EviAsync_t * async = calloc(1, sizeof(*async));
+
+    if (async == NULL)
+    {
+        return NULL;
+    }
+
+    async->signal = eviSignalCreate();
+    if (async->signal == NULL)
+    {
+        free(async);
+        return NULL;
+    }
+    eviQueueInit(&async->completed);
+    return async;
+}
+
+void eviAsyncDestroy(EviAsync_t * async)
+{
+    if (async == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < async->deviceCount; i++)
+    {
+        eviWorkerStop(async->devices[i].worker);
+    }
+    eviAsyncDispatch(async);
+
+    eviQueueClear(&async->completed);
+    eviSignalDestroy(async->signal);
+    free(async->devices);
+    free(async);
+}
+
+intptr_t eviAsyncHandle(const EviAsync_t * async)
+{
+    return eviSignalHandle(async->signal);
+}
+
+size_t eviAsyncDispatch(EviAsync_t * async)
+{
+    EviAsyncCommand_t * command;
+    size_t count = 0;
+
+    // a completion pushed from now on raises the signal again
+    eviAtomicStore(&async->raised, 0);
+    eviSignalClear(async->signal);
+
+    while ((command = (EviAsyncCommand_t *)eviQueuePop(&async->completed)) != NULL)
+    {
+        // the node is freed by the next pop, which a completion may trigger
+        EviCompletion_t completion = command->completion;
+        void * completionUser = command->completionUser;
+        Evi_t * evi = command->evi;
+        Error_t result = command->result;
+
+        async->pending--;
+        count++;
+        if (completion)
+        {
+            completion(evi, result, completionUser);
+        }
+    }
+    return count;
+}
+
+size_t eviAsyncPending(const EviAsync_t * async)
+{
+    return async->pending;
+}
+
+static Error_t eviAsyncRun(Evi_t * self, void * user)
+{
+    EviAsyncCommand_t * command = user;
+    EviAsync_t * async = command->async;
+    Error_t ret = eviExecute(self, command->cmd, command->execute, command->user);
+
+    // the command belongs to the event loop once it is queued
+    command->result = ret;
+    eviQueuePush(&async->completed, &command->node);
+    if (eviAtomicAdd(&async->raised, 1) == 1)
+    {
+        eviSignalRaise(async->signal);
+    }
+    return ret;
+}
+
+static EviWorker_t * eviAsyncWorker(EviAsync_t * async, Evi_t * self)
+{
+    EviAsyncDevice_t * devices;
+
+    for (size_t i = 0; i < async->deviceCount; i++)
+    {
+        if (async->devices[i].evi == self)
+        {
+            return async->devices[i].worker;
+        }
+    }
+
+    devices = realloc(async->devices, (async->deviceCount + 1) * sizeof(*devices));
+    if (devices == NULL)
+    {
+        return NULL;
+    }
+    async->devices = devices;
+
+    devices[async->deviceCount].evi = self;
+    devices[async->deviceCount].worker = eviWorkerStart(self);
+    if (devices[async->deviceCount].worker == NULL)
+    {
+        return NULL;
+    }
+    return devices[async->deviceCount++].worker;
+}
+
+Error_t eviExecuteAsync(EviAsync_t * async, Evi_t * self, const char * cmd, Error_t(execute)(EvieResponse_t *response, void *user), void * user, EviCompletion_t completion, void * completionUser)
+{
+    EviWorker_t * worker;
+    EviAsyncCommand_t * command;
+    size_t length = strlen(cmd);
+
+    if (length >= EVI_MAX_LINE_LENGTH)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+
+    worker = eviAsyncWorker(async, self);
+    if (worker == NULL)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+
+    command = malloc(sizeof(*command));
+    if (command == NULL)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+    command->async = async;
+    command->evi = self;
+    memcpy(command->cmd, cmd, length + 1);
+    command->execute = execute;
+    command->user = user;
+    command->completion = completion;
+    command->completionUser = completionUser;
+    command->result = ERROR_EVI_OK;
+
+    if (eviWorkerSubmit(worker, eviAsyncRun, command) != ERROR_EVI_OK)
+    {
+        free(command);
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+    async->pending++;
+    return ERROR_EVI_OK;
+}
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * Asynchronous commands
+ *
+ * eviExecuteAsync() queues a command and returns immediately. The command is
+ * sent by a worker thread per device, commands of the same device are
+ * executed in order, commands of different devices concurrently. Finished
+ * commands raise the handle returned by eviAsyncHandle(), the event loop then
+ * calls eviAsyncDispatch(), which runs the completion callbacks on its thread.
+ * All functions of an EviAsync_t must be called by the thread running the
+ * event loop.
+ */
+
+/**
+ * @brief Called by eviAsyncDispatch() when a command has finished.
+ *
+ * @param self The device the command was sent to.
+ * @param result Error code of the command.
+ * @param user User data passed with the command.
+ */
+typedef void (*EviCompletion_t)(Evi_t *self, Error_t result, void *user);
+
+/**
+ * @brief An event loop context created by eviAsyncCreate().
+ */
+typedef struct EviAsync EviAsync_t;
+
+/**
+ * @brief Creates an event loop context.
+ *
+ * @return The context, or NULL if it could not be created.
+ */
+DLLEXPORT EviAsync_t *eviAsyncCreate(void);
+
+/**
+ * @brief Waits for all outstanding commands, runs their completions and releases the context.
+ *
+ * @param async Context created by eviAsyncCreate(), may be NULL.
+ */
+DLLEXPORT void eviAsyncDestroy(EviAsync_t *async);
+
+/**
+ * @brief Returns the handle an event loop waits for.
+ *
+ * On Linux this is a file descriptor that becomes readable, e.g., for poll(),
+ * on Windows an event HANDLE for WaitForMultipleObjects().
+ *
+ * @param async Context created by eviAsyncCreate().
+ * @return The handle, raised while finished commands wait for eviAsyncDispatch().
+ */
+DLLEXPORT intptr_t eviAsyncHandle(const EviAsync_t *async);
+
+/**
+ * @brief Runs the completions of all finished commands without blocking.
+ *
+ * Must not be called from a completion.
+ *
+ * @param async Context created by eviAsyncCreate().
+ * @return Number of completions run.
+ */
+DLLEXPORT size_t eviAsyncDispatch(EviAsync_t *async);
+
+/**
+ * @brief Returns the number of commands whose completion has not run yet.
+ *
+ * @param async Context created by eviAsyncCreate().
+ * @return Number of outstanding commands.
+ */
+DLLEXPORT size_t eviAsyncPending(const EviAsync_t *async);
+
+/**
+ * @brief Queues a command and returns immediately.
+ *
+ * @param async Context created by eviAsyncCreate().
+ * @param self Device to send the command to, must stay valid until eviAsyncDestroy().
+ * @param cmd The command, copied.
+ * @param execute Parser called by the worker thread with the response.
+ * @param user User data passed to execute, must stay valid until the completion has run.
+ * @param completion Called by eviAsyncDispatch() with the result, may be NULL.
+ * @param completionUser User data passed to completion.
+ * @return ERROR_EVI_OK, or ERROR_EVI_INVALID_PARAMETER if the command is too long or no worker could be started.
+ */
+DLLEXPORT Error_t eviExecuteAsync(EviAsync_t *async, Evi_t *self, const char *cmd, Error_t(execute)(EvieResponse_t *response, void *user), void *user, EviCompletion_t completion, void *completionUser);
@@ -3,9 +3,11 @@
 
 #include "evibase.h"
 #include "crc-16-ccitt.h"
+#include "commonindex.h"
+#include "evistats.h"
+#include "evitrace.h"
 #include <stdio.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <stdarg.h>
 
 #define VERSION_DLL "0.2.1"
@@ -53,6 +55,10 @@ const char * eviError2String(Error_t e)
         return "File not found";
     case ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT:
         return "Unknown command line argument";
+    case ERROR_EVI_FILE_IO_ERROR:
+        return "File I/O error";
+    case ERROR_EVI_OUT_OF_MEMORY:
+        return "Out of memory";
     default:
         return "?";
     }
@@ -69,137 +75,619 @@ void eviFreeResponse(EvieResponse_t *response)
     free(response);
 }
 
-Error_t eviCommandComm(Evi_t *self, EVI_HANDLE hComm, const char * command, EvieResponse_t *response)
+static Error_t eviWriteCommand(Evi_t *self, const char * command)
 {
-    Error_t ret = ERROR_EVI_OK;
-
-    uint32_t txSize = EVI_MAX_LINE_LENGTH;
-    char * tx = (char *)calloc(1, txSize);
+    uint64_t start = eviTimeUs();
+    char tx[EVI_MAX_LINE_LENGTH] = {0};
     char s[20] = {0};
     if(self->useChecksum)
     {
         s[0] = EVI_START_WITH_CHK;
-        strncat_s(tx, txSize, s, 1);
-        strncat_s(tx, txSize, command, strlen(command));
+        strncat_s(tx, sizeof(tx), s, 1);
+        strncat_s(tx, sizeof(tx), command, strlen(command));
         s[0] = EVI_CHECKSUM_SEPARATOR;
-        strncat_s(tx, txSize, s, 1);
+        strncat_s(tx, sizeof(tx), s, 1);
         crc_t crc = crc_init();
         crc = crc_update(crc, command, strlen(command));
         crc = crc_finalize(crc);
         snprintf(s, sizeof(s), "%d", (uint32_t)crc);
-        strncat_s(tx, txSize, s, strlen(s));
+        strncat_s(tx, sizeof(tx), s, strlen(s));
     }
     else
     {
         s[0] = EVI_START_NO_CHK;
-        strncat_s(tx, txSize, s, 1);
-        strncat_s(tx, txSize, command, strlen(command));
+        strncat_s(tx, sizeof(tx), s, 1);
+        strncat_s(tx, sizeof(tx), command, strlen(command));
     }
-    strncat_s(tx, txSize, "\n", 1);
+    strncat_s(tx, sizeof(tx), "\n", 1);
 
-    eviPortWrite(hComm, tx, self->verbose);
-    if (eviPortRead(hComm, response->response, EVI_MAX_LINE_LENGTH, self->verbose) > 0)
+    eviTrace(self, EVI_TRACE_TX, tx, strlen(tx) - 1, ERROR_EVI_OK);
+    if (!eviPortWrite(self->session.handle, tx, self->verbose))
     {
-        for (int i = 0; i < EVI_MAX_ARGS; i++)
-        {
-            response->argv[i] = 0;
-        }
-        response->argc = 0;
-        int i = 0;
-        int inQuotes = 0;
-        char quoteChar = 0;
-        bool inToken = false;
-        char *d = response->response;
-        while ((d[i] != '\0') && (i < EVI_MAX_LINE_LENGTH) && (response->argc < EVI_MAX_ARGS))
+        return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+    }
+    eviStatsPhase(EVI_PHASE_WRITE, start);
+    return ERROR_EVI_OK;
+}
+
+// Extracts the next framed line from the session, reading from the port
+// until it is complete or the deadline has passed.
+static Error_t eviReadLine(Evi_t *self, char * line, size_t size, uint64_t deadline)
+{
+    EviSession_t * session = &self->session;
+    size_t count = 0;
+    size_t consumed = 0;
+    bool waitForStart = true;
+    bool done = false;
+    bool overflow = false;
+    bool useChecksum = false;
+    int checkSumSeparator = -1;
+
+    while (!done)
+    {
+        for (consumed = 0; consumed < session->rxCount && !done; consumed++)
         {
-            if (!inQuotes && (d[i] == '\'' || d[i] == '"'))
+            char c = session->rx[consumed];
+            if (waitForStart)
+            {
+                if (c == EVI_START_NO_CHK || c == EVI_START_WITH_CHK)
+                {
+                    waitForStart = false;
+                    useChecksum = (c == EVI_START_WITH_CHK);
+                }
+            }
+            else if (c == EVI_STOP1 || c == EVI_STOP2)
+            {
+                done = true;
+                line[count] = 0;
+            }
+            else if (count + 1 < size)
             {
-                inQuotes = 1;
-                quoteChar = d[i];
-                response->argv[response->argc++] = &d[i + 1];  // Start after the opening quote
-                inToken = true;
+                if (c == EVI_CHECKSUM_SEPARATOR)
+                {
+                    checkSumSeparator = count;
+                }
+                line[count++] = c;
             }
-            else if (inQuotes && d[i] == quoteChar)
+            else
             {
-                d[i] = '\0';  // Terminate the quoted string
-                inQuotes = 0;
-                inToken = false;
+                overflow = true;
             }
-            else if (!inQuotes && isspace(d[i]))
+        }
+
+        // keep bytes following the line for the next response
+        session->rxCount -= consumed;
+        memmove(session->rx, session->rx + consumed, session->rxCount);
+
+        if (!done)
+        {
+            uint64_t now = eviTimeMs();
+            if (now >= deadline)
             {
-                d[i] = '\0';
-                inToken = false;
+                eviStatsCount(EVI_COUNTER_TIMEOUT);
+                return ERROR_EVI_TIMEOUT;
             }
-            else if (!inQuotes && !inToken)
+
+            int32_t received = eviPortRead(session->handle, session->rx, sizeof(session->rx), (uint32_t)(deadline - now), self->verbose);
+            if (received < 0)
             {
-                response->argv[response->argc++] = &d[i];
-                inToken = true;
+                return ERROR_EVI_INSTRUMENT_NOT_FOUND;
             }
-            i++;
+            session->rxCount = received;
         }
-        ret = ERROR_EVI_OK;
+    }
 
+    if (overflow)
+    {
+        return ERROR_EVI_PROTOCOL_ERROR;
     }
-    else
+
+    if (useChecksum)
+    {
+        uint64_t start = eviTimeUs();
+        crc_t crcReceived;
+        crc_t crc;
+        uint32_t received;
+
+        if (checkSumSeparator < 0)
+        {
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
+
+        crc = crc_init();
+        crc = crc_update(crc, line, checkSumSeparator);
+        crc = crc_finalize(crc);
+        if (!eviParseUint32(line + checkSumSeparator + 1, &received) || received > UINT16_MAX)
+        {
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
+        crcReceived = (crc_t)received;
+        eviStatsPhase(EVI_PHASE_CRC, start);
+        if (crc == crcReceived)
+        {
+            line[checkSumSeparator] = 0;
+        }
+        else
+        {
+            fprintf(stderr, "CRC differ: received message %s, calculated crc=%i\n", line, (uint32_t)crc);
+            eviStatsCount(EVI_COUNTER_CRC_ERROR);
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
+    }
+
+    return ERROR_EVI_OK;
+}
+
+void eviResponseTokenize(EvieResponse_t *response)
+{
+    for (int i = 0; i < EVI_MAX_ARGS; i++)
+    {
+        response->argv[i] = 0;
+    }
+    response->argc = 0;
+    int i = 0;
+    int inQuotes = 0;
+    char quoteChar = 0;
+    bool inToken = false;
+    char *d = response->response;
+    while ((d[i] != '\0') && (i < EVI_MAX_LINE_LENGTH) && (response->argc < EVI_MAX_ARGS))
     {
-        ret = ERROR_EVI_INSTRUMENT_NOT_FOUND;
+        if (!inQuotes && (d[i] == '\'' || d[i] == '"'))
+        {
+            inQuotes = 1;
+            quoteChar = d[i];
+            response->argv[response->argc++] = &d[i + 1];  // Start after the opening quote
+            inToken = true;
+        }
+        else if (inQuotes && d[i] == quoteChar)
+        {
+            d[i] = '\0';  // Terminate the quoted string
+            inQuotes = 0;
+            inToken = false;
+        }
+        else if (!inQuotes && isspace(d[i]))
+        {
+            d[i] = '\0';
+            inToken = false;
+        }
+        else if (!inQuotes && !inToken)
+        {
+            response->argv[response->argc++] = &d[i];
+            inToken = true;
+        }
+        i++;
     }
+}
 
-    free(tx);
+static Error_t eviReadResponse(Evi_t *self, EvieResponse_t *response, uint64_t deadline)
+{
+    uint64_t start = eviTimeUs();
+    Error_t ret = eviReadLine(self, response->response, EVI_MAX_LINE_LENGTH, deadline);
+    if (ret != ERROR_EVI_OK)
+    {
+        if (ret == ERROR_EVI_PROTOCOL_ERROR)
+        {
+            eviStatsCount(EVI_COUNTER_PROTOCOL);
+        }
+        eviTrace(self, EVI_TRACE_RESULT, "", 0, ret);
+        return ret;
+    }
+    eviTrace(self, EVI_TRACE_RX, response->response, strlen(response->response), ERROR_EVI_OK);
+
+    eviResponseTokenize(response);
+
+    eviStatsPhase(EVI_PHASE_READ, start);
+    return ERROR_EVI_OK;
+}
+
+static void eviSessionCloseUnlocked(Evi_t *self);
+
+static uint64_t eviDeadline(Evi_t *self)
+{
+    return eviTimeMs() + (self->timeout != 0 ? self->timeout : EVI_DEFAULT_TIMEOUT);
+}
+
+static Error_t eviCommandComm(Evi_t *self, const char * command, EvieResponse_t *response)
+{
+    uint64_t start = eviTimeUs();
+    Error_t ret = eviWriteCommand(self, command);
+    if (ret == ERROR_EVI_OK)
+    {
+        ret = eviReadResponse(self, response, eviDeadline(self));
+    }
+    if (ret == ERROR_EVI_OK)
+    {
+        eviStatsCommand(command, start);
+    }
+
+    if (ret == ERROR_EVI_TIMEOUT)
+    {
+        // a late response must not be taken for the one of the next command
+        eviSessionCloseUnlocked(self);
+    }
     return ret;
 }
 
-Error_t eviCommand(Evi_t *self, const char * command, EvieResponse_t *response)
+Error_t eviFindDeviceBySerial(const char *serial, char *portName, size_t portNameSize, bool verbose)
+{
+    EviDeviceInfo_t devices[EVI_MAX_DEVICES];
+    size_t count = 0;
+    uint64_t start = eviTimeUs();
+
+    eviEnumerateDevices(devices, EVI_MAX_DEVICES, &count, verbose);
+    eviStatsPhase(EVI_PHASE_DISCOVERY, start);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(devices[i].serial, serial) == 0)
+        {
+            strcpy_s(portName, portNameSize, devices[i].portName);
+            return ERROR_EVI_OK;
+        }
+    }
+    return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+}
+
+static Error_t eviResolvePort(Evi_t *self, char * portName, size_t portNameSize)
+{
+    if (self->portName)
+    {
+        strcpy_s(portName, portNameSize, self->portName);
+        return ERROR_EVI_OK;
+    }
+    else
+    {
+        uint64_t start = eviTimeUs();
+        Error_t ret = eviFindDevice(portName, &portNameSize, self->verbose);
+        eviStatsPhase(EVI_PHASE_DISCOVERY, start);
+        return ret;
+    }
+}
+
+// Every function using the port holds the lock of the session, so the
+// command/response pairs of different threads do not interleave.
+EviMutex_t * eviMutexCreateOnce(void * volatile * lock)
+{
+    EviMutex_t * mutex = eviAtomicLoadPointer(lock);
+
+    if (mutex == NULL)
+    {
+        EviMutex_t * created = eviMutexCreate();
+        if (created == NULL)
+        {
+            return NULL;
+        }
+        mutex = eviAtomicCompareExchangePointer(lock, NULL, created);
+        if (mutex == NULL)
+        {
+            mutex = created;
+        }
+        else
+        {
+            // another thread was first
+            eviMutexDestroy(created);
+        }
+    }
+    return mutex;
+}
+
+static Error_t eviLock(Evi_t *self)
+{
+    EviMutex_t * lock = eviMutexCreateOnce(&self->session.lock);
+
+    if (lock == NULL)
+    {
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+    eviMutexLock(lock);
+    return ERROR_EVI_OK;
+}
+
+static void eviUnlock(Evi_t *self)
+{
+    eviMutexUnlock(self->session.lock);
+}
+
+static Error_t eviSessionOpenPort(Evi_t *self, char * portName)
+{
+    uint64_t start = eviTimeUs();
+
+    self->session.handle = eviPortOpen(portName);
+    eviStatsPhase(EVI_PHASE_OPEN, start);
+    if (!eviPortIsValid(self->session.handle))
+    {
+        eviStatsCount(EVI_COUNTER_PORT_FAILURE);
+        if (!self->portName)
+        {
+            eviInvalidateDeviceCache();
+        }
+        return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+    }
+    eviStatsCount(EVI_COUNTER_PORT_OPEN);
+
+    self->session.open = true;
+    self->session.rxCount = 0;
+    return ERROR_EVI_OK;
+}
+
+static Error_t eviSessionOpenUnlocked(Evi_t *self)
 {
     char portNameBuffer[1024];
-    size_t portNameBufferSize = sizeof(portNameBuffer);
 
+    if (self->session.open)
+    {
+        return ERROR_EVI_OK;
+    }
+
+    if (eviResolvePort(self, portNameBuffer, sizeof(portNameBuffer)) != ERROR_EVI_OK)
+    {
+        return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+    }
+
+    return eviSessionOpenPort(self, portNameBuffer);
+}
+
+static void eviSessionCloseUnlocked(Evi_t *self)
+{
+    if (self->session.open)
+    {
+        eviPortClose(self->session.handle);
+        self->session.open = false;
+    }
+}
+
+Error_t eviSessionOpen(Evi_t *self)
+{
+    Error_t ret;
+
+    ret = eviLock(self);
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+    ret = eviSessionOpenUnlocked(self);
+    eviUnlock(self);
+    return ret;
+}
+
+void eviSessionClose(Evi_t *self)
+{
+    // without a mutex the session could not have been opened
+    if (eviLock(self) != ERROR_EVI_OK)
+    {
+        return;
+    }
+    eviSessionCloseUnlocked(self);
+    eviUnlock(self);
+}
+
+void eviSessionFree(Evi_t *self)
+{
+    eviSessionClose(self);
+    eviMutexDestroy(self->session.lock);
+    self->session.lock = NULL;
+}
+
+Error_t eviCommand(Evi_t *self, const char * command, EvieResponse_t *response)
+{
     Error_t ret = ERROR_EVI_OK;
-    if (self->portName)
+
+    ret = eviLock(self);
+    if (ret != ERROR_EVI_OK)
     {
-        strcpy_s(portNameBuffer, portNameBufferSize, self->portName);
+        return ret;
+    }
+    if (self->session.open)
+    {
+        ret = eviCommandComm(self, command, response);
     }
     else
     {
-        ret = eviFindDevice(portNameBuffer, &portNameBufferSize, self->verbose);
+        ret = eviSessionOpenUnlocked(self);
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = eviCommandComm(self, command, response);
+            eviSessionCloseUnlocked(self);
+        }
     }
+    eviUnlock(self);
+    return ret;
+}
 
-    if (ret == ERROR_EVI_OK)
+bool eviParseUint32(const char *s, uint32_t *value)
+{
+    uint32_t v = 0;
+
+    if (s == NULL || *s == '\0')
     {
-        EVI_HANDLE hComm = eviPortOpen(portNameBuffer);
-        ret = eviCommandComm(self, hComm, command, response);
-        eviPortClose(hComm);
+        return false;
+    }
+
+    for (; *s != '\0'; s++)
+    {
+        uint32_t digit = (uint32_t)(*s - '0');
+        if (digit > 9 || v > (UINT32_MAX - digit) / 10)
+        {
+            return false;
+        }
+        v = v * 10 + digit;
+    }
+
+    *value = v;
+    return true;
+}
+
+Error_t eviResponseGetUint32(const EvieResponse_t *response, uint32_t first, uint32_t count, uint32_t *values)
+{
+    if (response->argc != first + count)
+    {
+        return ERROR_EVI_PROTOCOL_ERROR;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!eviParseUint32(response->argv[first + i], &values[i]))
+        {
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
+    }
+    return ERROR_EVI_OK;
+}
+
+static Error_t eviEvaluate(Evi_t *self, const char * cmd, EvieResponse_t *response, Error_t(execute)(EvieResponse_t *response, void *user), void *user)
+{
+    uint64_t start = eviTimeUs();
+    Error_t ret;
+
+    if (response->argc > 0 && strncmp(response->argv[0], cmd, 1) == 0)
+    {
+        ret = execute(response, user);
+    }
+    else if(response->argc == 2 && strncmp(response->argv[0], "E", 1) == 0)
+    {
+        uint32_t error;
+        if (!eviParseUint32(response->argv[1], &error) || error > UINT16_MAX)
+        {
+            ret = ERROR_EVI_PROTOCOL_ERROR;
+        }
+        else
+        {
+            // the empty log ends every drain and is no failure of the device
+            if (!(cmd[0] == 'Q' && error == ERROR_EVI_NO_MORE_LOGGING))
+            {
+                eviStatsCount(EVI_COUNTER_DEVICE_ERROR);
+            }
+            ret = (Error_t)error;
+        }
     }
     else
     {
-        ret = ERROR_EVI_INSTRUMENT_NOT_FOUND;
+        ret = ERROR_EVI_RESPONSE_ERROR;
+    }
+
+    eviStatsPhase(EVI_PHASE_PARSE, start);
+    if (ret == ERROR_EVI_PROTOCOL_ERROR || ret == ERROR_EVI_RESPONSE_ERROR)
+    {
+        eviStatsCount(EVI_COUNTER_PROTOCOL);
     }
+    eviTrace(self, EVI_TRACE_RESULT, cmd, strlen(cmd), ret);
     return ret;
 }
 
 Error_t eviExecute(Evi_t * self, char * cmd, Error_t(execute)(EvieResponse_t *response, void *user), void *user)
 {
-    EvieResponse_t *response = eviCreateResponse();
-    Error_t ret = eviCommand(self, cmd, response);
+    EvieResponse_t response;
+    Error_t ret = eviCommand(self, cmd, &response);
     if (ret == ERROR_EVI_OK)
     {
-        if (strncmp(response->argv[0], cmd, 1) == 0)
+        ret = eviEvaluate(self, cmd, &response, execute, user);
+    }
+    return ret;
+}
+
+// Keeps up to window commands in flight. With stopOnError no command is sent
+// after the first failed one, the entries not sent get that error.
+static Error_t eviPipelineComm(Evi_t * self, EviPipelineEntry_t *entries, size_t count, size_t window, bool stopOnError, EviProgress_t progress, void *user)
+{
+    Error_t ret = ERROR_EVI_OK;
+    Error_t comm = ERROR_EVI_OK;
+    EvieResponse_t response;
+    uint64_t sentAt[EVI_PIPELINE_WINDOW];
+    size_t sent = 0;
+    size_t received = 0;
+
+    if (window > EVI_PIPELINE_WINDOW)
+    {
+        window = EVI_PIPELINE_WINDOW;
+    }
+
+    while (received < count)
+    {
+        while (comm == ERROR_EVI_OK && !(stopOnError && ret != ERROR_EVI_OK) && sent < count && sent - received < window)
         {
-            ret = execute(response, user);
+            sentAt[sent % EVI_PIPELINE_WINDOW] = eviTimeUs();
+            comm = eviWriteCommand(self, entries[sent].command);
+            if (comm == ERROR_EVI_OK)
+            {
+                sent++;
+            }
         }
-        else
+
+        if (comm == ERROR_EVI_OK && received < sent)
         {
-            if(response->argc == 2 && strncmp(response->argv[0], "E", 1) == 0)
+            // every command in flight gets the full timeout
+            comm = eviReadResponse(self, &response, eviDeadline(self));
+            if (comm == ERROR_EVI_OK)
             {
-                ret = atoi(response->argv[1]);
+                eviStatsCommand(entries[received].command, sentAt[received % EVI_PIPELINE_WINDOW]);
             }
-            else
+        }
+
+        if (comm != ERROR_EVI_OK)
+        {
+            entries[received].result = comm;
+        }
+        else if (received < sent)
+        {
+            entries[received].result = eviEvaluate(self, entries[received].command, &response, entries[received].execute, entries[received].user);
+        }
+        else
+        {
+            entries[received].result = ret;
+        }
+
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = entries[received].result;
+        }
+        received++;
+        if (progress)
+        {
+            progress(received, count, user);
+        }
+    }
+
+    if (comm != ERROR_EVI_OK && sent > 0)
+    {
+        // responses still in flight cannot be matched to a command anymore
+        eviSessionCloseUnlocked(self);
+    }
+    return ret;
+}
+
+Error_t eviExecutePipelined(Evi_t * self, EviPipelineEntry_t *entries, size_t count)
+{
+    Error_t ret = ERROR_EVI_OK;
+
+    ret = eviLock(self);
+    if (ret != ERROR_EVI_OK)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            entries[i].result = ret;
+        }
+        return ret;
+    }
+    if (self->session.open)
+    {
+        ret = eviPipelineComm(self, entries, count, EVI_PIPELINE_WINDOW, false, NULL, NULL);
+    }
+    else
+    {
+        ret = eviSessionOpenUnlocked(self);
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = eviPipelineComm(self, entries, count, EVI_PIPELINE_WINDOW, false, NULL, NULL);
+            eviSessionCloseUnlocked(self);
+        }
+        else
+        {
+            for (size_t i = 0; i < count; i++)
             {
-                ret = ERROR_EVI_RESPONSE_ERROR;
+                entries[i].result = ret;
             }
         }
     }
-    eviFreeResponse(response);
+    eviUnlock(self);
     return ret;
 }
 
@@ -230,6 +718,25 @@ Error_t eviGet_(EvieResponse_t *response, void *user)
     }
 }
 
+// Reads a value while the caller holds the lock of the session.
+static Error_t eviGetUnlocked(Evi_t * self, uint32_t index, char * value, size_t valueSize)
+{
+    char cmd[EVI_MAX_LINE_LENGTH];
+    EvieResponse_t response;
+    UserGet user = { 0 };
+    Error_t ret;
+
+    user.value = value;
+    user.length = valueSize;
+    sprintf_s(cmd, EVI_MAX_LINE_LENGTH, "V %i", index);
+    ret = eviCommandComm(self, cmd, &response);
+    if (ret == ERROR_EVI_OK)
+    {
+        ret = eviEvaluate(self, cmd, &response, eviGet_, &user);
+    }
+    return ret;
+}
+
 Error_t eviGet(Evi_t * self, uint32_t index, char * value, size_t valueSize)
 {
     char cmd[EVI_MAX_LINE_LENGTH];
@@ -240,6 +747,38 @@ Error_t eviGet(Evi_t * self, uint32_t index, char * value, size_t valueSize)
     return eviExecute(self, cmd, eviGet_, &user);
 }
 
+Error_t eviGetPipelined(Evi_t * self, const uint32_t * indices, size_t count, char * values, size_t valueSize)
+{
+    Error_t ret = ERROR_EVI_OK;
+    EviPipelineEntry_t * entries = calloc(count, sizeof(EviPipelineEntry_t));
+    UserGet * users = calloc(count, sizeof(UserGet));
+    char (*cmds)[20] = calloc(count, sizeof(*cmds));
+
+    if (entries == NULL || users == NULL || cmds == NULL)
+    {
+        ret = ERROR_EVI_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        sprintf_s(cmds[i], sizeof(cmds[i]), "V %u", indices[i]);
+        users[i].value = values + i * valueSize;
+        users[i].length = valueSize;
+        entries[i].command = cmds[i];
+        entries[i].execute = eviGet_;
+        entries[i].user = &users[i];
+    }
+
+    ret = eviExecutePipelined(self, entries, count);
+
+cleanup:
+    free(entries);
+    free(users);
+    free(cmds);
+    return ret;
+}
+
 Error_t eviSet(Evi_t * self, uint32_t index, const char * value)
 {
     char cmd[EVI_MAX_LINE_LENGTH];
@@ -272,164 +811,480 @@ Error_t eviLogging(Evi_t *self, char *line, size_t length)
     return eviExecute(self, cmd, eviLogging_, &user);
 }
 
-Error_t eviSelftest_(EvieResponse_t *response, void *user)
+void eviLogRingInit(EviLogRing_t *ring, char (*lines)[EVI_MAX_LINE_LENGTH], size_t capacity)
 {
-    UserSelftest *u = (UserSelftest *)user;
-    if (response->argc == 2)
+    ring->lines = lines;
+    ring->capacity = capacity;
+    ring->first = 0;
+    ring->count = 0;
+    ring->dropped = 0;
+    ring->grow = lines == NULL;
+}
+
+void eviLogRingFree(EviLogRing_t *ring)
+{
+    if (ring->grow)
     {
-        *(u->result)    = strtoul(response->argv[1], 0, 10);
-        return ERROR_EVI_OK;
+        free(ring->lines);
+        eviLogRingInit(ring, NULL, 0);
     }
-    else
+}
+
+const char *eviLogRingLine(const EviLogRing_t *ring, size_t index)
+{
+    return ring->lines[(ring->first + index) % ring->capacity];
+}
+
+typedef struct
+{
+    EviLogRing_t * ring;
+    size_t drained;
+} UserLoggingDrain;
+
+static Error_t eviLoggingDrain_(EvieResponse_t *response, void *user)
+{
+    UserLoggingDrain *u = (UserLoggingDrain *)user;
+    EviLogRing_t * ring = u->ring;
+
+    if (response->argc != 2)
     {
         return ERROR_EVI_PROTOCOL_ERROR;
     }
+
+    u->drained++;
+    if (ring && ring->grow && ring->count == ring->capacity && ring->dropped == 0)
+    {
+        // a ring that already dropped lines must not grow, its lines are out of order
+        size_t capacity = ring->capacity > 0 ? ring->capacity * 2 : EVI_LOGGING_BATCH;
+        char (*lines)[EVI_MAX_LINE_LENGTH] = realloc(ring->lines, capacity * sizeof(*lines));
+        if (lines)
+        {
+            ring->lines = lines;
+            ring->capacity = capacity;
+        }
+    }
+    if (ring && ring->capacity == 0)
+    {
+        ring->dropped++;
+    }
+    else if (ring)
+    {
+        size_t index;
+        if (ring->count < ring->capacity)
+        {
+            index = (ring->first + ring->count++) % ring->capacity;
+        }
+        else
+        {
+            index = ring->first;
+            ring->first = (ring->first + 1) % ring->capacity;
+            ring->dropped++;
+        }
+        strncpy_s(ring->lines[index], EVI_MAX_LINE_LENGTH, response->argv[1], EVI_MAX_LINE_LENGTH);
+    }
+    return ERROR_EVI_OK;
 }
 
-Error_t eviSelftest(Evi_t * self, uint32_t * result)
+// The number of pending lines is unknown and usually small, so the drain
+// starts with a single `Q` and pipelines as many as lines have been read so
+// far, up to EVI_LOGGING_BATCH. A batch ends with the error of an empty log;
+// the commands still in flight after it return the same error, or a line
+// logged meanwhile, which is kept.
+static Error_t eviLoggingDrainComm(Evi_t *self, UserLoggingDrain *user)
 {
-    UserSelftest user = {.result = result};
-    return eviExecute(self, "Y", eviSelftest_, &user);
+    EviPipelineEntry_t entries[EVI_LOGGING_BATCH];
+    Error_t ret = ERROR_EVI_OK;
+
+    for (size_t i = 0; i < EVI_LOGGING_BATCH; i++)
+    {
+        entries[i].command = "Q";
+        entries[i].execute = eviLoggingDrain_;
+        entries[i].user = user;
+    }
+
+    while (ret == ERROR_EVI_OK)
+    {
+        size_t batch = user->drained < 1 ? 1 : (user->drained < EVI_LOGGING_BATCH ? user->drained : EVI_LOGGING_BATCH);
+        ret = eviPipelineComm(self, entries, batch, batch, true, NULL, NULL);
+    }
+    return ret == ERROR_EVI_NO_MORE_LOGGING ? ERROR_EVI_OK : ret;
 }
 
-static int getlineInternal(char **lineptr, size_t *n, FILE *stream) {
-    char *bufptr = NULL;
-    char *p = bufptr;
-    size_t size;
-    int c;
+Error_t eviLoggingDrain(Evi_t *self, EviLogRing_t *ring, size_t *drained)
+{
+    UserLoggingDrain user = {.ring = ring, .drained = 0};
+    Error_t ret = ERROR_EVI_OK;
 
-    if (lineptr == NULL) {
-        return -1;
+    ret = eviLock(self);
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
     }
-    if (stream == NULL) {
-        return -1;
+    if (self->session.open)
+    {
+        ret = eviLoggingDrainComm(self, &user);
     }
-    if (n == NULL) {
-        return -1;
+    else
+    {
+        ret = eviSessionOpenUnlocked(self);
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = eviLoggingDrainComm(self, &user);
+            eviSessionCloseUnlocked(self);
+        }
     }
-    bufptr = *lineptr;
-    size = *n;
+    eviUnlock(self);
 
-    c = fgetc(stream);
-    if (c == EOF) {
-        return -1;
+    if (drained)
+    {
+        *drained = user.drained;
     }
-    if (bufptr == NULL) {
-        bufptr = malloc(128);
-        if (bufptr == NULL) {
+    return ret;
+}
+
+Error_t eviSelftest_(EvieResponse_t *response, void *user)
+{
+    UserSelftest *u = (UserSelftest *)user;
+    return eviResponseGetUint32(response, 1, 1, u->result);
+}
+
+Error_t eviSelftest(Evi_t * self, uint32_t * result)
+{
+    UserSelftest user = {.result = result};
+    return eviExecute(self, "Y", eviSelftest_, &user);
+}
+
+// Longest S-record that still fits into a framed "S <record>" command with checksum.
+#define EVI_SREC_MAX_LENGTH (EVI_MAX_LINE_LENGTH - 16)
+
+/**
+ * @struct EviFirmware_t
+ * @brief An SREC file prepared as "S <record>" commands.
+ */
+typedef struct
+{
+    char * commands;               /**< All commands, null-terminated one after another. */
+    EviPipelineEntry_t * entries;  /**< One entry per record. */
+    size_t count;                  /**< Number of records. */
+} EviFirmware_t;
+
+static int eviHexByte(const char * s)
+{
+    int value = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        char c = s[i];
+
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+        {
+            value |= c - '0';
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            value |= c - 'A' + 10;
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            value |= c - 'a' + 10;
+        }
+        else
+        {
             return -1;
         }
-        size = 128;
     }
-    p = bufptr;
-    while(c != EOF) {
-        if ((p - bufptr) > (size - 1)) {
-            size = size + 128;
-            bufptr = realloc(bufptr, size);
-            if (bufptr == NULL) {
-                return -1;
-            }
-        }
-        *p++ = c;
-        if (c == '\n') {
-            break;
+    return value;
+}
+
+// Checks type, length, hex digits and checksum of a Motorola S-record, the
+// same way the device does before it writes the flash.
+static Error_t eviSrecCheck(const char * record, size_t length)
+{
+    int count;
+    uint8_t sum;
+
+    if (length < 4 || length > EVI_SREC_MAX_LENGTH || (length % 2) != 0 || record[0] != 'S' || record[1] < '0' || record[1] > '9')
+    {
+        return ERROR_EVI_SREC_INVALID_STRING;
+    }
+    if (record[1] == '4')
+    {
+        return ERROR_EVI_SREC_UNSUPPORTED_TYPE;
+    }
+
+    count = eviHexByte(&record[2]);
+    if (count < 0 || (size_t)count != (length - 4) / 2)
+    {
+        return ERROR_EVI_SREC_INVALID_STRING;
+    }
+
+    sum = (uint8_t)count;
+    for (size_t i = 4; i < length; i += 2)
+    {
+        int value = eviHexByte(&record[i]);
+        if (value < 0)
+        {
+            return ERROR_EVI_SREC_INVALID_STRING;
         }
-        c = fgetc(stream);
+        sum += (uint8_t)value;
     }
 
-    *p++ = '\0';
-    *lineptr = bufptr;
-    *n = size;
+    // the checksum byte completes the sum of all bytes to 0xFF
+    return sum == 0xFF ? ERROR_EVI_OK : ERROR_EVI_SREC_INVALID_CRC;
+}
 
-    return p - bufptr - 1;
+static Error_t eviFwUpdate_(EvieResponse_t *response, void *user)
+{
+    (void)response;
+    (void)user;
+    return ERROR_EVI_OK;
 }
 
-Error_t eviFwUpdate(Evi_t * self, const char * file)
+static void eviFirmwareFree(EviFirmware_t * firmware)
+{
+    free(firmware->commands);
+    free(firmware->entries);
+    memset(firmware, 0, sizeof(*firmware));
+}
+
+static Error_t eviFirmwareLoad(const char * file, EviFirmware_t * firmware)
 {
     Error_t ret = ERROR_EVI_FILE_NOT_FOUND;
-    FILE * f = fopen(file, "r");
-    size_t n = 0;
-    char * line = NULL;
-    int length = 0;
-    char cmd[255];
-    char portNameBuffer[1024];
-    size_t portNameBufferSize = sizeof(portNameBuffer);
-    EvieResponse_t *response = NULL;
-    EVI_HANDLE hComm = {0};
-    bool hCommOpened = false;
+    FILE * f = fopen(file, "rb");
+    char * data = NULL;
+    char * line;
+    char * end;
+    char * command;
+    long size;
+    size_t lines = 1;
 
-    if(f == NULL)
+    memset(firmware, 0, sizeof(*firmware));
+    if (f == NULL)
     {
         return ret;
     }
 
-    ret = ERROR_EVI_OK;
-    if(self->portName == 0)
+    ret = ERROR_EVI_FILE_IO_ERROR;
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0)
     {
-        ret = eviFindDevice(portNameBuffer, &portNameBufferSize, self->verbose);
-        if(ret != ERROR_EVI_OK)
+        goto cleanup;
+    }
+
+    data = malloc((size_t)size + 1);
+    if (data == NULL || fread(data, 1, (size_t)size, f) != (size_t)size)
+    {
+        goto cleanup;
+    }
+    end = data + size;
+
+    for (line = data; line < end; line++)
+    {
+        if (*line == '\n')
         {
-            goto cleanup;
+            lines++;
         }
     }
-    else
+
+    // every record gets "S " and a terminator
+    firmware->entries = malloc(lines * sizeof(*firmware->entries));
+    firmware->commands = malloc((size_t)size + 3 * lines);
+    if (firmware->entries == NULL || firmware->commands == NULL)
     {
-        strcpy_s(portNameBuffer, portNameBufferSize, self->portName);
+        goto cleanup;
     }
 
-    response = eviCreateResponse();
-    if(response == NULL)
+    command = firmware->commands;
+    for (line = data; line < end; )
     {
-        ret = ERROR_EVI_FILE_IO_ERROR;
-        goto cleanup;
+        char * next = memchr(line, '\n', (size_t)(end - line));
+        size_t length = (size_t)((next ? next : end) - line);
+
+        while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t'))
+        {
+            length--;
+        }
+
+        if (length > 0)
+        {
+            ret = eviSrecCheck(line, length);
+            if (ret != ERROR_EVI_OK)
+            {
+                goto cleanup;
+            }
+
+            memcpy(command, "S ", 2);
+            memcpy(command + 2, line, length);
+            command[length + 2] = '\0';
+
+            firmware->entries[firmware->count].command = command;
+            firmware->entries[firmware->count].execute = eviFwUpdate_;
+            firmware->entries[firmware->count].user = NULL;
+            firmware->entries[firmware->count].result = ERROR_EVI_OK;
+            firmware->count++;
+            command += length + 3;
+        }
+        line = next ? next + 1 : end;
     }
 
-    hComm = eviPortOpen(portNameBuffer);
-    hCommOpened = true;
+    ret = firmware->count > 0 ? ERROR_EVI_OK : ERROR_EVI_SREC_INVALID_STRING;
 
-    ret = eviCommandComm(self, hComm, "F", response);
-    if(ret != ERROR_EVI_OK)
+cleanup:
+    if (ret != ERROR_EVI_OK)
     {
-        goto cleanup;
+        eviFirmwareFree(firmware);
+    }
+    free(data);
+    fclose(f);
+    return ret;
+}
+
+// The USB serial number finds the device after the reboot, when it may be
+// back on another port. It is empty for a port that is no USB device.
+static void eviFwUpdateSerial(Evi_t * self, char * serial, size_t serialSize)
+{
+    char portName[1024];
+    EviDeviceInfo_t devices[EVI_MAX_DEVICES];
+    size_t count = 0;
+
+    serial[0] = '\0';
+    if (eviResolvePort(self, portName, sizeof(portName)) != ERROR_EVI_OK)
+    {
+        return;
+    }
+
+    eviEnumerateDevices(devices, EVI_MAX_DEVICES, &count, self->verbose);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(devices[i].portName, portName) == 0)
+        {
+            strcpy_s(serial, serialSize, devices[i].serial);
+            return;
+        }
     }
+}
+
+// Waits for the device to come back after the reboot. The port is looked up
+// by serial number, since the device may come back on a different port,
+// and the update is complete as soon as the device reports its version.
+static Error_t eviFwUpdateReady(Evi_t * self, const char * serial, uint32_t rebootTimeout)
+{
+    uint64_t deadline = eviTimeMs() + (rebootTimeout != 0 ? rebootTimeout : EVI_FWUPDATE_REBOOT_TIMEOUT);
+    char portName[1024];
+    char version[EVI_MAX_LINE_LENGTH];
+    Error_t ret;
+
+    eviSessionCloseUnlocked(self);
 
     do
     {
-        length = getlineInternal(&line, &n, f);
-        if(length != -1)
+        Sleep(EVI_FWUPDATE_POLL_INTERVAL);
+
+        eviInvalidateDeviceCache();
+        // another device on the old port must not pass for the updated one
+        if (serial[0] != '\0')
         {
-            snprintf(cmd, sizeof(cmd), "S %s", line);
-            ret = eviCommandComm(self, hComm, cmd, response);
-            if(ret != ERROR_EVI_OK)
+            if (eviFindDeviceBySerial(serial, portName, sizeof(portName), self->verbose) != ERROR_EVI_OK)
             {
-                goto cleanup;
+                continue;
+            }
+        }
+        else if (eviResolvePort(self, portName, sizeof(portName)) != ERROR_EVI_OK)
+        {
+            continue;
+        }
+
+        if (eviSessionOpenPort(self, portName) == ERROR_EVI_OK)
+        {
+            // a port that is back before the firmware answers must not block the whole timeout
+            uint32_t timeout = self->timeout;
+            self->timeout = EVI_FWUPDATE_POLL_INTERVAL * 2;
+            ret = eviGetUnlocked(self, INDEX_VERSION, version, sizeof(version));
+            self->timeout = timeout;
+            if (ret == ERROR_EVI_OK)
+            {
+                if (self->verbose)
+                {
+                    fprintf_s(stdout, "Firmware %s running on %s\n", version, portName);
+                }
+                return ERROR_EVI_OK;
             }
+            eviSessionCloseUnlocked(self);
         }
     }
-    while(length != -1 && ret == ERROR_EVI_OK);
+    while (eviTimeMs() < deadline);
 
-    ret = eviCommandComm(self, hComm, "R", response);
-    if(ret != ERROR_EVI_OK)
+    return ERROR_EVI_TIMEOUT;
+}
+
+Error_t eviFwUpdate(Evi_t * self, const char * file)
+{
+    return eviFwUpdateEx(self, file, NULL, NULL, 0);
+}
+
+Error_t eviFwUpdateEx(Evi_t * self, const char * file, EviProgress_t progress, void * user, uint32_t rebootTimeout)
+{
+    EviFirmware_t firmware;
+    EvieResponse_t response;
+    char serial[EVI_MAX_LINE_LENGTH] = {0};
+    bool wasOpen;
+    // the whole image is checked before the flash is erased
+    Error_t ret = eviFirmwareLoad(file, &firmware);
+
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+
+    // no other thread may talk to the device during the update
+    ret = eviLock(self);
+    if (ret != ERROR_EVI_OK)
+    {
+        eviFirmwareFree(&firmware);
+        return ret;
+    }
+    wasOpen = self->session.open;
+    ret = eviSessionOpenUnlocked(self);
+    if (ret != ERROR_EVI_OK)
     {
         goto cleanup;
     }
 
-    Sleep(30000);
+    // without a USB serial number the device is expected on the same port again
+    eviFwUpdateSerial(self, serial, sizeof(serial));
 
-cleanup:
-    free(line);
-    if(f != NULL)
+    ret = eviCommandComm(self, "F", &response);
+    if (ret == ERROR_EVI_OK)
+    {
+        ret = eviEvaluate(self, "F", &response, eviFwUpdate_, NULL);
+    }
+    if (ret != ERROR_EVI_OK)
+    {
+        goto cleanup;
+    }
+
+    ret = eviPipelineComm(self, firmware.entries, firmware.count, EVI_FWUPDATE_WINDOW, true, progress, user);
+    if (ret != ERROR_EVI_OK)
     {
-        fclose(f);
+        goto cleanup;
     }
-    if(response != NULL)
+
+    ret = eviCommandComm(self, "R", &response);
+    if (ret != ERROR_EVI_OK)
     {
-        eviFreeResponse(response);
+        goto cleanup;
     }
-    if(hCommOpened)
+
+    ret = eviFwUpdateReady(self, serial, rebootTimeout);
+
+cleanup:
+    eviFirmwareFree(&firmware);
+    // a session opened by the caller stays open on the restarted device
+    if (!wasOpen || ret != ERROR_EVI_OK)
     {
-        eviPortClose(hComm);
+        eviSessionCloseUnlocked(self);
     }
+    eviUnlock(self);
 
     return ret;
 }
@@ -48,6 +48,12 @@ extern void Sleep(uint32_t dwMilliseconds);
 #define EVI_CHECKSUM_SEPARATOR '@'
 #define EVI_STOP1 '\n'
 #define EVI_STOP2 '\r'
+#define EVI_DEFAULT_TIMEOUT 30000
+#define EVI_PIPELINE_WINDOW 8
+#define EVI_FWUPDATE_WINDOW 4
+#define EVI_LOGGING_BATCH 32
+#define EVI_FWUPDATE_REBOOT_TIMEOUT 60000
+#define EVI_FWUPDATE_POLL_INTERVAL 500
 
 /**
  * @struct EvieResponse_t
@@ -62,17 +68,41 @@ typedef struct
     char response[EVI_MAX_LINE_LENGTH]; /**< Response message. */    
 } EvieResponse_t;
 
+/**
+ * @struct EviSession_t
+ * @brief Represents an open connection to an Evi device.
+ *
+ * While a session is open, all commands reuse its port instead of opening
+ * and closing the port for every single command.
+ */
+typedef struct
+{
+    EVI_HANDLE handle; /**< Handle of the opened communication port. */
+    bool open; /**< Whether the session currently holds an open port. */
+    char rx[EVI_MAX_LINE_LENGTH]; /**< Received bytes not yet consumed by a response. */
+    size_t rxCount; /**< Number of valid bytes in rx. */
+    void * volatile lock; /**< EviMutex_t serializing the command/response pairs of all threads, created on first use. */
+} EviSession_t;
+
 /**
  * @struct Evi_t
  * @brief Represents an Evi device configuration.
  *
  * This structure stores configuration parameters for communicating with an Evi device.
+ *
+ * The functions of the library may be called from several threads with the
+ * same Evi_t: the command/response pairs of a device are serialized by a lock
+ * in its session, while different devices do not block each other. The
+ * configuration must not change while other threads use the device. Release
+ * a device shared by threads with eviSessionFree().
  */
 typedef struct
 {
     bool verbose; /**< Enables verbose output for debugging. */
     char *portName; /**< Name of the communication port. */
     bool useChecksum; /**< Whether to use checksum validation. */
+    uint32_t timeout; /**< Response timeout in milliseconds, 0 uses EVI_DEFAULT_TIMEOUT. */
+    EviSession_t session; /**< Session shared by all commands, see eviSessionOpen(). */
 } Evi_t;
 
 /**
@@ -85,6 +115,84 @@ typedef struct
  */
 DLLEXPORT Error_t eviFindDevice(char *portName, size_t *portNameSize, bool verbose);
 
+/**
+ * @brief Maximum number of devices reported by eviEnumerateDevices().
+ */
+#define EVI_MAX_DEVICES 16
+
+/**
+ * @struct EviDeviceInfo_t
+ * @brief A connected Evi device.
+ */
+typedef struct
+{
+    char portName[256]; /**< Name of the communication port, usable as Evi_t::portName. */
+    char serial[64];    /**< USB serial number, empty if the device reports none. */
+} EviDeviceInfo_t;
+
+/**
+ * @brief Finds all Evi devices connected to a port.
+ *
+ * Unlike eviFindDevice(), which returns the first device only, this reports
+ * every device with the Evi VID/PID together with its serial number.
+ *
+ * @param devices Array receiving the devices.
+ * @param maxDevices Number of elements of devices.
+ * @param count Receives the number of devices stored in devices.
+ * @param verbose Whether to enable verbose output.
+ * @return ERROR_EVI_OK, ERROR_EVI_INSTRUMENT_NOT_FOUND if no device is connected or ERROR_EVI_OUT_OF_MEMORY.
+ */
+DLLEXPORT Error_t eviEnumerateDevices(EviDeviceInfo_t *devices, size_t maxDevices, size_t *count, bool verbose);
+
+/**
+ * @brief Finds the Evi device with the given USB serial number.
+ *
+ * @param serial Serial number of the device.
+ * @param portName Buffer to store the port name.
+ * @param portNameSize Size of the port name buffer.
+ * @param verbose Whether to enable verbose output.
+ * @return ERROR_EVI_OK, or ERROR_EVI_INSTRUMENT_NOT_FOUND if no device has this serial number.
+ */
+DLLEXPORT Error_t eviFindDeviceBySerial(const char *serial, char *portName, size_t portNameSize, bool verbose);
+
+/**
+ * @brief Forgets the devices found by eviFindDevice().
+ *
+ * eviFindDevice() caches the discovered devices. The cache is dropped
+ * automatically when a port cannot be opened or, on Linux, when devices
+ * appear or disappear in /dev.
+ */
+DLLEXPORT void eviInvalidateDeviceCache(void);
+
+/**
+ * @brief Opens a session that keeps the port open across commands.
+ *
+ * Resolves the port like a single command would and keeps it open until
+ * eviSessionClose() is called. Calling it on an open session does nothing.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviSessionOpen(Evi_t *self);
+
+/**
+ * @brief Closes the session opened with eviSessionOpen().
+ *
+ * Following commands open and close the port on their own again.
+ *
+ * @param self Pointer to the Evi_t structure.
+ */
+DLLEXPORT void eviSessionClose(Evi_t *self);
+
+/**
+ * @brief Closes the session and frees the lock serializing the threads.
+ *
+ * Must only be called when no other thread uses the device anymore.
+ *
+ * @param self Pointer to the Evi_t structure.
+ */
+DLLEXPORT void eviSessionFree(Evi_t *self);
+
 /**
  * @brief Creates a new EvieResponse_t structure.
  * @see eviFreeResponse()
@@ -109,6 +217,40 @@ DLLEXPORT void eviFreeResponse(EvieResponse_t *response);
  */
 DLLEXPORT Error_t eviCommand(Evi_t *self, const char *command, EvieResponse_t *response);
 
+/**
+ * @brief Splits the received line of a response into its arguments.
+ *
+ * Arguments are separated by whitespace, quoted arguments may contain
+ * whitespace. The line in EvieResponse_t::response is terminated after each
+ * argument and EvieResponse_t::argv points into it.
+ *
+ * @param response Response with the received line, receives argc and argv.
+ */
+DLLEXPORT void eviResponseTokenize(EvieResponse_t *response);
+
+/**
+ * @brief Parses a decimal number into a uint32_t.
+ *
+ * Unlike atoi(), only digits are accepted: no sign, no whitespace, no
+ * trailing characters and no values above UINT32_MAX.
+ *
+ * @param s Null-terminated text to parse.
+ * @param value Receives the number.
+ * @return True if s is a valid number, otherwise false.
+ */
+DLLEXPORT bool eviParseUint32(const char *s, uint32_t *value);
+
+/**
+ * @brief Decodes the numeric arguments of a response.
+ *
+ * @param response Tokenized response.
+ * @param first Index of the first argument to decode, usually 1 to skip the command letter.
+ * @param count Number of arguments to decode; the response must have exactly first + count arguments.
+ * @param values Receives count numbers.
+ * @return ERROR_EVI_OK, or ERROR_EVI_PROTOCOL_ERROR if the argument count does not match or an argument is not a valid number.
+ */
+DLLEXPORT Error_t eviResponseGetUint32(const EvieResponse_t *response, uint32_t first, uint32_t count, uint32_t *values);
+
 /**
  * @brief Handles a command response without returning a value.
  *
@@ -129,6 +271,33 @@ Error_t eviNoReturn_(EvieResponse_t *response, void *user);
  */
 Error_t eviExecute(Evi_t * self, char * cmd, Error_t(execute)(EvieResponse_t *response, void *user), void *user);
 
+/**
+ * @struct EviPipelineEntry_t
+ * @brief One command of a pipelined sequence, see eviExecutePipelined().
+ */
+typedef struct
+{
+    const char *command; /**< The command to be executed. */
+    Error_t (*execute)(EvieResponse_t *response, void *user); /**< Handler for the response of this command. */
+    void *user; /**< User-defined data passed to the handler. */
+    Error_t result; /**< Result of this command, set by eviExecutePipelined(). */
+} EviPipelineEntry_t;
+
+/**
+ * @brief Executes several commands without waiting for each response.
+ *
+ * Up to EVI_PIPELINE_WINDOW commands are sent before the first response is
+ * read. The responses arrive in the order of the commands and are passed to
+ * the handler of the corresponding entry. If reading from the device fails,
+ * all remaining entries get that error.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param entries Commands to execute, in order.
+ * @param count Number of entries.
+ * @return The first error of any entry, or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviExecutePipelined(Evi_t *self, EviPipelineEntry_t *entries, size_t count);
+
 /**
  * @brief Retrieves a value from the Evi device.
  *
@@ -140,6 +309,18 @@ Error_t eviExecute(Evi_t * self, char * cmd, Error_t(execute)(EvieResponse_t *re
  */
 DLLEXPORT Error_t eviGet(Evi_t *self, uint32_t index, char *value, size_t valueSize);
 
+/**
+ * @brief Retrieves several values from the Evi device in one pipelined exchange.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param indices Indices of the values to retrieve.
+ * @param count Number of indices.
+ * @param values Buffer of count * valueSize bytes, value i is stored at values + i * valueSize.
+ * @param valueSize Size of a single value.
+ * @return The first error of any value, ERROR_EVI_OUT_OF_MEMORY, or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviGetPipelined(Evi_t *self, const uint32_t *indices, size_t count, char *values, size_t valueSize);
+
 /**
  * @brief Sets a value on the Evi device.
  *
@@ -152,6 +333,64 @@ DLLEXPORT Error_t eviSet(Evi_t *self, uint32_t index, const char *value);
 
 DLLEXPORT Error_t eviLogging(Evi_t *self, char *line, size_t length);
 
+/**
+ * @struct EviLogRing_t
+ * @brief Ring buffer of log lines filled by eviLoggingDrain().
+ *
+ * When the ring is full, a new line replaces the oldest one. A ring without
+ * storage of its own grows instead and only drops lines when out of memory.
+ */
+typedef struct
+{
+    char (*lines)[EVI_MAX_LINE_LENGTH]; /**< Storage for capacity lines, supplied by the caller or allocated by the drain. */
+    size_t capacity; /**< Number of lines the storage holds. */
+    size_t first; /**< Index of the oldest line in lines. */
+    size_t count; /**< Number of lines stored. */
+    size_t dropped; /**< Number of lines replaced or lost because the ring was full. */
+    bool grow; /**< Whether the drain allocates and grows lines, see eviLogRingFree(). */
+} EviLogRing_t;
+
+/**
+ * @brief Initializes an empty ring buffer.
+ *
+ * @param ring Ring buffer to initialize.
+ * @param lines Storage for capacity lines, or NULL for a ring that grows with the lines drained.
+ * @param capacity Number of lines, at least 1, or 0 with lines NULL.
+ */
+DLLEXPORT void eviLogRingInit(EviLogRing_t *ring, char (*lines)[EVI_MAX_LINE_LENGTH], size_t capacity);
+
+/**
+ * @brief Releases the storage of a growing ring buffer.
+ *
+ * @param ring Ring buffer initialized without storage, other rings are left unchanged.
+ */
+DLLEXPORT void eviLogRingFree(EviLogRing_t *ring);
+
+/**
+ * @brief Returns a line of a ring buffer.
+ *
+ * @param ring Ring buffer filled by eviLoggingDrain().
+ * @param index Index of the line, 0 is the oldest, less than EviLogRing_t::count.
+ * @return The line.
+ */
+DLLEXPORT const char *eviLogRingLine(const EviLogRing_t *ring, size_t index);
+
+/**
+ * @brief Reads all pending log lines of the device.
+ *
+ * The drain starts with a single `Q` command, so an empty log costs one round
+ * trip. While the device keeps returning lines, the `Q` commands are
+ * pipelined in batches growing with the number of lines read, up to
+ * EVI_LOGGING_BATCH, over one session until the device reports
+ * ERROR_EVI_NO_MORE_LOGGING, which ends the drain successfully.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param ring Receives the lines in the order of the device, may be NULL to discard them.
+ * @param drained Receives the number of lines read, may be NULL.
+ * @return ERROR_EVI_OK once the log is empty, otherwise the error of the exchange.
+ */
+DLLEXPORT Error_t eviLoggingDrain(Evi_t *self, EviLogRing_t *ring, size_t *drained);
+
 /**
  * @brief Performs a self-test on the Evi device.
  *
@@ -170,6 +409,37 @@ DLLEXPORT Error_t eviSelftest(Evi_t *self, uint32_t *result);
  */
 DLLEXPORT Error_t eviFwUpdate(Evi_t *self, const char *file);
 
+/**
+ * @brief Reports the progress of a long running operation.
+ *
+ * @param done Number of steps done.
+ * @param total Total number of steps.
+ * @param user User data passed with the callback.
+ */
+typedef void (*EviProgress_t)(size_t done, size_t total, void *user);
+
+/**
+ * @brief Performs a firmware update and reports its progress.
+ *
+ * The SREC file is read and every record is checked before the flash is
+ * erased. The records are then sent with up to EVI_FWUPDATE_WINDOW of them
+ * waiting for their acknowledgement. No record is sent after one has failed.
+ *
+ * After the reboot the device is looked up by the USB serial number of its
+ * port every EVI_FWUPDATE_POLL_INTERVAL milliseconds, and the update is
+ * complete as soon as it reports its firmware version. A port without a USB
+ * serial number, e.g., SIMULATION, is expected to come back unchanged. A session opened by the caller
+ * is open on the restarted device afterwards.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param file Path to the firmware update file.
+ * @param progress Called after each acknowledged record, may be NULL.
+ * @param user User data passed to progress.
+ * @param rebootTimeout Time in milliseconds the device may take to restart, 0 uses EVI_FWUPDATE_REBOOT_TIMEOUT.
+ * @return An error code indicating the result of the update process, ERROR_EVI_TIMEOUT if the device did not come back.
+ */
+DLLEXPORT Error_t eviFwUpdateEx(Evi_t *self, const char *file, EviProgress_t progress, void *user, uint32_t rebootTimeout);
+
 /**
  * @brief Converts an error code into a human-readable string.
  *
@@ -193,6 +463,14 @@ DLLEXPORT const char *eviVersion();
  */
 EVI_HANDLE eviPortOpen(char *portName);
 
+/**
+ * @brief Checks whether eviPortOpen() returned a usable handle.
+ *
+ * @param hComm Handle to the communication port.
+ * @return True if the port is open, otherwise false.
+ */
+bool eviPortIsValid(EVI_HANDLE hComm);
+
 /**
  * @brief Closes an open communication port.
  *
@@ -213,10 +491,285 @@ bool eviPortWrite(EVI_HANDLE hComm, char *buffer, bool verbose);
 /**
  * @brief Reads data from the communication port.
  *
+ * Returns as soon as any data is available, without waiting for a complete
+ * response line.
+ *
  * @param hComm Handle to the communication port.
  * @param buffer Buffer to store the received data.
  * @param size Maximum number of bytes to read.
+ * @param timeout Maximum time to wait for data in milliseconds.
  * @param verbose Whether to enable verbose output.
- * @return The number of bytes read from the port.
+ * @return The number of bytes read, 0 on timeout or -1 if the port failed.
+ */
+int32_t eviPortRead(EVI_HANDLE hComm, char *buffer, size_t size, uint32_t timeout, bool verbose);
+
+/**
+ * @brief Returns a monotonic time stamp.
+ *
+ * @return Milliseconds since an arbitrary but fixed point in time.
+ */
+uint64_t eviTimeMs(void);
+
+/**
+ * @brief Returns a monotonic time stamp with a finer resolution.
+ *
+ * @return Microseconds since an arbitrary but fixed point in time.
+ */
+uint64_t eviTimeUs(void);
+
+/**
+ * @struct EviFileMapping_t
+ * @brief Read-only memory mapping of a whole file.
+ */
+typedef struct
+{
+    const void * data; /**< Start of the mapped file, NULL for an empty file. */
+    size_t size;       /**< Size of the file in bytes. */
+    void * handle;     /**< Platform-specific mapping handle. */
+} EviFileMapping_t;
+
+/**
+ * @brief Maps a file read-only into memory.
+ *
+ * @param file Path of the file.
+ * @param mapping Receives the mapping, release it with eviFileUnmap().
+ * @return ERROR_EVI_OK, ERROR_EVI_FILE_NOT_FOUND if the file cannot be opened or ERROR_EVI_FILE_IO_ERROR if it cannot be mapped.
+ */
+DLLEXPORT Error_t eviFileMap(const char * file, EviFileMapping_t * mapping);
+
+/**
+ * @brief Releases a mapping created by eviFileMap().
+ *
+ * @param mapping Mapping to release.
+ */
+DLLEXPORT void eviFileUnmap(EviFileMapping_t * mapping);
+
+/**
+ * @brief Replaces a file by another one, e.g., a completely written temporary file.
+ *
+ * Readers see either the old or the new content of to, never a partial file.
+ *
+ * @param from Path of the file to move.
+ * @param to Path of the file to replace, created if it does not exist.
+ * @return True if to was replaced, otherwise false and both files are unchanged.
+ */
+DLLEXPORT bool eviReplaceFile(const char * from, const char * to);
+
+/**
+ * @brief A thread started by eviThreadStart().
+ */
+typedef struct EviThread EviThread_t;
+
+/**
+ * @brief A mutex created by eviMutexCreate().
+ */
+typedef struct EviMutex EviMutex_t;
+
+/**
+ * @brief A condition variable created by eviConditionCreate().
+ */
+typedef struct EviCondition EviCondition_t;
+
+/**
+ * @brief Starts a thread.
+ *
+ * @param function Function executed by the thread.
+ * @param argument Argument passed to function.
+ * @return The thread, or NULL if it could not be started.
+ */
+EviThread_t * eviThreadStart(void (*function)(void *argument), void * argument);
+
+/**
+ * @brief Waits for a thread to finish and releases it.
+ *
+ * @param thread Thread started by eviThreadStart().
+ */
+void eviThreadJoin(EviThread_t * thread);
+
+/**
+ * @brief Creates a mutex.
+ *
+ * @return The mutex, or NULL if out of memory.
+ */
+EviMutex_t * eviMutexCreate(void);
+
+/**
+ * @brief Returns the mutex stored in lock and creates it on first use.
+ *
+ * Several threads may call it at the same time, all of them get the same mutex.
+ *
+ * @param lock Location of the mutex, initially NULL.
+ * @return The mutex, or NULL if out of memory.
+ */
+EviMutex_t * eviMutexCreateOnce(void * volatile * lock);
+
+/**
+ * @brief Locks a mutex.
+ *
+ * @param mutex Mutex created by eviMutexCreate().
+ */
+void eviMutexLock(EviMutex_t * mutex);
+
+/**
+ * @brief Unlocks a mutex.
+ *
+ * @param mutex Mutex locked by the calling thread.
+ */
+void eviMutexUnlock(EviMutex_t * mutex);
+
+/**
+ * @brief Destroys a mutex.
+ *
+ * @param mutex Unlocked mutex created by eviMutexCreate(), may be NULL.
+ */
+void eviMutexDestroy(EviMutex_t * mutex);
+
+/**
+ * @brief Creates a condition variable.
+ *
+ * @return The condition variable, or NULL if out of memory.
+ */
+EviCondition_t * eviConditionCreate(void);
+
+/**
+ * @brief Waits until the condition variable is signalled.
+ *
+ * @param condition Condition variable created by eviConditionCreate().
+ * @param mutex Mutex locked by the calling thread, unlocked while waiting.
+ */
+void eviConditionWait(EviCondition_t * condition, EviMutex_t * mutex);
+
+/**
+ * @brief Wakes up all threads waiting on a condition variable.
+ *
+ * @param condition Condition variable created by eviConditionCreate().
+ */
+void eviConditionBroadcast(EviCondition_t * condition);
+
+/**
+ * @brief Destroys a condition variable.
+ *
+ * @param condition Condition variable without waiting threads, may be NULL.
+ */
+void eviConditionDestroy(EviCondition_t * condition);
+
+/**
+ * @brief A wake-up signal created by eviSignalCreate().
+ */
+typedef struct EviSignal EviSignal_t;
+
+/**
+ * @brief Creates a signal that an event loop can wait for.
+ *
+ * @return The signal, or NULL if it could not be created.
+ */
+EviSignal_t * eviSignalCreate(void);
+
+/**
+ * @brief Raises a signal, may be called by any thread.
+ *
+ * @param signal Signal created by eviSignalCreate().
+ */
+void eviSignalRaise(EviSignal_t * signal);
+
+/**
+ * @brief Resets a raised signal.
+ *
+ * @param signal Signal created by eviSignalCreate().
+ */
+void eviSignalClear(EviSignal_t * signal);
+
+/**
+ * @brief Returns the handle to wait for.
+ *
+ * @param signal Signal created by eviSignalCreate().
+ * @return A file descriptor readable while the signal is raised, or on Windows an event HANDLE.
+ */
+intptr_t eviSignalHandle(const EviSignal_t * signal);
+
+/**
+ * @brief Destroys a signal.
+ *
+ * @param signal Signal created by eviSignalCreate(), may be NULL.
+ */
+void eviSignalDestroy(EviSignal_t * signal);
+
+/**
+ * @brief Atomically replaces a pointer.
+ *
+ * All atomic functions are sequentially consistent.
+ *
+ * @param target Pointer to replace.
+ * @param value New value.
+ * @return The previous value.
+ */
+void * eviAtomicExchangePointer(void * volatile * target, void * value);
+
+/**
+ * @brief Atomically replaces a pointer if it has the expected value.
+ *
+ * @param target Pointer to replace.
+ * @param expected Value target must have.
+ * @param value New value.
+ * @return The previous value, equal to expected if target was replaced.
+ */
+void * eviAtomicCompareExchangePointer(void * volatile * target, void * expected, void * value);
+
+/**
+ * @brief Atomically reads a pointer.
+ *
+ * @param target Pointer to read.
+ * @return The value.
+ */
+void * eviAtomicLoadPointer(void * volatile * target);
+
+/**
+ * @brief Atomically writes a pointer.
+ *
+ * @param target Pointer to write.
+ * @param value New value.
+ */
+void eviAtomicStorePointer(void * volatile * target, void * value);
+
+/**
+ * @brief Atomically adds to a counter.
+ *
+ * @param target Counter to change.
+ * @param value Value to add, may be negative.
+ * @return The new value.
+ */
+int32_t eviAtomicAdd(volatile int32_t * target, int32_t value);
+
+/**
+ * @brief Atomically reads a counter or flag.
+ *
+ * @param target Value to read.
+ * @return The value.
+ */
+int32_t eviAtomicLoad(volatile int32_t * target);
+
+/**
+ * @brief Atomically writes a counter or flag.
+ *
+ * @param target Value to write.
+ * @param value New value.
+ */
+void eviAtomicStore(volatile int32_t * target, int32_t value);
+
+/**
+ * @brief Copies memory with relaxed atomic loads and stores of 32-bit words.
+ *
+ * Unlike the other atomic functions, the copy is not ordered against other
+ * memory accesses, see eviAtomicFence(). It is meant for data guarded by a
+ * sequence number, which may be read while it is written.
+ *
+ * @param destination Destination, aligned to 4 bytes.
+ * @param source Source, aligned to 4 bytes.
+ * @param size Number of bytes, a multiple of 4.
+ */
+void eviAtomicCopy(volatile void * destination, const volatile void * source, size_t size);
+
+/**
+ * @brief Keeps memory accesses from moving across the fence in either direction.
  */
-uint32_t eviPortRead(EVI_HANDLE hComm, char *buffer, size_t size, bool verbose);
+void eviAtomicFence(void);
@@ -3,7 +3,6 @@
 
 #include "evidense.h"
 #include <stdio.h>
-#include <stdlib.h>
 
 typedef struct
 {
@@ -19,25 +18,37 @@ typedef struct
     Levelling_t * levelling340;
 } UserLevelling;
 
-Error_t eviDenseMeasure_(EvieResponse_t *response, void *user)
+static Error_t eviDenseDecodeMeasurement(const EvieResponse_t *response, SingleMeasurement_t * measurement)
 {
-    UserMeasurement *u = (UserMeasurement *)user;
-    if (response->argc == 9)
-    {
-        u->measurement->channel230.sample    = atoi(response->argv[1]);
-        u->measurement->channel230.reference = atoi(response->argv[2]);
-        u->measurement->channel260.sample    = atoi(response->argv[3]);
-        u->measurement->channel260.reference = atoi(response->argv[4]);
-        u->measurement->channel280.sample    = atoi(response->argv[5]);
-        u->measurement->channel280.reference = atoi(response->argv[6]);
-        u->measurement->channel340.sample    = atoi(response->argv[7]);
-        u->measurement->channel340.reference = atoi(response->argv[8]);
-        return ERROR_EVI_OK;
-    }
-    else
+    uint32_t values[8];
+    Error_t error = eviResponseGetUint32(response, 1, 8, values);
+
+    if (error == ERROR_EVI_OK)
     {
-        return ERROR_EVI_PROTOCOL_ERROR;
+        measurement->channel230.sample    = values[0];
+        measurement->channel230.reference = values[1];
+        measurement->channel260.sample    = values[2];
+        measurement->channel260.reference = values[3];
+        measurement->channel280.sample    = values[4];
+        measurement->channel280.reference = values[5];
+        measurement->channel340.sample    = values[6];
+        measurement->channel340.reference = values[7];
     }
+    return error;
+}
+
+static void eviDenseDecodeLevelling(const uint32_t * values, Levelling_t * levelling)
+{
+    levelling->result                 = values[0];
+    levelling->current                = values[1];
+    levelling->amplificationSample    = values[2];
+    levelling->amplificationReference = values[3];
+}
+
+Error_t eviDenseMeasure_(EvieResponse_t *response, void *user)
+{
+    UserMeasurement *u = (UserMeasurement *)user;
+    return eviDenseDecodeMeasurement(response, u->measurement);
 }
 
 Error_t eviDenseMeasure(Evi_t * self, SingleMeasurement_t * measurement)
@@ -54,37 +65,43 @@ Error_t eviDenseLastMeasurements(Evi_t * self, uint32_t last, SingleMeasurement_
     return eviExecute(self, cmd, eviDenseMeasure_, &user);
 }
 
-Error_t eviDenseLevelling_(EvieResponse_t *response, void *user)
+Error_t eviDenseLastMeasurementsBatch(Evi_t * self, uint32_t first, uint32_t count, SingleMeasurement_t * measurements)
 {
-    UserLevelling *u = (UserLevelling *)user;
-    if (response->argc == 17)
+    EviPipelineEntry_t entries[EVI_DENSE_MAX_LAST_MEASUREMENTS];
+    UserMeasurement users[EVI_DENSE_MAX_LAST_MEASUREMENTS];
+    char cmds[EVI_DENSE_MAX_LAST_MEASUREMENTS][20];
+
+    if (first > EVI_DENSE_MAX_LAST_MEASUREMENTS || count > EVI_DENSE_MAX_LAST_MEASUREMENTS - first)
     {
-        u->levelling230->result                 = atoi(response->argv[1]);
-        u->levelling230->current                = atoi(response->argv[2]);
-        u->levelling230->amplificationSample    = atoi(response->argv[3]);
-        u->levelling230->amplificationReference = atoi(response->argv[4]);
-
-        u->levelling260->result                 = atoi(response->argv[5]);
-        u->levelling260->current                = atoi(response->argv[6]);
-        u->levelling260->amplificationSample    = atoi(response->argv[7]);
-        u->levelling260->amplificationReference = atoi(response->argv[8]);
-
-        u->levelling280->result                 = atoi(response->argv[9]);
-        u->levelling280->current                = atoi(response->argv[10]);
-        u->levelling280->amplificationSample    = atoi(response->argv[11]);
-        u->levelling280->amplificationReference = atoi(response->argv[12]);
-
-        u->levelling340->result                 = atoi(response->argv[13]);
-        u->levelling340->current                = atoi(response->argv[14]);
-        u->levelling340->amplificationSample    = atoi(response->argv[15]);
-        u->levelling340->amplificationReference = atoi(response->argv[16]);
-
-        return ERROR_EVI_OK;
+        return ERROR_EVI_INVALID_PARAMETER;
     }
-    else
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        sprintf_s(cmds[i], sizeof(cmds[i]), "M %u", first + i);
+        users[i].measurement = &measurements[i];
+        entries[i].command = cmds[i];
+        entries[i].execute = eviDenseMeasure_;
+        entries[i].user = &users[i];
+    }
+
+    return eviExecutePipelined(self, entries, count);
+}
+
+Error_t eviDenseLevelling_(EvieResponse_t *response, void *user)
+{
+    UserLevelling *u = (UserLevelling *)user;
+    uint32_t values[16];
+    Error_t error = eviResponseGetUint32(response, 1, 16, values);
+
+    if (error == ERROR_EVI_OK)
     {
-        return ERROR_EVI_PROTOCOL_ERROR;
+        eviDenseDecodeLevelling(&values[0], u->levelling230);
+        eviDenseDecodeLevelling(&values[4], u->levelling260);
+        eviDenseDecodeLevelling(&values[8], u->levelling280);
+        eviDenseDecodeLevelling(&values[12], u->levelling340);
     }
+    return error;
 }
 
 Error_t eviDenseLevelling(Evi_t * self, Levelling_t * levelling230, Levelling_t * levelling260, Levelling_t * levelling280, Levelling_t * levelling340)
@@ -102,22 +119,7 @@ Error_t eviDenseLastLevelling(Evi_t * self, Levelling_t * levelling230, Levellin
 Error_t eviDenseBaseline_(EvieResponse_t *response, void *user)
 {
     UserMeasurement *u = (UserMeasurement *)user;
-    if (response->argc == 9)
-    {
-        u->measurement->channel230.sample    = atoi(response->argv[1]);
-        u->measurement->channel230.reference = atoi(response->argv[2]);
-        u->measurement->channel260.sample    = atoi(response->argv[3]);
-        u->measurement->channel260.reference = atoi(response->argv[4]);
-        u->measurement->channel280.sample    = atoi(response->argv[5]);
-        u->measurement->channel280.reference = atoi(response->argv[6]);
-        u->measurement->channel340.sample    = atoi(response->argv[7]);
-        u->measurement->channel340.reference = atoi(response->argv[8]);
-        return ERROR_EVI_OK;
-    }
-    else
-    {
-        return ERROR_EVI_PROTOCOL_ERROR;
-    }
+    return eviDenseDecodeMeasurement(response, u->measurement);
 }
 
 Error_t eviDenseBaseline(Evi_t * self, SingleMeasurement_t * measurement)
@@ -126,6 +128,22 @@ Error_t eviDenseBaseline(Evi_t * self, SingleMeasurement_t * measurement)
     return eviExecute(self, "G", eviDenseBaseline_, &user);
 }
 
+static Error_t eviDenseMeasureAsync_(EvieResponse_t *response, void *user)
+{
+    // the caller's measurement outlives the command, unlike a UserMeasurement on the stack
+    return eviDenseDecodeMeasurement(response, (SingleMeasurement_t *)user);
+}
+
+Error_t eviDenseMeasureAsync(EviAsync_t * async, Evi_t * self, SingleMeasurement_t * measurement, EviCompletion_t completion, void * user)
+{
+    return eviExecuteAsync(async, self, "M", eviDenseMeasureAsync_, measurement, completion, user);
+}
+
+Error_t eviDenseBaselineAsync(EviAsync_t * async, Evi_t * self, SingleMeasurement_t * measurement, EviCompletion_t completion, void * user)
+{
+    return eviExecuteAsync(async, self, "G", eviDenseMeasureAsync_, measurement, completion, user);
+}
+
 typedef struct
 {
     bool * empty;
@@ -134,15 +152,14 @@ typedef struct
 Error_t eviDenseIsCuvetteHolderEmpty_(EvieResponse_t *response, void *user)
 {
     UserEmpty *u = (UserEmpty *)user;
-    if (response->argc >= 2)
-    {
-        (*u->empty) = atoi(response->argv[1]);
-        return ERROR_EVI_OK;
-    }
-    else
+    uint32_t value;
+    Error_t error = eviResponseGetUint32(response, 1, 1, &value);
+
+    if (error == ERROR_EVI_OK)
     {
-        return ERROR_EVI_PROTOCOL_ERROR;
+        (*u->empty) = value != 0;
     }
+    return error;
 }
 
 Error_t eviDenseIsCuvetteHolderEmpty(Evi_t * self, bool * empty)
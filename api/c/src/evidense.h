@@ -6,6 +6,7 @@
 #include "evibase.h"
 #include "commonerror.h"
 #include "singlemeasurement.h"
+#include "eviasync.h"
 
 /**
  * @struct Levelling_t
@@ -81,6 +82,30 @@ DLLEXPORT Error_t eviDenseMeasure(Evi_t *self, SingleMeasurement_t * measurement
  */
 DLLEXPORT Error_t eviDenseBaseline(Evi_t *self, SingleMeasurement_t * measurement);
 
+/**
+ * @brief Queues a dense fluorescence measurement and returns immediately.
+ *
+ * @param async Context created by eviAsyncCreate().
+ * @param self Pointer to the Evi_t structure.
+ * @param measurement Receives the measurement result, must stay valid until the completion has run.
+ * @param completion Called by eviAsyncDispatch() when the measurement has finished.
+ * @param user User data passed to completion.
+ * @return An error code indicating whether the measurement was queued.
+ */
+DLLEXPORT Error_t eviDenseMeasureAsync(EviAsync_t *async, Evi_t *self, SingleMeasurement_t * measurement, EviCompletion_t completion, void *user);
+
+/**
+ * @brief Queues a baseline dense fluorescence measurement and returns immediately.
+ *
+ * @param async Context created by eviAsyncCreate().
+ * @param self Pointer to the Evi_t structure.
+ * @param measurement Receives the baseline measurement, must stay valid until the completion has run.
+ * @param completion Called by eviAsyncDispatch() when the measurement has finished.
+ * @param user User data passed to completion.
+ * @return An error code indicating whether the measurement was queued.
+ */
+DLLEXPORT Error_t eviDenseBaselineAsync(EviAsync_t *async, Evi_t *self, SingleMeasurement_t * measurement, EviCompletion_t completion, void *user);
+
 /**
  * @brief Performs the levelling process for dense fluorescence measurements.
  *
@@ -103,6 +128,25 @@ DLLEXPORT Error_t eviDenseLevelling(Evi_t *self, Levelling_t *levelling230, Leve
  */
 DLLEXPORT Error_t eviDenseLastMeasurements(Evi_t *self, uint32_t last, SingleMeasurement_t * measurement);
 
+/**
+ * @brief Maximum number of measurements stored in the device.
+ */
+#define EVI_DENSE_MAX_LAST_MEASUREMENTS 10
+
+/**
+ * @brief Retrieves several of the last recorded measurements in one pipelined exchange.
+ *
+ * measurements[i] receives the measurement at index first + i, where index 0
+ * is the last measurement.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param first Index of the first measurement to retrieve.
+ * @param count Number of measurements to retrieve.
+ * @param measurements Array of at least count SingleMeasurement_t structures.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviDenseLastMeasurementsBatch(Evi_t *self, uint32_t first, uint32_t count, SingleMeasurement_t * measurements);
+
 /**
  * @brief Retrieves the last levelling results for fluorescence measurements.
  *
@@ -0,0 +1,357 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evimanager.h"
+#include <stdlib.h>
+
+// Lock-free queue with many producers and a single consumer: producers append
+// by exchanging tail, the consumer takes nodes from head, which always points
+// to an already consumed node or the initial stub.
+
+void eviQueueInit(EviQueue_t * queue)
+{
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+void eviQueuePush(EviQueue_t * queue, EviQueueNode_t * node)
+{
+    EviQueueNode_t * previous;
+
+    eviAtomicStorePointer(&node->next, NULL);
+    previous = eviAtomicExchangePointer(&queue->tail, node);
+    // until this store the consumer sees the queue as empty
+    eviAtomicStorePointer(&previous->next, node);
+}
+
+EviQueueNode_t * eviQueuePop(EviQueue_t * queue)
+{
+    EviQueueNode_t * head = queue->head;
+    EviQueueNode_t * next = eviAtomicLoadPointer(&head->next);
+
+    if (next == NULL)
+    {
+        return NULL;
+    }
+
+    queue->head = next;
+    if (head != &queue->stub)
+    {
+        free(head);
+    }
+    return next;
+}
+
+void eviQueueClear(EviQueue_t * queue)
+{
+    while (eviQueuePop(queue) != NULL)
+    {
+    }
+    if (queue->head != &queue->stub)
+    {
+        free(queue->head);
+    }
+    eviQueueInit(queue);
+}
+
+typedef struct
+{
+    EviQueueNode_t node; // first member, the queue frees jobs
+    EviJob_t job;
+    void * user;
+} EviWorkerJob_t;
+
+// The mutex is only taken to put the worker to sleep, to wake it up and to
+// report finished jobs.
+struct EviWorker
+{
+    Evi_t * evi;
+    EviThread_t * thread;
+    EviMutex_t * mutex;
+    EviCondition_t * changed;  // a job was queued or finished, or the worker has to stop
+    EviQueue_t queue;
+    volatile int32_t idle;     // the worker waits for jobs
+    volatile int32_t pending;  // queued jobs plus the one running
+    Error_t error;             // first error since the last eviWorkerWait()
+    bool stop;
+};
+
+static void eviWorkerMain(void * argument)
+{
+    EviWorker_t * worker = argument;
+
+    for (;;)
+    {
+        EviWorkerJob_t * job = (EviWorkerJob_t *)eviQueuePop(&worker->queue);
+        Error_t ret;
+
+        if (job == NULL)
+        {
+            // producers wake the worker only if they see it idle
+            eviMutexLock(worker->mutex);
+            eviAtomicStore(&worker->idle, 1);
+            while ((job = (EviWorkerJob_t *)eviQueuePop(&worker->queue)) == NULL && !worker->stop)
+            {
+                eviConditionWait(worker->changed, worker->mutex);
+            }
+            eviAtomicStore(&worker->idle, 0);
+            eviMutexUnlock(worker->mutex);
+
+            if (job == NULL)
+            {
+                break;
+            }
+        }
+
+        ret = job->job(worker->evi, job->user);
+
+        eviMutexLock(worker->mutex);
+        if (worker->error == ERROR_EVI_OK)
+        {
+            worker->error = ret;
+        }
+        eviAtomicAdd(&worker->pending, -1);
+        eviConditionBroadcast(worker->changed);
+        eviMutexUnlock(worker->mutex);
+    }
+
+    eviQueueClear(&worker->queue);
+}
+
+EviWorker_t * eviWorkerStart(Evi_t * evi)
+{
+    EviWorker_t * worker = calloc(1, sizeof(*worker));
+
+    if (worker == NULL)
+    {
+        return NULL;
+    }
+
+    worker->evi = evi;
+    eviQueueInit(&worker->queue);
+    worker->mutex = eviMutexCreate();
+    worker->changed = eviConditionCreate();
+    if (worker->mutex != NULL && worker->changed != NULL)
+    {
+        worker->thread = eviThreadStart(eviWorkerMain, worker);
+    }
+
+    if (worker->thread == NULL)
+    {
+        eviConditionDestroy(worker->changed);
+        eviMutexDestroy(worker->mutex);
+        free(worker);
+        return NULL;
+    }
+    return worker;
+}
+
+static void eviWorkerRequestStop(EviWorker_t * worker)
+{
+    eviMutexLock(worker->mutex);
+    worker->stop = true;
+    eviConditionBroadcast(worker->changed);
+    eviMutexUnlock(worker->mutex);
+}
+
+static void eviWorkerJoin(EviWorker_t * worker)
+{
+    eviThreadJoin(worker->thread);
+    eviConditionDestroy(worker->changed);
+    eviMutexDestroy(worker->mutex);
+    free(worker);
+}
+
+void eviWorkerStop(EviWorker_t * worker)
+{
+    if (worker)
+    {
+        eviWorkerRequestStop(worker);
+        eviWorkerJoin(worker);
+    }
+}
+
+Error_t eviWorkerSubmit(EviWorker_t * worker, EviJob_t job, void * user)
+{
+    EviWorkerJob_t * entry = malloc(sizeof(*entry));
+
+    if (entry == NULL)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+    entry->job = job;
+    entry->user = user;
+
+    eviAtomicAdd(&worker->pending, 1);
+    eviQueuePush(&worker->queue, &entry->node);
+    if (eviAtomicLoad(&worker->idle))
+    {
+        eviMutexLock(worker->mutex);
+        eviConditionBroadcast(worker->changed);
+        eviMutexUnlock(worker->mutex);
+    }
+    return ERROR_EVI_OK;
+}
+
+Error_t eviWorkerWait(EviWorker_t * worker)
+{
+    Error_t ret;
+
+    eviMutexLock(worker->mutex);
+    while (eviAtomicLoad(&worker->pending) > 0)
+    {
+        eviConditionWait(worker->changed, worker->mutex);
+    }
+    ret = worker->error;
+    worker->error = ERROR_EVI_OK;
+    eviMutexUnlock(worker->mutex);
+
+    return ret;
+}
+
+typedef struct
+{
+    EviDeviceInfo_t info;
+    Evi_t evi;
+    EviWorker_t * worker;
+} EviManagerDevice_t;
+
+struct EviManager
+{
+    EviManagerDevice_t * devices;
+    size_t count;
+};
+
+static Error_t eviManagerOpenSession(Evi_t * self, void * user)
+{
+    (void)user;
+    // a device that cannot be opened now is opened again by its first command
+    eviSessionOpen(self);
+    return ERROR_EVI_OK;
+}
+
+Error_t eviManagerOpen(EviManager_t **manager, const Evi_t *settings, const EviDeviceInfo_t *devices, size_t count)
+{
+    EviManager_t * self = NULL;
+
+    *manager = NULL;
+    if (count == 0)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+
+    self = calloc(1, sizeof(*self));
+    if (self == NULL)
+    {
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+    self->devices = calloc(count, sizeof(*self->devices));
+    if (self->devices == NULL)
+    {
+        free(self);
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        EviManagerDevice_t * device = &self->devices[i];
+
+        device->info = devices[i];
+        device->evi.verbose = settings->verbose;
+        device->evi.useChecksum = settings->useChecksum;
+        device->evi.timeout = settings->timeout;
+        device->evi.portName = device->info.portName;
+        device->worker = eviWorkerStart(&device->evi);
+        if (device->worker == NULL)
+        {
+            eviManagerClose(self);
+            return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+        }
+        self->count++;
+
+        // all ports are opened at the same time
+        eviWorkerSubmit(device->worker, eviManagerOpenSession, NULL);
+    }
+
+    *manager = self;
+    return ERROR_EVI_OK;
+}
+
+void eviManagerClose(EviManager_t *manager)
+{
+    if (manager == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < manager->count; i++)
+    {
+        eviWorkerRequestStop(manager->devices[i].worker);
+    }
+
+    for (size_t i = 0; i < manager->count; i++)
+    {
+        eviWorkerJoin(manager->devices[i].worker);
+        eviSessionFree(&manager->devices[i].evi);
+    }
+
+    free(manager->devices);
+    free(manager);
+}
+
+size_t eviManagerCount(const EviManager_t *manager)
+{
+    return manager->count;
+}
+
+const EviDeviceInfo_t *eviManagerDeviceInfo(const EviManager_t *manager, size_t index)
+{
+    return &manager->devices[index].info;
+}
+
+Error_t eviManagerSubmit(EviManager_t *manager, size_t index, EviJob_t job, void *user)
+{
+    if (index >= manager->count)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+    return eviWorkerSubmit(manager->devices[index].worker, job, user);
+}
+
+Error_t eviManagerWait(EviManager_t *manager, size_t index)
+{
+    if (index >= manager->count)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+    return eviWorkerWait(manager->devices[index].worker);
+}
+
+Error_t eviManagerRunAll(EviManager_t *manager, EviJob_t job, void * const *users, Error_t *results)
+{
+    Error_t ret = ERROR_EVI_OK;
+
+    for (size_t i = 0; i < manager->count; i++)
+    {
+        Error_t error = eviManagerSubmit(manager, i, job, users ? users[i] : NULL);
+        if (results)
+        {
+            results[i] = error;
+        }
+    }
+
+    for (size_t i = 0; i < manager->count; i++)
+    {
+        Error_t error = eviManagerWait(manager, i);
+        if (results && results[i] == ERROR_EVI_OK)
+        {
+            results[i] = error;
+        }
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = results ? results[i] : error;
+        }
+    }
+    return ret;
+}
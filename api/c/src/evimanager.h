@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * Multi-device manager
+ *
+ * The manager opens a session for each of several devices and runs a worker
+ * thread per device. Jobs submitted for a device are executed in order by its
+ * worker, jobs of different devices run concurrently. A job must only use the
+ * Evi_t it is called with.
+ */
+
+/**
+ * @brief A job executed by the worker of a device.
+ *
+ * @param self The device the job is executed on.
+ * @param user User data passed to eviManagerSubmit().
+ * @return Error code of the job.
+ */
+typedef Error_t (*EviJob_t)(Evi_t *self, void *user);
+
+/**
+ * @brief A manager created by eviManagerOpen().
+ */
+typedef struct EviManager EviManager_t;
+
+/**
+ * @brief Opens the given devices and starts a worker thread for each.
+ *
+ * @param manager Receives the manager, close it with eviManagerClose().
+ * @param settings Settings used for all devices: verbose, useChecksum and timeout. Evi_t::portName is ignored.
+ * @param devices Devices to open, e.g., found by eviEnumerateDevices().
+ * @param count Number of devices.
+ * @return ERROR_EVI_OK, ERROR_EVI_INVALID_PARAMETER if count is 0, ERROR_EVI_OUT_OF_MEMORY or ERROR_EVI_INSTRUMENT_NOT_FOUND if a worker could not be started.
+ */
+DLLEXPORT Error_t eviManagerOpen(EviManager_t **manager, const Evi_t *settings, const EviDeviceInfo_t *devices, size_t count);
+
+/**
+ * @brief Stops all workers after their queued jobs and closes the devices.
+ *
+ * @param manager Manager created by eviManagerOpen(), may be NULL.
+ */
+DLLEXPORT void eviManagerClose(EviManager_t *manager);
+
+/**
+ * @brief Returns the number of devices of a manager.
+ *
+ * @param manager Manager created by eviManagerOpen().
+ * @return Number of devices.
+ */
+DLLEXPORT size_t eviManagerCount(const EviManager_t *manager);
+
+/**
+ * @brief Returns the port and serial number of a device.
+ *
+ * @param manager Manager created by eviManagerOpen().
+ * @param index Index of the device, less than eviManagerCount().
+ * @return The device.
+ */
+DLLEXPORT const EviDeviceInfo_t *eviManagerDeviceInfo(const EviManager_t *manager, size_t index);
+
+/**
+ * @brief Queues a job for a device and returns immediately.
+ *
+ * @param manager Manager created by eviManagerOpen().
+ * @param index Index of the device.
+ * @param job Job to execute.
+ * @param user User data passed to the job.
+ * @return ERROR_EVI_OK, or ERROR_EVI_INVALID_PARAMETER for an invalid index.
+ */
+DLLEXPORT Error_t eviManagerSubmit(EviManager_t *manager, size_t index, EviJob_t job, void *user);
+
+/**
+ * @brief Waits until all jobs queued for a device are done.
+ *
+ * @param manager Manager created by eviManagerOpen().
+ * @param index Index of the device.
+ * @return The first error of the jobs finished since the last wait, or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviManagerWait(EviManager_t *manager, size_t index);
+
+/**
+ * @brief Executes a job on every device concurrently and waits for all of them.
+ *
+ * @param manager Manager created by eviManagerOpen().
+ * @param job Job to execute.
+ * @param users User data per device, may be NULL to pass NULL to every job.
+ * @param results Receives the error code per device, may be NULL.
+ * @return The first error of all devices, or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviManagerRunAll(EviManager_t *manager, EviJob_t job, void * const *users, Error_t *results);
+
+/**
+ * @brief Node of an EviQueue_t, the first member of every queued entry.
+ */
+typedef struct EviQueueNode
+{
+    void * volatile next; /**< Next node, written by producers. */
+} EviQueueNode_t;
+
+/**
+ * @struct EviQueue_t
+ * @brief Lock-free queue with many producers and a single consumer.
+ *
+ * Nodes are allocated with malloc() by the producers and freed by the queue.
+ */
+typedef struct
+{
+    EviQueueNode_t stub;   /**< Initial node, the queue must not be moved. */
+    EviQueueNode_t * head; /**< Last consumed node, owned by the consumer. */
+    void * volatile tail;  /**< Last queued node. */
+} EviQueue_t;
+
+/**
+ * @brief Initializes an empty queue.
+ *
+ * @param queue Queue to initialize.
+ */
+void eviQueueInit(EviQueue_t * queue);
+
+/**
+ * @brief Appends a node, may be called by any thread.
+ *
+ * @param queue Queue to append to.
+ * @param node Node allocated with malloc(), owned by the queue from now on.
+ */
+void eviQueuePush(EviQueue_t * queue, EviQueueNode_t * node);
+
+/**
+ * @brief Takes the next node, must only be called by the consumer.
+ *
+ * @param queue Queue to take from.
+ * @return The node, valid until the next call, or NULL if the queue is empty.
+ */
+EviQueueNode_t * eviQueuePop(EviQueue_t * queue);
+
+/**
+ * @brief Frees all nodes once no producer uses the queue anymore.
+ *
+ * @param queue Queue to clear, empty afterwards.
+ */
+void eviQueueClear(EviQueue_t * queue);
+
+/**
+ * @brief A thread executing the jobs of one device in order.
+ */
+typedef struct EviWorker EviWorker_t;
+
+/**
+ * @brief Starts a worker for a device.
+ *
+ * @param evi Device passed to the jobs, must outlive the worker.
+ * @return The worker, or NULL if it could not be started.
+ */
+EviWorker_t * eviWorkerStart(Evi_t * evi);
+
+/**
+ * @brief Stops a worker after its queued jobs and releases it.
+ *
+ * @param worker Worker started by eviWorkerStart(), may be NULL.
+ */
+void eviWorkerStop(EviWorker_t * worker);
+
+/**
+ * @brief Queues a job, may be called by any thread.
+ *
+ * @param worker Worker started by eviWorkerStart().
+ * @param job Job to execute.
+ * @param user User data passed to the job.
+ * @return ERROR_EVI_OK, or ERROR_EVI_INVALID_PARAMETER if out of memory.
+ */
+Error_t eviWorkerSubmit(EviWorker_t * worker, EviJob_t job, void * user);
+
+/**
+ * @brief Waits until all queued jobs are done.
+ *
+ * @param worker Worker started by eviWorkerStart().
+ * @return The first error of the jobs finished since the last wait, or ERROR_EVI_OK.
+ */
+Error_t eviWorkerWait(EviWorker_t * worker);
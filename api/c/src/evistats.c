@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evistats.h"
+#include <string.h>
+
+// One set of statistics for the whole process, guarded by a lock created on
+// first use. A command takes the lock a few times, which is negligible next
+// to the serial transfer.
+static EviStats_t eviStats;
+static void * volatile eviStatsLock;
+
+static size_t eviHistogramBucket(uint64_t duration)
+{
+    size_t exponent = 0;
+
+    if (duration < 8)
+    {
+        return (size_t)duration;
+    }
+
+    while ((duration >> exponent) >= 16)
+    {
+        exponent++;
+    }
+    // the top four bits select one of 8 buckets per power of two
+    size_t bucket = (exponent + 1) * 8 + (size_t)((duration >> exponent) & 7);
+    return bucket < EVI_STATS_BUCKETS ? bucket : EVI_STATS_BUCKETS - 1;
+}
+
+static uint64_t eviHistogramBucketLimit(size_t bucket)
+{
+    size_t exponent;
+
+    if (bucket < 8)
+    {
+        return bucket;
+    }
+
+    exponent = bucket / 8 - 1;
+    return ((uint64_t)(8 + bucket % 8) << exponent) + ((uint64_t)1 << exponent) - 1;
+}
+
+static void eviHistogramAdd(EviHistogram_t * histogram, uint64_t duration)
+{
+    histogram->count++;
+    histogram->total += duration;
+    if (duration > histogram->max)
+    {
+        histogram->max = duration;
+    }
+    histogram->buckets[eviHistogramBucket(duration)]++;
+}
+
+void eviStatsPhase(EviPhase_t phase, uint64_t start)
+{
+    uint64_t duration = eviTimeUs() - start;
+    EviMutex_t * lock = eviMutexCreateOnce(&eviStatsLock);
+
+    if (lock == NULL)
+    {
+        return;
+    }
+    eviMutexLock(lock);
+    eviHistogramAdd(&eviStats.phases[phase], duration);
+    eviMutexUnlock(lock);
+}
+
+void eviStatsCommand(const char * command, uint64_t start)
+{
+    uint64_t duration = eviTimeUs() - start;
+    EviMutex_t * lock = eviMutexCreateOnce(&eviStatsLock);
+    size_t index = EVI_STATS_COMMANDS - 1;
+
+    if (command[0] >= 'A' && command[0] <= 'Z')
+    {
+        index = (size_t)(command[0] - 'A');
+    }
+
+    if (lock == NULL)
+    {
+        return;
+    }
+    eviMutexLock(lock);
+    eviHistogramAdd(&eviStats.commands[index], duration);
+    eviMutexUnlock(lock);
+}
+
+void eviStatsCount(EviCounter_t counter)
+{
+    EviMutex_t * lock = eviMutexCreateOnce(&eviStatsLock);
+
+    if (lock == NULL)
+    {
+        return;
+    }
+    eviMutexLock(lock);
+    eviStats.counters[counter]++;
+    eviMutexUnlock(lock);
+}
+
+void eviStatsGet(EviStats_t * stats)
+{
+    EviMutex_t * lock = eviMutexCreateOnce(&eviStatsLock);
+
+    if (lock == NULL)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    eviMutexLock(lock);
+    *stats = eviStats;
+    eviMutexUnlock(lock);
+}
+
+void eviStatsReset(void)
+{
+    EviMutex_t * lock = eviMutexCreateOnce(&eviStatsLock);
+
+    if (lock == NULL)
+    {
+        return;
+    }
+    eviMutexLock(lock);
+    memset(&eviStats, 0, sizeof(eviStats));
+    eviMutexUnlock(lock);
+}
+
+uint64_t eviHistogramPercentile(const EviHistogram_t * histogram, double percentile)
+{
+    uint64_t rank;
+    uint64_t seen = 0;
+
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+
+    // the smallest duration with at least percentile % of all durations at or below it
+    rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    for (size_t i = 0; i < EVI_STATS_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t limit = eviHistogramBucketLimit(i);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+const char * eviStatsCommandName(size_t index)
+{
+    static const char * const names[EVI_STATS_COMMANDS] =
+    {
+        "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M",
+        "N", "O", "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "other"
+    };
+    return index < EVI_STATS_COMMANDS ? names[index] : "";
+}
+
+const char * eviStatsPhaseName(EviPhase_t phase)
+{
+    switch (phase)
+    {
+    case EVI_PHASE_DISCOVERY:
+        return "discovery";
+    case EVI_PHASE_OPEN:
+        return "open";
+    case EVI_PHASE_WRITE:
+        return "write";
+    case EVI_PHASE_READ:
+        return "read";
+    case EVI_PHASE_CRC:
+        return "crc";
+    case EVI_PHASE_PARSE:
+        return "parse";
+    default:
+        return "";
+    }
+}
+
+const char * eviStatsCounterName(EviCounter_t counter)
+{
+    switch (counter)
+    {
+    case EVI_COUNTER_TIMEOUT:
+        return "timeouts";
+    case EVI_COUNTER_CRC_ERROR:
+        return "crc errors";
+    case EVI_COUNTER_PROTOCOL:
+        return "protocol errors";
+    case EVI_COUNTER_DEVICE_ERROR:
+        return "device errors";
+    case EVI_COUNTER_PORT_OPEN:
+        return "port opens";
+    case EVI_COUNTER_PORT_FAILURE:
+        return "port open failures";
+    default:
+        return "";
+    }
+}
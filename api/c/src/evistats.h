@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * Command path statistics
+ *
+ * The library times every command and the phases of the command path and
+ * counts the failures, for all devices of the process together. The
+ * statistics are kept until eviStatsReset() and are most useful in a long
+ * running process, e.g., the daemon of the command line tool.
+ */
+
+/** @brief Number of buckets of an EviHistogram_t. */
+#define EVI_STATS_BUCKETS 240
+/** @brief Number of command histograms, one per command letter A to Z and one for all others. */
+#define EVI_STATS_COMMANDS 27
+
+/**
+ * @brief Phases of the command path.
+ */
+typedef enum
+{
+    EVI_PHASE_DISCOVERY = 0, /**< Looking up the port of the device. */
+    EVI_PHASE_OPEN      = 1, /**< Opening the port. */
+    EVI_PHASE_WRITE     = 2, /**< Sending a command. */
+    EVI_PHASE_READ      = 3, /**< Waiting for, reading and splitting a response. */
+    EVI_PHASE_CRC       = 4, /**< Checking the checksum of a response. */
+    EVI_PHASE_PARSE     = 5, /**< Evaluating a response. */
+    EVI_PHASE_COUNT     = 6, /**< Number of phases. */
+} EviPhase_t;
+
+/**
+ * @brief Failures and events counted on the command path.
+ */
+typedef enum
+{
+    EVI_COUNTER_TIMEOUT       = 0, /**< Responses not received in time. */
+    EVI_COUNTER_CRC_ERROR     = 1, /**< Responses with a wrong checksum. */
+    EVI_COUNTER_PROTOCOL      = 2, /**< Responses that could not be decoded. */
+    EVI_COUNTER_DEVICE_ERROR  = 3, /**< Commands answered with an error code by the device, except the empty log answering `Q`. */
+    EVI_COUNTER_PORT_OPEN     = 4, /**< Ports opened, more than one per device counts reconnects. */
+    EVI_COUNTER_PORT_FAILURE  = 5, /**< Ports that could not be opened. */
+    EVI_COUNTER_COUNT         = 6, /**< Number of counters. */
+} EviCounter_t;
+
+/**
+ * @struct EviHistogram_t
+ * @brief Distribution of durations in microseconds.
+ *
+ * Durations below 8 us have a bucket each, above every power of two is split
+ * into 8 buckets, so a bucket is at most 12.5% wide.
+ */
+typedef struct
+{
+    uint32_t count; /**< Number of durations recorded. */
+    uint64_t total; /**< Sum of all durations. */
+    uint64_t max; /**< Longest duration. */
+    uint32_t buckets[EVI_STATS_BUCKETS]; /**< Number of durations per bucket. */
+} EviHistogram_t;
+
+/**
+ * @struct EviStats_t
+ * @brief Statistics of the command path.
+ */
+typedef struct
+{
+    EviHistogram_t commands[EVI_STATS_COMMANDS]; /**< Time from sending a command to its response, see eviStatsCommandName(). */
+    EviHistogram_t phases[EVI_PHASE_COUNT]; /**< Time spent per phase. */
+    uint32_t counters[EVI_COUNTER_COUNT]; /**< Number of events per counter. */
+} EviStats_t;
+
+/**
+ * @brief Copies the current statistics.
+ *
+ * @param stats Receives the statistics.
+ */
+DLLEXPORT void eviStatsGet(EviStats_t *stats);
+
+/**
+ * @brief Clears all statistics.
+ */
+DLLEXPORT void eviStatsReset(void);
+
+/**
+ * @brief Returns a percentile of a histogram.
+ *
+ * @param histogram Histogram of eviStatsGet().
+ * @param percentile Percentile between 0 and 100.
+ * @return Upper bound of the bucket holding the percentile in microseconds, at most EviHistogram_t::max.
+ */
+DLLEXPORT uint64_t eviHistogramPercentile(const EviHistogram_t *histogram, double percentile);
+
+/**
+ * @brief Returns the name of a command histogram.
+ *
+ * @param index Index into EviStats_t::commands.
+ * @return The command letter, or "other".
+ */
+DLLEXPORT const char *eviStatsCommandName(size_t index);
+
+/**
+ * @brief Returns the name of a phase.
+ *
+ * @param phase The phase.
+ * @return The name.
+ */
+DLLEXPORT const char *eviStatsPhaseName(EviPhase_t phase);
+
+/**
+ * @brief Returns the name of a counter.
+ *
+ * @param counter The counter.
+ * @return The name.
+ */
+DLLEXPORT const char *eviStatsCounterName(EviCounter_t counter);
+
+/**
+ * @brief Records the duration of a phase.
+ *
+ * @param phase The phase.
+ * @param start Start of the phase, from eviTimeUs().
+ */
+void eviStatsPhase(EviPhase_t phase, uint64_t start);
+
+/**
+ * @brief Records the time from sending a command to its response.
+ *
+ * @param command The command.
+ * @param start Time the command was sent, from eviTimeUs().
+ */
+void eviStatsCommand(const char *command, uint64_t start);
+
+/**
+ * @brief Counts an event.
+ *
+ * @param counter The counter to increment.
+ */
+void eviStatsCount(EviCounter_t counter);
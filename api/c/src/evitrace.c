@@ -0,0 +1,422 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evitrace.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Writers reserve a record by incrementing head, clear its sequence number,
+// copy the fields and publish the record by storing its sequence number
+// last. A reader copies a record and keeps it only if the sequence number
+// was the expected one before and after copying, so a record overwritten
+// meanwhile is skipped instead of being read half. The fields are copied
+// with relaxed atomic accesses, the fences order them against the sequence
+// number.
+//
+// The mask and head belong to the ring and are published with its records
+// in one pointer, so a rejected start cannot change a ring in use. Every
+// writer and reader counts itself as a user of the ring, which is freed only
+// after the last one has left.
+typedef struct
+{
+    uint32_t mask;
+    volatile int32_t head;
+    EviTraceRecord_t records[];
+} EviTraceRing_t;
+
+static void * volatile eviTraceRing;
+static volatile int32_t eviTraceUsers;
+
+#define EVI_TRACE_MAX_DEVICES 64
+#define EVI_TRACE_MAX_PENDING 16
+
+Error_t eviTraceStart(size_t capacity)
+{
+    EviTraceRing_t * ring;
+    size_t size = 1;
+
+    if (capacity == 0)
+    {
+        capacity = EVI_TRACE_DEFAULT_CAPACITY;
+    }
+    while (size < capacity && size < 0x40000000u)
+    {
+        size <<= 1;
+    }
+
+    ring = calloc(1, sizeof(*ring) + size * sizeof(ring->records[0]));
+    if (ring == NULL)
+    {
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+
+    ring->mask = (uint32_t)(size - 1);
+    if (eviAtomicCompareExchangePointer(&eviTraceRing, NULL, ring) != NULL)
+    {
+        free(ring);
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+    return ERROR_EVI_OK;
+}
+
+static EviTraceRing_t * eviTraceEnter(void)
+{
+    EviTraceRing_t * ring;
+
+    eviAtomicAdd(&eviTraceUsers, 1);
+    ring = eviAtomicLoadPointer(&eviTraceRing);
+    if (ring == NULL)
+    {
+        eviAtomicAdd(&eviTraceUsers, -1);
+    }
+    return ring;
+}
+
+static void eviTraceLeave(void)
+{
+    eviAtomicAdd(&eviTraceUsers, -1);
+}
+
+void eviTraceStop(void)
+{
+    EviTraceRing_t * ring = eviAtomicExchangePointer(&eviTraceRing, NULL);
+
+    // a user that entered before the exchange may still access the ring
+    while (eviAtomicLoad(&eviTraceUsers) != 0)
+    {
+        Sleep(1);
+    }
+    free(ring);
+}
+
+void eviTrace(const Evi_t *self, EviTraceType_t type, const char *data, size_t length, Error_t result)
+{
+    EviTraceRing_t * ring = eviTraceEnter();
+    EviTraceRecord_t * record;
+    EviTraceRecord_t entry = {0};
+    uint32_t index;
+    size_t copy;
+
+    if (ring == NULL)
+    {
+        return;
+    }
+
+    entry.time = eviTimeUs();
+    entry.device = (uint64_t)(uintptr_t)self;
+    entry.type = (uint32_t)type;
+    entry.result = (uint32_t)result;
+    entry.length = (uint32_t)length;
+    copy = length < EVI_TRACE_DATA - 1 ? length : EVI_TRACE_DATA - 1;
+    memcpy(entry.data, data, copy);
+
+    index = (uint32_t)eviAtomicAdd(&ring->head, 1) - 1;
+    record = &ring->records[index & ring->mask];
+
+    eviAtomicStore(&record->sequence, 0);
+    eviAtomicFence();
+    eviAtomicCopy(record, &entry, offsetof(EviTraceRecord_t, sequence));
+    eviAtomicCopy(record->data, entry.data, sizeof(entry.data));
+    eviAtomicStore(&record->sequence, (int32_t)(index + 1));
+
+    eviTraceLeave();
+}
+
+Error_t eviTraceSave(const char *file)
+{
+    EviTraceRing_t * ring = eviTraceEnter();
+    EviTraceRecord_t * copy = NULL;
+    EviTraceHeader_t header = {0};
+    Error_t ret = ERROR_EVI_OK;
+    uint32_t head;
+    uint32_t first;
+    size_t count = 0;
+    FILE * fout;
+
+    if (ring == NULL)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+
+    head = (uint32_t)eviAtomicLoad(&ring->head);
+    first = head > ring->mask + 1 ? head - (ring->mask + 1) : 0;
+
+    copy = malloc((size_t)(head - first + 1) * sizeof(*copy));
+    if (copy == NULL)
+    {
+        eviTraceLeave();
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+
+    for (uint32_t i = first; i != head; i++)
+    {
+        EviTraceRecord_t * record = &ring->records[i & ring->mask];
+
+        if (eviAtomicLoad(&record->sequence) != (int32_t)(i + 1))
+        {
+            continue;
+        }
+        eviAtomicCopy(&copy[count], record, sizeof(*record));
+        eviAtomicFence();
+        if (eviAtomicLoad(&record->sequence) == (int32_t)(i + 1))
+        {
+            copy[count].sequence = (int32_t)(i + 1);
+            count++;
+        }
+    }
+    eviTraceLeave();
+
+    memcpy(header.magic, EVI_TRACE_MAGIC, sizeof(EVI_TRACE_MAGIC));
+    header.version = EVI_TRACE_VERSION;
+    header.headerSize = sizeof(header);
+    header.recordSize = sizeof(EviTraceRecord_t);
+    header.recordCount = count;
+
+    fout = fopen(file, "wb");
+    if (fout == NULL)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+    if (fwrite(&header, sizeof(header), 1, fout) != 1 ||
+        (count > 0 && fwrite(copy, sizeof(*copy), count, fout) != count))
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+    }
+    if (fclose(fout) != 0)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+    }
+
+cleanup:
+    free(copy);
+    return ret;
+}
+
+static void eviTraceWriteString(FILE * fout, const char * s)
+{
+    fputc('"', fout);
+    for (; *s != '\0'; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', fout);
+            fputc(c, fout);
+        }
+        else if (c < 0x20 || c >= 0x7F)
+        {
+            fprintf(fout, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, fout);
+        }
+    }
+    fputc('"', fout);
+}
+
+// Frames start with ':' or ';' and may end with a checksum, the name of a
+// slice is the bare command.
+static const char * eviTraceCommand(const char * frame, char * buffer, size_t size)
+{
+    const char * separator;
+    size_t length;
+
+    if (frame[0] == EVI_START_NO_CHK || frame[0] == EVI_START_WITH_CHK)
+    {
+        frame++;
+    }
+    separator = strchr(frame, EVI_CHECKSUM_SEPARATOR);
+    length = separator ? (size_t)(separator - frame) : strlen(frame);
+    if (length >= size)
+    {
+        length = size - 1;
+    }
+    memcpy(buffer, frame, length);
+    buffer[length] = '\0';
+    return buffer;
+}
+
+typedef struct
+{
+    uint64_t id;
+    size_t pending[EVI_TRACE_MAX_PENDING]; // sent frames waiting for their response, oldest first
+    size_t pendingCount;
+} EviTraceDevice_t;
+
+static void eviTraceWriteInstant(FILE * fout, const EviTraceRecord_t * record, size_t thread, uint64_t start, const char * name, bool * first)
+{
+    char command[EVI_TRACE_DATA];
+
+    fprintf(fout, "%s\n{\"name\":", *first ? "" : ",");
+    eviTraceWriteString(fout, name);
+    fprintf(fout, ",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"args\":{", (unsigned)thread, (unsigned long long)(record->time - start));
+    if (record->type == EVI_TRACE_RESULT)
+    {
+        fprintf(fout, "\"command\":");
+        eviTraceWriteString(fout, eviTraceCommand(record->data, command, sizeof(command)));
+        fprintf(fout, ",\"result\":%u,\"text\":", record->result);
+        eviTraceWriteString(fout, eviError2String((Error_t)record->result));
+    }
+    else
+    {
+        fprintf(fout, "\"frame\":");
+        eviTraceWriteString(fout, record->data);
+    }
+    fprintf(fout, "}}");
+    *first = false;
+}
+
+Error_t eviTraceExportChrome(const char *traceFile, const char *jsonFile)
+{
+    EviTraceHeader_t header;
+    EviTraceRecord_t * records = NULL;
+    EviTraceDevice_t * devices = NULL;
+    size_t deviceCount = 0;
+    Error_t ret = ERROR_EVI_OK;
+    FILE * fin = fopen(traceFile, "rb");
+    FILE * fout = NULL;
+    bool first = true;
+    uint64_t start;
+
+    if (fin == NULL)
+    {
+        return ERROR_EVI_FILE_NOT_FOUND;
+    }
+
+    if (fread(&header, sizeof(header), 1, fin) != 1 ||
+        memcmp(header.magic, EVI_TRACE_MAGIC, sizeof(EVI_TRACE_MAGIC)) != 0 || header.version != EVI_TRACE_VERSION ||
+        header.headerSize < sizeof(header) || header.recordSize < sizeof(EviTraceRecord_t) || header.recordCount > SIZE_MAX / header.recordSize)
+    {
+        ret = ERROR_EVI_PROTOCOL_ERROR;
+        goto cleanup;
+    }
+
+    records = calloc((size_t)header.recordCount + 1, sizeof(*records));
+    devices = calloc(EVI_TRACE_MAX_DEVICES, sizeof(*devices));
+    if (records == NULL || devices == NULL)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < header.recordCount; i++)
+    {
+        // later versions may append fields to a record
+        if (fseek(fin, (long)(header.headerSize + i * header.recordSize), SEEK_SET) != 0 ||
+            fread(&records[i], sizeof(records[i]), 1, fin) != 1)
+        {
+            ret = ERROR_EVI_PROTOCOL_ERROR;
+            goto cleanup;
+        }
+        records[i].data[EVI_TRACE_DATA - 1] = '\0';
+    }
+
+    fout = fopen(jsonFile, "w");
+    if (fout == NULL)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+        goto cleanup;
+    }
+
+    start = header.recordCount > 0 ? records[0].time : 0;
+    fprintf(fout, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    for (size_t i = 0; i < header.recordCount; i++)
+    {
+        const EviTraceRecord_t * record = &records[i];
+        EviTraceDevice_t * device = NULL;
+        size_t thread;
+        char command[EVI_TRACE_DATA];
+
+        for (thread = 0; thread < deviceCount; thread++)
+        {
+            if (devices[thread].id == record->device)
+            {
+                device = &devices[thread];
+                break;
+            }
+        }
+        if (device == NULL)
+        {
+            if (deviceCount == EVI_TRACE_MAX_DEVICES)
+            {
+                continue;
+            }
+            thread = deviceCount++;
+            device = &devices[thread];
+            device->id = record->device;
+            fprintf(fout, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"device %u\"}}", first ? "" : ",", (unsigned)thread, (unsigned)thread);
+            first = false;
+        }
+
+        if (record->type == EVI_TRACE_TX)
+        {
+            if (device->pendingCount == EVI_TRACE_MAX_PENDING)
+            {
+                eviTraceWriteInstant(fout, &records[device->pending[0]], thread, start, "tx", &first);
+                memmove(device->pending, device->pending + 1, (EVI_TRACE_MAX_PENDING - 1) * sizeof(device->pending[0]));
+                device->pendingCount--;
+            }
+            device->pending[device->pendingCount++] = i;
+        }
+        else if (record->type == EVI_TRACE_RX && device->pendingCount > 0)
+        {
+            // responses arrive in the order of the commands
+            const EviTraceRecord_t * tx = &records[device->pending[0]];
+
+            fprintf(fout, "%s\n{\"name\":", first ? "" : ",");
+            eviTraceWriteString(fout, eviTraceCommand(tx->data, command, sizeof(command)));
+            fprintf(fout, ",\"cat\":\"command\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu,\"args\":{\"tx\":",
+                    (unsigned)thread, (unsigned long long)(tx->time - start), (unsigned long long)(record->time - tx->time));
+            eviTraceWriteString(fout, tx->data);
+            fprintf(fout, ",\"rx\":");
+            eviTraceWriteString(fout, record->data);
+            fprintf(fout, "}}");
+            first = false;
+
+            memmove(device->pending, device->pending + 1, (device->pendingCount - 1) * sizeof(device->pending[0]));
+            device->pendingCount--;
+        }
+        else if (record->type == EVI_TRACE_RX)
+        {
+            eviTraceWriteInstant(fout, record, thread, start, "rx", &first);
+        }
+        else
+        {
+            // a failed read ends the commands in flight
+            if (record->result != ERROR_EVI_OK && record->length == 0)
+            {
+                device->pendingCount = 0;
+            }
+            eviTraceWriteInstant(fout, record, thread, start, record->result == ERROR_EVI_OK ? "ok" : "error", &first);
+        }
+    }
+
+    for (size_t d = 0; d < deviceCount; d++)
+    {
+        for (size_t p = 0; p < devices[d].pendingCount; p++)
+        {
+            eviTraceWriteInstant(fout, &records[devices[d].pending[p]], d, start, "tx", &first);
+        }
+    }
+
+    fprintf(fout, "\n]}\n");
+    if (ferror(fout))
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+    }
+
+cleanup:
+    if (fout != NULL && fclose(fout) != 0)
+    {
+        ret = ERROR_EVI_FILE_IO_ERROR;
+    }
+    fclose(fin);
+    free(devices);
+    free(records);
+    return ret;
+}
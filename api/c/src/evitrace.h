@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: (c) 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * Protocol trace
+ *
+ * While tracing is started, every frame sent to or received from a device
+ * and the result of every command are recorded with a time stamp in a ring
+ * buffer. Recording takes no lock and does not write anything, the newest
+ * records are written to a file with eviTraceSave() on demand.
+ *
+ * Trace file layout, all values little-endian:
+ *   EviTraceHeader_t
+ *   recordCount records of recordSize bytes, oldest first
+ *
+ * eviTraceExportChrome() converts a trace file to the JSON trace event
+ * format shown by chrome://tracing and https://ui.perfetto.dev.
+ */
+
+#define EVI_TRACE_MAGIC "EVITRCE"
+#define EVI_TRACE_VERSION 1
+#define EVI_TRACE_DATA 64
+#define EVI_TRACE_DEFAULT_CAPACITY 16384
+
+/**
+ * @brief Kind of a trace record.
+ */
+typedef enum
+{
+    EVI_TRACE_TX     = 0, /**< A frame sent to the device. */
+    EVI_TRACE_RX     = 1, /**< A frame received from the device. */
+    EVI_TRACE_RESULT = 2, /**< The result of a command, or of a failed read. */
+} EviTraceType_t;
+
+/**
+ * @struct EviTraceHeader_t
+ * @brief File header of a trace.
+ */
+typedef struct
+{
+    char     magic[8];    /**< EVI_TRACE_MAGIC, null-terminated. */
+    uint32_t version;     /**< EVI_TRACE_VERSION. */
+    uint32_t headerSize;  /**< Size of this header in bytes. */
+    uint32_t recordSize;  /**< Size of a record in bytes, at least sizeof(EviTraceRecord_t). */
+    uint32_t reserved;    /**< Always 0. */
+    uint64_t recordCount; /**< Number of records. */
+} EviTraceHeader_t;
+
+/**
+ * @struct EviTraceRecord_t
+ * @brief One recorded event.
+ */
+typedef struct
+{
+    uint64_t time;     /**< Time stamp in microseconds, see eviTimeUs(). */
+    uint64_t device;   /**< Identifies the Evi_t of the event. */
+    uint32_t type;     /**< EviTraceType_t. */
+    uint32_t result;   /**< Error_t of a EVI_TRACE_RESULT record. */
+    uint32_t length;   /**< Length of the frame or command, data may be shorter. */
+    int32_t  sequence; /**< Number of the record since tracing started, from 1. */
+    char     data[EVI_TRACE_DATA]; /**< Frame without the line end, or the command of a result, null-terminated. */
+} EviTraceRecord_t;
+
+/**
+ * @brief Starts recording.
+ *
+ * @param capacity Number of records kept, rounded up to a power of two, 0 uses EVI_TRACE_DEFAULT_CAPACITY.
+ * @return ERROR_EVI_OK, ERROR_EVI_INVALID_PARAMETER if tracing is started already or ERROR_EVI_OUT_OF_MEMORY.
+ */
+DLLEXPORT Error_t eviTraceStart(size_t capacity);
+
+/**
+ * @brief Stops recording and drops all records.
+ *
+ * Commands running on other threads stop recording as well; the records are
+ * released once they are no longer accessed.
+ */
+DLLEXPORT void eviTraceStop(void);
+
+/**
+ * @brief Writes the recorded events to a file, oldest first.
+ *
+ * Recording continues, events recorded while saving may be missing.
+ *
+ * @param file Path of the trace file.
+ * @return ERROR_EVI_OK, ERROR_EVI_INVALID_PARAMETER if tracing is not started, ERROR_EVI_OUT_OF_MEMORY or ERROR_EVI_FILE_IO_ERROR.
+ */
+DLLEXPORT Error_t eviTraceSave(const char *file);
+
+/**
+ * @brief Converts a trace file to the Chrome trace event JSON format.
+ *
+ * Every device is a thread. A command is a slice from sending it until its
+ * response, results and frames without a counterpart are instant events.
+ *
+ * @param traceFile Trace file written by eviTraceSave().
+ * @param jsonFile Path of the JSON file.
+ * @return ERROR_EVI_OK, ERROR_EVI_FILE_NOT_FOUND, ERROR_EVI_PROTOCOL_ERROR for an invalid trace file or ERROR_EVI_FILE_IO_ERROR.
+ */
+DLLEXPORT Error_t eviTraceExportChrome(const char *traceFile, const char *jsonFile);
+
+/**
+ * @brief Records an event if tracing is started.
+ *
+ * @param self The device.
+ * @param type Kind of the event.
+ * @param data The frame or command, need not be null-terminated.
+ * @param length Length of data.
+ * @param result Result of an EVI_TRACE_RESULT event.
+ */
+void eviTrace(const Evi_t *self, EviTraceType_t type, const char *data, size_t length, Error_t result);
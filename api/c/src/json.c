@@ -2,6 +2,7 @@
 // SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
 
 #include "json.h"
+#include "helpers.h"
 #include <sys/stat.h>
 #include <stdio.h>
 #include <string.h>
@@ -35,18 +36,384 @@ cJSON* json_loadFromFile(const char * file)
     return json;
 }
 
-void json_saveToFile(const char* file, cJSON* json)
+bool json_saveToFile(const char* file, cJSON* json)
 {
     FILE* fout   = 0;
     char* buffer = NULL;
-
-    fout = fopen(file, "w+");
+    char* temp   = malloc_printf("%s.tmp", file);
+    bool  ret    = false;
 
     buffer = cJSON_Print(json);
+    if (buffer == NULL || temp == NULL)
+    {
+        goto cleanup;
+    }
+
+    fout = fopen(temp, "w+");
+    if (fout)
+    {
+        size_t length = strlen(buffer);
+        ret = fwrite(buffer, 1, length, fout) == length;
+        ret = (fclose(fout) == 0) && ret;
+        ret = ret && eviReplaceFile(temp, file);
+        if (!ret)
+        {
+            remove(temp);
+        }
+    }
+
+cleanup:
+    free(buffer);
+    free(temp);
+    return ret;
+}
+
+bool json_appendLineToFile(const char* file, cJSON* json)
+{
+    FILE* fout   = 0;
+    char* buffer = NULL;
+    bool  ret    = false;
+
+    buffer = cJSON_PrintUnformatted(json);
+    if (buffer == NULL)
+    {
+        return false;
+    }
 
-    fwrite(buffer, strlen(buffer), 1, fout);
+    fout = fopen(file, "ab");
+    if (fout)
+    {
+        size_t length = strlen(buffer);
+        buffer[length] = '\n';
+        ret = fwrite(buffer, 1, length + 1, fout) == length + 1;
+        ret = (fclose(fout) == 0) && ret;
+    }
 
     free(buffer);
+    return ret;
+}
+
+cJSON* json_loadLinesFromFile(const char * file)
+{
+    FILE*  fin   = 0;
+    char*  line  = NULL;
+    size_t size  = 0;
+    size_t length = 0;
+    cJSON* array = NULL;
+    int    c;
+
+    fin = fopen(file, "rb");
+    if (!fin)
+    {
+        return NULL;
+    }
+
+    array = cJSON_CreateArray();
+
+    do
+    {
+        c = getc(fin);
+        if (c == '\n' || c == EOF)
+        {
+            if (length > 0)
+            {
+                cJSON* item = cJSON_ParseWithLength(line, length);
+                if (item)
+                {
+                    cJSON_AddItemToArray(array, item);
+                }
+            }
+            length = 0;
+        }
+        else
+        {
+            if (length == size)
+            {
+                char* grown = realloc(line, size + 4096);
+                if (!grown)
+                {
+                    break;
+                }
+                line = grown;
+                size += 4096;
+            }
+            line[length++] = (char)c;
+        }
+    } while (c != EOF);
+
+    fclose(fin);
+    free(line);
+    return array;
+}
+
+static int json_readerGet(JsonArrayReader_t * reader)
+{
+    if (reader->position == reader->length)
+    {
+        reader->length = fread(reader->buffer, 1, JSON_READER_BUFFER_SIZE, reader->file);
+        reader->position = 0;
+        if (reader->length == 0)
+        {
+            return EOF;
+        }
+    }
+    return (unsigned char)reader->buffer[reader->position++];
+}
+
+// only valid directly after a successful json_readerGet()
+static void json_readerUnget(JsonArrayReader_t * reader)
+{
+    reader->position--;
+}
+
+static int json_readerGetNonSpace(JsonArrayReader_t * reader)
+{
+    int c;
 
-    fclose(fout);
+    do
+    {
+        c = json_readerGet(reader);
+    } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+    return c;
+}
+
+// Reads the rest of a string after the opening quote. Returns true if the
+// string equals key.
+static bool json_readerSkipString(JsonArrayReader_t * reader, const char * key, bool * ok)
+{
+    size_t keyLength = key ? strlen(key) : 0;
+    size_t length = 0;
+    bool   equal = key != NULL;
+    int    c;
+
+    for (;;)
+    {
+        c = json_readerGet(reader);
+        if (c == EOF)
+        {
+            *ok = false;
+            return false;
+        }
+        if (c == '"')
+        {
+            return equal && (length == keyLength);
+        }
+        if (c == '\\')
+        {
+            equal = false;
+            if (json_readerGet(reader) == EOF)
+            {
+                *ok = false;
+                return false;
+            }
+        }
+        else if (equal && (length >= keyLength || key[length] != (char)c))
+        {
+            equal = false;
+        }
+        length++;
+    }
+}
+
+static bool json_readerAppend(JsonArrayReader_t * reader, int c)
+{
+    if (reader->itemLength == reader->itemSize)
+    {
+        char* grown = realloc(reader->item, reader->itemSize + 4096);
+        if (!grown)
+        {
+            return false;
+        }
+        reader->item = grown;
+        reader->itemSize += 4096;
+    }
+    reader->item[reader->itemLength++] = (char)c;
+    return true;
+}
+
+bool json_arrayReaderOpen(JsonArrayReader_t * reader, const char * file, const char * key)
+{
+    int  depth = 1;
+    bool ok = true;
+    int  c;
+
+    memset(reader, 0, sizeof(*reader));
+
+    reader->file = fopen(file, "rb");
+    reader->buffer = malloc(JSON_READER_BUFFER_SIZE);
+    if (!reader->file || !reader->buffer)
+    {
+        goto error;
+    }
+
+    c = json_readerGetNonSpace(reader);
+    if (c == '[')
+    {
+        // a top-level array has no members
+        reader->done = true;
+        return true;
+    }
+    if (c != '{')
+    {
+        goto error;
+    }
+
+    // search the key among the members of the top-level object
+    while (depth > 0)
+    {
+        c = json_readerGet(reader);
+        switch (c)
+        {
+            case EOF:
+                goto error;
+            case '"':
+            {
+                bool match = json_readerSkipString(reader, depth == 1 ? key : NULL, &ok);
+                if (!ok)
+                {
+                    goto error;
+                }
+                c = json_readerGetNonSpace(reader);
+                if (c != ':')
+                {
+                    if (c == EOF)
+                    {
+                        goto error;
+                    }
+                    json_readerUnget(reader);
+                }
+                else if (match)
+                {
+                    if (json_readerGetNonSpace(reader) != '[')
+                    {
+                        // not an array, there are no items to read
+                        reader->done = true;
+                    }
+                    return true;
+                }
+                break;
+            }
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                break;
+            default:
+                break;
+        }
+    }
+
+    reader->done = true;
+    return true;
+
+error:
+    reader->error = true;
+    reader->done = true;
+    return false;
+}
+
+cJSON * json_arrayReaderNext(JsonArrayReader_t * reader)
+{
+    int    depth = 0;
+    bool   inString = false;
+    cJSON* item = NULL;
+    int    c;
+
+    if (reader->done)
+    {
+        return NULL;
+    }
+
+    c = json_readerGetNonSpace(reader);
+    if (c == ',' && reader->itemLength > 0)
+    {
+        c = json_readerGetNonSpace(reader);
+    }
+    if (c == ']')
+    {
+        reader->done = true;
+        return NULL;
+    }
+
+    // collect the text of one item by matching brackets outside of strings
+    reader->itemLength = 0;
+    for (;;)
+    {
+        if (c == EOF)
+        {
+            goto error;
+        }
+        if (!inString && depth == 0 && (c == ',' || c == ']') && reader->itemLength > 0)
+        {
+            json_readerUnget(reader);
+            break;
+        }
+        if (!json_readerAppend(reader, c))
+        {
+            goto error;
+        }
+        if (inString)
+        {
+            if (c == '\\')
+            {
+                c = json_readerGet(reader);
+                if (c == EOF || !json_readerAppend(reader, c))
+                {
+                    goto error;
+                }
+            }
+            else if (c == '"')
+            {
+                inString = false;
+                if (depth == 0)
+                {
+                    break;
+                }
+            }
+        }
+        else if (c == '"')
+        {
+            inString = true;
+        }
+        else if (c == '{' || c == '[')
+        {
+            depth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+            depth--;
+            if (depth <= 0)
+            {
+                break;
+            }
+        }
+        c = json_readerGet(reader);
+    }
+
+    item = cJSON_ParseWithLength(reader->item, reader->itemLength);
+    if (!item)
+    {
+        goto error;
+    }
+    return item;
+
+error:
+    reader->error = true;
+    reader->done = true;
+    return NULL;
+}
+
+void json_arrayReaderClose(JsonArrayReader_t * reader)
+{
+    if (reader->file)
+    {
+        fclose(reader->file);
+    }
+    free(reader->buffer);
+    free(reader->item);
+    memset(reader, 0, sizeof(*reader));
 }
@@ -15,7 +15,83 @@ DLLEXPORT cJSON *json_loadFromFile(const char *file);
 /**
  * @brief Writes a cJSON document to a file path.
  *
+ * The document is written to a temporary file next to the file, which then
+ * replaces it, so a failed write leaves the previous content untouched.
+ *
  * @param file Null-terminated path where the JSON data should be saved.
  * @param json Pointer to the cJSON document that will be serialized.
+ * @return true if the file was written completely; false otherwise.
+ */
+DLLEXPORT bool json_saveToFile(const char* file, cJSON* json);
+
+/**
+ * @brief Appends a cJSON document as a single line to a JSON Lines file.
+ *
+ * The file is created if it does not exist.
+ *
+ * @param file Null-terminated path of the JSON Lines file.
+ * @param json Pointer to the cJSON document that will be appended.
+ * @return true if the line was written completely; false otherwise.
+ */
+DLLEXPORT bool json_appendLineToFile(const char* file, cJSON* json);
+
+/**
+ * @brief Loads all lines of a JSON Lines file into a cJSON array.
+ *
+ * Lines that cannot be parsed, e.g. a line cut off by a crash, are skipped.
+ *
+ * @param file Null-terminated path of the JSON Lines file.
+ * @return Pointer to a cJSON array with one item per line, or NULL if the file cannot be read.
+ */
+DLLEXPORT cJSON *json_loadLinesFromFile(const char *file);
+
+/**
+ * @brief Size of the read buffer of a JsonArrayReader_t.
+ */
+#define JSON_READER_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Reads the items of an array member of a JSON object file one at a time.
+ *
+ * Only the current item is held in memory, so files of any size can be
+ * processed in constant memory.
+ */
+typedef struct
+{
+    FILE * file;          /**< File being read. */
+    char * buffer;        /**< Read buffer of JSON_READER_BUFFER_SIZE bytes. */
+    size_t length;        /**< Number of valid bytes in buffer. */
+    size_t position;      /**< Index of the next unprocessed byte in buffer. */
+    char * item;          /**< Text of the current item. */
+    size_t itemLength;    /**< Number of valid bytes in item. */
+    size_t itemSize;      /**< Allocated size of item. */
+    bool   done;          /**< No more items are available. */
+    bool   error;         /**< The file is not valid JSON or could not be read. */
+} JsonArrayReader_t;
+
+/**
+ * @brief Opens a JSON file and positions the reader on the array stored under a top-level key.
+ *
+ * If the top-level object has no such array, the reader returns no items.
+ *
+ * @param reader Reader to initialize.
+ * @param file Null-terminated path of the JSON file.
+ * @param key Null-terminated name of the array member of the top-level object.
+ * @return true if the file was opened and its beginning could be parsed; false otherwise.
+ */
+DLLEXPORT bool json_arrayReaderOpen(JsonArrayReader_t * reader, const char * file, const char * key);
+
+/**
+ * @brief Parses the next item of the array.
+ *
+ * @param reader Reader opened by json_arrayReaderOpen().
+ * @return The item, to be freed with cJSON_Delete(), or NULL at the end of the array or on errors (see JsonArrayReader_t::error).
+ */
+DLLEXPORT cJSON * json_arrayReaderNext(JsonArrayReader_t * reader);
+
+/**
+ * @brief Closes the file and frees the buffers of a reader.
+ *
+ * @param reader Reader opened by json_arrayReaderOpen().
  */
-DLLEXPORT void json_saveToFile(const char* file, cJSON* json);
+DLLEXPORT void json_arrayReaderClose(JsonArrayReader_t * reader);
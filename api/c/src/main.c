@@ -14,9 +14,16 @@
 #include "cmdexport.h"
 #include "cmdempty.h"
 #include "cmdrun.h"
+#include "cmdarchive.h"
+#include "cmddaemon.h"
+#include "cmddevices.h"
+#include "cmdstats.h"
+#include "cmdtrace.h"
+#include "evitrace.h"
 #include "printerror.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 #define VERSION_TOOL "0.10.0"
 
@@ -26,9 +33,12 @@ void help(int argcCmd, char **argvCmd)
 	{
             fprintf_s(stdout, "Usage: evidense [OPTIONS] COMMAND [ARGUMENTS]\n");
             fprintf_s(stdout, "Commands:\n");
+            fprintf_s(stdout, "  archive             : converts between JSON data files and binary archives\n");
             fprintf_s(stdout, "  baseline            : starts a baseline measurement and returns the values\n");
             fprintf_s(stdout, "  command COMMAND     : executes a command, e.g., evidense.exe command \"V 0\" returns the value at index 0\n");
+            fprintf_s(stdout, "  daemon              : keeps the device open and executes the commands of clients\n");
             fprintf_s(stdout, "  data                : handles data in a data file\n");
+            fprintf_s(stdout, "  devices             : lists all connected devices or measures on all of them\n");
             fprintf_s(stdout, "  empty               : checks if the cuvette guide is empty\n");
             fprintf_s(stdout, "  export              : exports JSON as CSV file\n");
             fprintf_s(stdout, "  fwupdate FILE       : loads new firmware\n");
@@ -39,12 +49,18 @@ void help(int argcCmd, char **argvCmd)
             fprintf_s(stdout, "  save                : saves the last measurement(s)\n");            
             fprintf_s(stdout, "  selftest            : executes an internal selftest\n");
             fprintf_s(stdout, "  set INDEX VALUE     : sets a value in the device\n");
+            fprintf_s(stdout, "  stats               : prints timing statistics of the device communication\n");
+            fprintf_s(stdout, "  trace               : saves the protocol trace or converts it to JSON\n");
             fprintf_s(stdout, "  version             : returns the version\n");            
             fprintf_s(stdout, "Options:\n");
             fprintf_s(stdout, "  --verbose           : prints debug info\n");
             fprintf_s(stdout, "  --help -h           : shows this help and exits\n");
             fprintf_s(stdout, "  --device            : uses the given device; if omitted the CLI searches for a device\n");
+            fprintf_s(stdout, "  --serial SERIAL     : uses the device with the USB serial number SERIAL, see 'devices'\n");
             fprintf_s(stdout, "  --use-checksum      : uses the protocol with a checksum\n");
+            fprintf_s(stdout, "  --timeout MS        : waits at most MS milliseconds for a response (default: 30000)\n");
+            fprintf_s(stdout, "  --socket PATH       : forwards the command to the daemon listening on PATH\n");
+            fprintf_s(stdout, "  --trace FILE        : records all frames sent and received and saves them to FILE at exit\n");
             fprintf_s(stdout, "\n");
             fprintf_s(stdout, "The command-line tool returns the following exit codes:\n");
             fprintf_s(stdout, "    0: No error.\n");
@@ -105,18 +121,26 @@ void help(int argcCmd, char **argvCmd)
             else if(strcmp(argvCmd[1], "export") == 0)
             {
                 fprintf_s(stdout, "Usage: evidense export [OPTIONS] [JSON FILE] [CSV FILE]\n");
-                fprintf_s(stdout, "  Exports data from the JSON file to CSV format.\n");
+                fprintf_s(stdout, "  Exports data from the JSON file or binary archive to CSV format.\n");
                 fprintf_s(stdout, "Options:\n");
                 fprintf_s(stdout, "  --delimiter-comma     : uses commas as separators (default).\n");
                 fprintf_s(stdout, "  --delimiter-semicolon : uses semicolons as separators.\n");
                 fprintf_s(stdout, "  --delimiter-tab       : uses tabs as separators.\n");
                 fprintf_s(stdout, "  --mode-raw            : exports single measurements.\n");
                 fprintf_s(stdout, "  --mode-measurement    : exports air-sample pairs (default).\n");
+            }
+            else if(strcmp(argvCmd[1], "archive") == 0)
+            {
+                fprintf_s(stdout, "Usage: evidense archive pack JSON_FILE ARCHIVE_FILE\n");
+                fprintf_s(stdout, "  Converts a JSON data file into a compact binary archive.\n");
+                fprintf_s(stdout, "Usage: evidense archive unpack ARCHIVE_FILE JSON_FILE\n");
+                fprintf_s(stdout, "  Converts a binary archive back into a JSON data file.\n");
+                fprintf_s(stdout, "The commands data and export read archives directly.\n");
             }
 			else if(strcmp(argvCmd[1], "data") == 0)
 			{
                 fprintf_s(stdout, "Usage: evidense data print FILE\n");
-                fprintf_s(stdout, "  Prints the calculated values from file FILE.\n");
+                fprintf_s(stdout, "  Prints the calculated values from file FILE, a JSON file or binary archive.\n");
                 fprintf_s(stdout, "Output:\n");
                 fprintf_s(stdout, "  dsDNA ssDNA ssRNA purity_ratio_260/230 purity_ratio_260/280 comment\n");
                 fprintf_s(stdout, "\n");
@@ -142,8 +166,12 @@ void help(int argcCmd, char **argvCmd)
                 fprintf_s(stdout, "Usage: evidense run [OPTIONS] checkempty\n");
                 fprintf_s(stdout, "  Checks if the cuvette guide is empty.\n");
                 fprintf_s(stdout, "  Returns exit code 0 when the cuvette guide is empty; otherwise, the exit code is non-zero.\n");
+                fprintf_s(stdout, "Usage: evidense run [OPTIONS] finalize\n");
+                fprintf_s(stdout, "  Writes the measurements of the run into the data JSON file and calculates the results.\n");
+                fprintf_s(stdout, "  Until then, measurements are appended to a journal with the suffix .jsonl next to the data file.\n");
                 fprintf_s(stdout, "Usage: evidense run [OPTIONS] export\n");
                 fprintf_s(stdout, "  Exports the active run data JSON file as a CSV file with the same basename.\n");
+                fprintf_s(stdout, "  Finalizes the run first.\n");
                 fprintf_s(stdout, "Options:\n");
                 fprintf_s(stdout, "  --working-dir=DIR      : working directory (default: .)\n");
                 fprintf_s(stdout, "  --file=FILE            : data file\n");
@@ -188,6 +216,51 @@ void help(int argcCmd, char **argvCmd)
                 fprintf_s(stdout, "Usage: evidense empty\n");
                 fprintf_s(stdout, "  Checks if the cuvette guide is empty.\n");
                 fprintf_s(stdout, "  Returns 'Empty' if the cuvette guide is empty; otherwise returns 'Not empty'.\n");
+            }
+            else if(strcmp(argvCmd[1], "devices") == 0)
+            {
+                fprintf_s(stdout, "Usage: evidense devices\n");
+                fprintf_s(stdout, "  Lists the USB serial number and port of all connected devices.\n");
+                fprintf_s(stdout, "Usage: evidense devices measure\n");
+                fprintf_s(stdout, "  Measures on all devices at the same time and prints the values per device.\n");
+                fprintf_s(stdout, "Output: all units in [uV]\n");
+                fprintf_s(stdout, "  SERIAL SAMPLE_230 REFERENCE_230 SAMPLE_260 REFERENCE_260 SAMPLE_280 REFERENCE_280 SAMPLE_340 REFERENCE_340\n");
+                fprintf_s(stdout, "Use --serial SERIAL to address one device, e.g., to run a workflow per device.\n");
+                fprintf_s(stdout, "Every device has its own run state and data file.\n");
+            }
+            else if(strcmp(argvCmd[1], "stats") == 0)
+            {
+                fprintf_s(stdout, "Usage: evidense stats\n");
+                fprintf_s(stdout, "  Prints the timing statistics of the device communication of this process:\n");
+                fprintf_s(stdout, "  count, mean, p50, p99 and max in [ms] per phase and per command letter,\n");
+                fprintf_s(stdout, "  followed by the number of timeouts, errors and opened ports.\n");
+                fprintf_s(stdout, "  Use it with --socket to get the statistics of a running daemon.\n");
+                fprintf_s(stdout, "Usage: evidense stats reset\n");
+                fprintf_s(stdout, "  Clears the statistics.\n");
+            }
+            else if(strcmp(argvCmd[1], "trace") == 0)
+            {
+                fprintf_s(stdout, "Usage: evidense --trace FILE COMMAND\n");
+                fprintf_s(stdout, "  Records every frame sent to and received from the device and the result of\n");
+                fprintf_s(stdout, "  every command, and saves the newest %u records to FILE when the tool exits.\n", EVI_TRACE_DEFAULT_CAPACITY);
+                fprintf_s(stdout, "  Started with the daemon, the trace is saved when the daemon stops.\n");
+                fprintf_s(stdout, "Usage: evidense trace save FILE\n");
+                fprintf_s(stdout, "  Saves the trace recorded so far, e.g., of a daemon with --socket.\n");
+                fprintf_s(stdout, "Usage: evidense trace export FILE JSON\n");
+                fprintf_s(stdout, "  Converts a trace file to JSON for chrome://tracing or https://ui.perfetto.dev.\n");
+            }
+            else if(strcmp(argvCmd[1], "daemon") == 0)
+            {
+                fprintf_s(stdout, "Usage: evidense [OPTIONS] daemon\n");
+                fprintf_s(stdout, "  Keeps the device session and the run state open and executes the commands\n");
+                fprintf_s(stdout, "  of clients. A client is any evidense call with --socket PATH or with the\n");
+                fprintf_s(stdout, "  environment variable EVIDENSE_SOCKET set, e.g., evidense --socket PATH run measure.\n");
+                fprintf_s(stdout, "  The options --device, --use-checksum, --timeout and --verbose of the daemon\n");
+                fprintf_s(stdout, "  apply to all forwarded commands.\n");
+                fprintf_s(stdout, "  The socket is PATH given with --socket, EVIDENSE_SOCKET or $XDG_RUNTIME_DIR/evidense.sock,\n");
+                fprintf_s(stdout, "  without a runtime directory /tmp/evidense-UID/daemon.sock. Only the user may connect.\n");
+                fprintf_s(stdout, "Usage: evidense [--socket PATH] daemon stop\n");
+                fprintf_s(stdout, "  Stops the daemon.\n");
             }
 			else if(strcmp(argvCmd[1], "command") == 0)
             {
@@ -206,6 +279,110 @@ void help(int argcCmd, char **argvCmd)
 	}
 }
 
+static bool commandNeedsDevice(const char * command)
+{
+    static const char * const commands[] = {"get", "set", "measure", "baseline", "selftest", "fwupdate", "command", "save", "empty", "run"};
+
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    {
+        if (strcmp(command, commands[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static Error_t execute(Evi_t * self, int argcCmd, char **argvCmd)
+{
+    Error_t ret = ERROR_EVI_OK;
+
+    if (commandNeedsDevice(argvCmd[0]))
+    {
+        // keep the port open for all device commands of this invocation
+        eviSessionOpen(self);
+    }
+
+	if (strcmp(argvCmd[0], "get") == 0 && argcCmd == 2)
+	{
+        ret = cmdGet(self, argvCmd[1]);
+	}
+	else if (strcmp(argvCmd[0], "set") == 0 && argcCmd == 3)
+	{
+        ret = cmdSet(self, argvCmd[1], argvCmd[2]);
+	}
+	else if (strcmp(argvCmd[0], "measure") == 0)
+	{
+        ret = cmdMeasure(self);
+	}
+	else if (strcmp(argvCmd[0], "baseline") == 0)
+	{
+        ret = cmdBaseline(self);
+	}
+	else if (strcmp(argvCmd[0], "version") == 0)
+	{
+        fprintf(stdout, "%s\n", VERSION_TOOL);
+	}
+	else if (strcmp(argvCmd[0], "selftest") == 0)
+	{
+        ret = cmdSelftest(self);
+	}
+	else if (strcmp(argvCmd[0], "fwupdate") == 0 && argcCmd == 2)
+	{
+        ret = cmdFwUpdate(self, argvCmd[1]);
+	}
+	else if (strcmp(argvCmd[0], "command") == 0 && argcCmd == 2)
+	{
+        ret = cmdCommand(self, argvCmd[1]);
+	}
+	else if (strcmp(argvCmd[0], "data") == 0)
+	{
+        ret = cmdData(self, argcCmd, argvCmd);
+	}
+	else if (strcmp(argvCmd[0], "save") == 0)
+	{
+        ret = cmdSave(self, argcCmd, argvCmd);
+	}
+    else if (strcmp(argvCmd[0], "export") == 0)
+    {
+        ret = cmdExport(self, argcCmd, argvCmd);
+    }
+    else if (strcmp(argvCmd[0], "empty") == 0)
+    {
+        ret = cmdEmpty(self);
+    }
+    else if (strcmp(argvCmd[0], "run") == 0)
+    {
+        ret = cmdRun(self, argcCmd, argvCmd);
+    }
+    else if (strcmp(argvCmd[0], "archive") == 0)
+    {
+        ret = cmdArchive(self, argcCmd, argvCmd);
+    }
+    else if (strcmp(argvCmd[0], "devices") == 0)
+    {
+        ret = cmdDevices(self, argcCmd, argvCmd);
+    }
+    else if (strcmp(argvCmd[0], "stats") == 0)
+    {
+        ret = cmdStats(argcCmd, argvCmd);
+    }
+    else if (strcmp(argvCmd[0], "trace") == 0)
+    {
+        ret = cmdTrace(argcCmd, argvCmd);
+    }
+    else if (strcmp(argvCmd[0], "help") == 0)
+	{
+		help(argcCmd, argvCmd);
+	}
+	else
+	{
+        ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, "'%s' is not a evidense command. See 'evidense --help'.", argvCmd[0]);
+	}
+
+    return ret;
+}
+
 int main(int argc, char *argv[])
 {
     Error_t ret = ERROR_EVI_OK;
@@ -214,6 +391,11 @@ int main(int argc, char *argv[])
 	bool options = true;
 	int i = 1;
     Evi_t eviDense = {0};
+    const char * socketPath = NULL;
+    const char * serial = NULL;
+    bool forward;
+    const char * traceFile = NULL;
+    char portName[256];
 
 	while (i < argc && options)
 	{
@@ -236,6 +418,31 @@ int main(int argc, char *argv[])
 			{
 				i++;
                 eviDense.portName = argv[i];
+			}
+			else if ((strcmp(argv[i], "--serial") == 0) && (i + 1 < argc))
+			{
+				i++;
+                serial = argv[i];
+			}
+			else if ((strcmp(argv[i], "--socket") == 0) && (i + 1 < argc))
+			{
+				i++;
+                socketPath = argv[i];
+			}
+			else if ((strcmp(argv[i], "--trace") == 0) && (i + 1 < argc))
+			{
+				i++;
+                traceFile = argv[i];
+			}
+			else if ((strcmp(argv[i], "--timeout") == 0) && (i + 1 < argc))
+			{
+				char *end = NULL;
+				i++;
+                eviDense.timeout = strtoul(argv[i], &end, 10);
+                if (end == argv[i] || *end != '\0')
+                {
+                    return printError(ERROR_EVI_INVALID_NUMBER, "Invalid timeout: %s\n", argv[i]);
+                }
 			}
 			else
 			{
@@ -252,74 +459,56 @@ int main(int argc, char *argv[])
 	argcCmd = argc - i;
 	argvCmd = argv + i;
 
+    forward = argcCmd > 0 && strcmp(argvCmd[0], "daemon") != 0 && (socketPath != NULL || getenv(DAEMON_SOCKET_ENV) != NULL);
+
+    // a client forwards the serial number, the daemon looks the device up
+    if (serial != NULL && !forward)
+    {
+        if (eviFindDeviceBySerial(serial, portName, sizeof(portName), eviDense.verbose) != ERROR_EVI_OK)
+        {
+            return printError(ERROR_EVI_INSTRUMENT_NOT_FOUND, "No device with serial number %s.\n", serial);
+        }
+        eviDense.portName = portName;
+    }
+
+    if (traceFile != NULL)
+    {
+        eviTraceStart(0);
+    }
+
 	if (argcCmd > 0)
 	{
-		if (strcmp(argvCmd[0], "get") == 0 && argcCmd == 2)
-		{
-            return cmdGet(&eviDense, argvCmd[1]);
-		}
-		else if (strcmp(argvCmd[0], "set") == 0 && argcCmd == 3)
-		{
-            return cmdSet(&eviDense, argvCmd[1], argvCmd[2]);
-		}
-		else if (strcmp(argvCmd[0], "measure") == 0)
-		{
-            return cmdMeasure(&eviDense);
-		}
-		else if (strcmp(argvCmd[0], "baseline") == 0)
-		{
-            return cmdBaseline(&eviDense);
-		}
-		else if (strcmp(argvCmd[0], "version") == 0)
-		{
-            fprintf(stdout, "%s\n", VERSION_TOOL);
-		}
-		else if (strcmp(argvCmd[0], "selftest") == 0)
-		{
-            return cmdSelftest(&eviDense);
-		}
-		else if (strcmp(argvCmd[0], "fwupdate") == 0 && argcCmd == 2)
-		{
-            return cmdFwUpdate(&eviDense, argvCmd[1]);
-		}
-		else if (strcmp(argvCmd[0], "command") == 0 && argcCmd == 2)
-		{
-            return cmdCommand(&eviDense, argvCmd[1]);
-		}
-		else if (strcmp(argvCmd[0], "data") == 0)
-		{
-            return cmdData(&eviDense, argcCmd, argvCmd);
-		}
-		else if (strcmp(argvCmd[0], "save") == 0)
-		{
-            return cmdSave(&eviDense, argcCmd, argvCmd);
-		}
-        else if (strcmp(argvCmd[0], "export") == 0)
+        char buffer[256];
+
+        if (strcmp(argvCmd[0], "daemon") == 0)
         {
-            return cmdExport(&eviDense, argcCmd, argvCmd);
+            ret = cmdDaemon(&eviDense, daemonSocketPath(socketPath, buffer, sizeof(buffer)), execute, argcCmd, argvCmd);
         }
-        else if (strcmp(argvCmd[0], "empty") == 0)
+        else if (forward)
         {
-            return cmdEmpty(&eviDense);
+            // the daemon holds the device, this process only forwards the command
+            ret = daemonForward(daemonSocketPath(socketPath, buffer, sizeof(buffer)), serial, argcCmd, argvCmd);
         }
-        else if (strcmp(argvCmd[0], "run") == 0)
+        else
         {
-            return cmdRun(&eviDense, argcCmd, argvCmd);
+            ret = execute(&eviDense, argcCmd, argvCmd);
         }
-        else if (strcmp(argvCmd[0], "help") == 0)
-		{
-			help(argcCmd, argvCmd);
-            return ERROR_EVI_OK;
-		}
-		else
-		{
-            return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, "'%s' is not a evidense command. See 'evidense --help'.", argvCmd[0]);
-		}
 	}
 	else
 	{
 		help(0, NULL);
 	}
 
+    eviSessionFree(&eviDense);
+
+    if (traceFile != NULL)
+    {
+        if (eviTraceSave(traceFile) != ERROR_EVI_OK)
+        {
+            printError(ERROR_EVI_FILE_IO_ERROR, "Could not write trace %s.\n", traceFile);
+        }
+        eviTraceStop();
+    }
+
 	return ret;
 }
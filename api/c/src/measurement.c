@@ -310,34 +310,70 @@ static const WavelengthAbsorption_t theoreticalDnaAbsorption[] =
     {314.1728395061729, 0.0132890365448505}
 };
 
+// The table has a uniform wavelength grid, so the interval is found from the
+// wavelength directly. The result is the same as scanning for the first
+// interval with x0 <= wavelength <= x1.
 static double measurement_getTheoreticalDnaAbsorption(double wavelength)
 {
     size_t i;
     size_t count = sizeof(theoreticalDnaAbsorption) / sizeof(theoreticalDnaAbsorption[0]);
+    double first = theoreticalDnaAbsorption[0].wavelength;
+    double last = theoreticalDnaAbsorption[count - 1].wavelength;
 
-    if(wavelength <= theoreticalDnaAbsorption[0].wavelength)
+    if(wavelength <= first)
     {
         return theoreticalDnaAbsorption[0].absorption;
     }
-    if(wavelength >= theoreticalDnaAbsorption[count - 1].wavelength)
+    if((wavelength >= last) || isnan(wavelength))
     {
         return theoreticalDnaAbsorption[count - 1].absorption;
     }
 
-    for(i = 0; i < count - 1; i++)
+    i = (size_t)((wavelength - first) / ((last - first) / (double)(count - 1)));
+    if(i > count - 2)
     {
-        double x0 = theoreticalDnaAbsorption[i].wavelength;
-        double y0 = theoreticalDnaAbsorption[i].absorption;
-        double x1 = theoreticalDnaAbsorption[i + 1].wavelength;
-        double y1 = theoreticalDnaAbsorption[i + 1].absorption;
+        i = count - 2;
+    }
+    // the grid points are not exactly equidistant, correct the estimate
+    while((i < count - 2) && (wavelength > theoreticalDnaAbsorption[i + 1].wavelength))
+    {
+        i++;
+    }
+    while((i > 0) && (wavelength <= theoreticalDnaAbsorption[i].wavelength))
+    {
+        i--;
+    }
 
-        if((x0 <= wavelength) && (wavelength <= x1))
-        {
-            return y0 + (y1 - y0) * (wavelength - x0) / (x1 - x0);
-        }
+    double x0 = theoreticalDnaAbsorption[i].wavelength;
+    double y0 = theoreticalDnaAbsorption[i].absorption;
+    double x1 = theoreticalDnaAbsorption[i + 1].wavelength;
+    double y1 = theoreticalDnaAbsorption[i + 1].absorption;
+
+    return y0 + (y1 - y0) * (wavelength - x0) / (x1 - x0);
+}
+
+// Returns false if no 280 nm correction applies, else the absorptions for
+// absorbance.value280 * a280Theoretical / a280Real.
+static bool parametersCorrection280(const Parameters_t * parameters, double * a280Theoretical, double * a280Real)
+{
+    if(!parameters || !(parameters->centerWavelength280 > 0.0))
+    {
+        return false;
+    }
+
+    if(parameters->absorption280Wavelength == parameters->centerWavelength280)
+    {
+        *a280Real = parameters->absorption280Real;
+        *a280Theoretical = parameters->absorption280Theoretical;
+    }
+    else
+    {
+        // centerWavelength280 was assigned without parametersSetCenterWavelength280()
+        *a280Real = measurement_getTheoreticalDnaAbsorption(parameters->centerWavelength280);
+        *a280Theoretical = measurement_getTheoreticalDnaAbsorption(DEFAULT_CENTER_WAVELENGTH_280);
     }
 
-    return theoreticalDnaAbsorption[count - 1].absorption;
+    return true;
 }
 
 Measurement_t measurement_init(SingleMeasurement_t baseline, SingleMeasurement_t air, SingleMeasurement_t sample, const char * comment)
@@ -401,11 +437,10 @@ Quadruple_t measurement_absorbance(const Measurement_t * self, const Quadruple_t
 
     absorbance = quadruple_sub(&aSample, factorAbsorbanceBufferBlank);
 
-    if(parameters && (parameters->centerWavelength280 > 0.0))
+    double a280Real;
+    double a280Theoretical;
+    if(parametersCorrection280(parameters, &a280Theoretical, &a280Real))
     {
-        double a280Real = measurement_getTheoreticalDnaAbsorption(parameters->centerWavelength280);
-        double a280Theoretical = measurement_getTheoreticalDnaAbsorption(DEFAULT_CENTER_WAVELENGTH_280);
-
         absorbance.value280 = absorbance.value280 * a280Theoretical / a280Real;
     }
 
@@ -486,6 +521,113 @@ double measurement_purityRatio260_230(const Measurement_t * self, const Quadrupl
     return  aNNN.value260 / aNNN.value230;
 }
 
+Results_t measurement_calculateAll(const Measurement_t * self, const Quadruple_t * factorAbsorbanceBufferBlank, const double * cuvettePathLength, const Parameters_t * parameters)
+{
+    Results_t ret;
+    double tempCcuvettePathLength = DEFAULT_CUVETTE_PATH_LENGTH;
+    if(cuvettePathLength)
+    {
+        tempCcuvettePathLength = *cuvettePathLength;
+    }
+
+    // same operations as measurement_algorithmV9() and the functions using it
+    Quadruple_t aSampleMinusBlank = measurement_absorbance(self, factorAbsorbanceBufferBlank, parameters);
+    Quadruple_t a340              = quadruple_initAllTheSame(aSampleMinusBlank.value340);
+    Quadruple_t aNNN              = quadruple_sub(&aSampleMinusBlank, &a340);
+
+    ret.dsDNA = aNNN.value260 * 50.0 * 10.0 / tempCcuvettePathLength;
+    ret.ssDNA = aNNN.value260 * 33.0 * 10.0 / tempCcuvettePathLength;
+    ret.ssRNA = aNNN.value260 * 40.0 * 10.0 / tempCcuvettePathLength;
+    ret.absorbance = aSampleMinusBlank;
+    ret.purityRatio260_230 = aNNN.value260 / aNNN.value230;
+    ret.purityRatio260_280 = aNNN.value260 / aNNN.value280;
+
+    return ret;
+}
+
+#define BATCH_BLOCK 256
+
+// log10 of the absorbance ratios of one channel for a block of measurements
+static void calculateAbsorbanceBlock(const uint32_t * airSample, const uint32_t * airReference, const uint32_t * sample, const uint32_t * reference, size_t n, double * out)
+{
+    // same expression as measurement_calculateAbsorbance() with a correction factor of 1.0
+    for(size_t i = 0; i < n; i++)
+    {
+        out[i] = (double)airSample[i] / (double)airReference[i] * (double)reference[i] / (double)sample[i] * 1.0;
+    }
+    for(size_t i = 0; i < n; i++)
+    {
+        out[i] = log10(out[i]);
+    }
+}
+
+void measurement_calculateBatch(const MeasurementBatch_t * batch, const Quadruple_t * factorAbsorbanceBufferBlank, const double * cuvettePathLength, const Parameters_t * parameters, ResultsBatch_t * results)
+{
+    double a230[BATCH_BLOCK];
+    double a260[BATCH_BLOCK];
+    double a280[BATCH_BLOCK];
+    double a340[BATCH_BLOCK];
+    Quadruple_t factor0 = quadruple_initAllTheSame(0.0);
+    double pathLength = DEFAULT_CUVETTE_PATH_LENGTH;
+    double a280Theoretical = 1.0;
+    double a280Real = 1.0;
+    bool correct280 = parametersCorrection280(parameters, &a280Theoretical, &a280Real);
+
+    if(!factorAbsorbanceBufferBlank)
+    {
+        factorAbsorbanceBufferBlank = &factor0;
+    }
+    if(cuvettePathLength)
+    {
+        pathLength = *cuvettePathLength;
+    }
+
+    const double f230 = factorAbsorbanceBufferBlank->value230;
+    const double f260 = factorAbsorbanceBufferBlank->value260;
+    const double f280 = factorAbsorbanceBufferBlank->value280;
+    const double f340 = factorAbsorbanceBufferBlank->value340;
+    const SingleMeasurementArray_t * air = &batch->air;
+    const SingleMeasurementArray_t * sample = &batch->sample;
+
+    for(size_t first = 0; first < batch->count; first += BATCH_BLOCK)
+    {
+        size_t n = batch->count - first < BATCH_BLOCK ? batch->count - first : BATCH_BLOCK;
+
+        calculateAbsorbanceBlock(air->sample230 + first, air->reference230 + first, sample->sample230 + first, sample->reference230 + first, n, a230);
+        calculateAbsorbanceBlock(air->sample260 + first, air->reference260 + first, sample->sample260 + first, sample->reference260 + first, n, a260);
+        calculateAbsorbanceBlock(air->sample280 + first, air->reference280 + first, sample->sample280 + first, sample->reference280 + first, n, a280);
+        calculateAbsorbanceBlock(air->sample340 + first, air->reference340 + first, sample->sample340 + first, sample->reference340 + first, n, a340);
+
+        // same operations as measurement_calculateAll()
+        for(size_t i = 0; i < n; i++)
+        {
+            double v230 = a230[i] - f230;
+            double v260 = a260[i] - f260;
+            double v280 = a280[i] - f280;
+            double v340 = a340[i] - f340;
+
+            if(correct280)
+            {
+                v280 = v280 * a280Theoretical / a280Real;
+            }
+
+            double n230 = v230 - v340;
+            double n260 = v260 - v340;
+            double n280 = v280 - v340;
+
+            results->dsDNA[first + i] = n260 * 50.0 * 10.0 / pathLength;
+            results->ssDNA[first + i] = n260 * 33.0 * 10.0 / pathLength;
+            results->ssRNA[first + i] = n260 * 40.0 * 10.0 / pathLength;
+            results->a230[first + i] = v230;
+            results->a260[first + i] = v260;
+            results->a280[first + i] = v280;
+            results->a340[first + i] = v340;
+            results->purityRatio260_230[first + i] = n260 / n230;
+            results->purityRatio260_280[first + i] = n260 / n280;
+        }
+    }
+}
+
 bool measurement_fromJson(cJSON * node, Measurement_t * measurement)
 {
     bool ret = false;
@@ -514,11 +656,19 @@ Parameters_t parametersCreate()
     ret.blanksStart       = 1;
     ret.blanksEnd         = 0;
     ret.cuvettePathLength = DEFAULT_CUVETTE_PATH_LENGTH;
-    ret.centerWavelength280 = DEFAULT_CENTER_WAVELENGTH_280;
+    parametersSetCenterWavelength280(&ret, DEFAULT_CENTER_WAVELENGTH_280);
 
     return ret;
 }
 
+void parametersSetCenterWavelength280(Parameters_t * parameters, double centerWavelength280)
+{
+    parameters->centerWavelength280 = centerWavelength280;
+    parameters->absorption280Wavelength = centerWavelength280;
+    parameters->absorption280Real = measurement_getTheoreticalDnaAbsorption(centerWavelength280);
+    parameters->absorption280Theoretical = measurement_getTheoreticalDnaAbsorption(DEFAULT_CENTER_WAVELENGTH_280);
+}
+
 bool parametersApplyAdjustmentsFromJson(cJSON * node, Parameters_t * parameters)
 {
     cJSON * oAdjustments = NULL;
@@ -548,7 +698,7 @@ bool parametersApplyAdjustmentsFromJson(cJSON * node, Parameters_t * parameters)
         return false;
     }
 
-    parameters->centerWavelength280 = cJSON_GetNumberValue(o280);
+    parametersSetCenterWavelength280(parameters, cJSON_GetNumberValue(o280));
     return true;
 }
 
@@ -598,20 +748,36 @@ static cJSON *calculate(cJSON *measurement, const Factors_t * factors, const Par
 
     measurement_fromJson(measurement, &m);
 
-    cJSON_AddNumberToObject(obj, DICT_DS_DNA, measurement_dsDNA(&m, &factors->fAbsorbanceBufferBlank, &parameters->cuvettePathLength, parameters));
-    cJSON_AddNumberToObject(obj, DICT_SS_DNA, measurement_ssDNA(&m, &factors->fAbsorbanceBufferBlank, &parameters->cuvettePathLength, parameters));
-    cJSON_AddNumberToObject(obj, DICT_SS_RNA, measurement_ssRNA(&m, &factors->fAbsorbanceBufferBlank, &parameters->cuvettePathLength, parameters));
-    cJSON_AddNumberToObject(obj, DICT_A230, measurement_a230(&m, &factors->fAbsorbanceBufferBlank, parameters));
-    cJSON_AddNumberToObject(obj, DICT_A260, measurement_a260(&m, &factors->fAbsorbanceBufferBlank, parameters));
-    cJSON_AddNumberToObject(obj, DICT_A280, measurement_a280(&m, &factors->fAbsorbanceBufferBlank, parameters));
-    cJSON_AddNumberToObject(obj, DICT_A340, measurement_a340(&m, &factors->fAbsorbanceBufferBlank, parameters));
+    Results_t results = measurement_calculateAll(&m, &factors->fAbsorbanceBufferBlank, &parameters->cuvettePathLength, parameters);
+
+    cJSON_AddNumberToObject(obj, DICT_DS_DNA, results.dsDNA);
+    cJSON_AddNumberToObject(obj, DICT_SS_DNA, results.ssDNA);
+    cJSON_AddNumberToObject(obj, DICT_SS_RNA, results.ssRNA);
+    cJSON_AddNumberToObject(obj, DICT_A230, results.absorbance.value230);
+    cJSON_AddNumberToObject(obj, DICT_A260, results.absorbance.value260);
+    cJSON_AddNumberToObject(obj, DICT_A280, results.absorbance.value280);
+    cJSON_AddNumberToObject(obj, DICT_A340, results.absorbance.value340);
 
-    cJSON_AddNumberToObject(obj, DICT_PURITY_260_230, measurement_purityRatio260_230(&m, &factors->fAbsorbanceBufferBlank, parameters));
-    cJSON_AddNumberToObject(obj, DICT_PURITY_260_280, measurement_purityRatio260_280(&m, &factors->fAbsorbanceBufferBlank, parameters));
+    cJSON_AddNumberToObject(obj, DICT_PURITY_260_230, results.purityRatio260_230);
+    cJSON_AddNumberToObject(obj, DICT_PURITY_260_280, results.purityRatio260_280);
 
     return obj;
 }
 
+bool measurement_calculateEntry(cJSON * measurement, const Factors_t * factors, const Parameters_t * parameters)
+{
+    Measurement_t m = {};
+
+    if (!measurement_fromJson(measurement, &m))
+    {
+        return false;
+    }
+
+    cJSON_DeleteItemFromObject(measurement, DICT_CALCULATED);
+    cJSON_AddItemToObject(measurement, DICT_CALCULATED, calculate(measurement, factors, parameters));
+    return true;
+}
+
 bool measurement_calculate(cJSON * oMeasurements, const Parameters_t * parameters)
 {
     bool ret = false;
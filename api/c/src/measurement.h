@@ -29,6 +29,9 @@ typedef struct
     uint32_t blanksEnd;
     double   cuvettePathLength;
     double   centerWavelength280;
+    double   absorption280Wavelength;  /**< centerWavelength280 the cached absorptions were computed for. */
+    double   absorption280Real;        /**< Theoretical DNA absorption at absorption280Wavelength. */
+    double   absorption280Theoretical; /**< Theoretical DNA absorption at 280 nm. */
 
 } Parameters_t;
 
@@ -39,6 +42,14 @@ typedef struct
  */
 DLLEXPORT Parameters_t parametersCreate();
 
+/**
+ * @brief Sets the 280 nm center wavelength and caches the absorptions of the 260/280 correction.
+ *
+ * @param parameters Pointer to the parameters to update.
+ * @param centerWavelength280 Center wavelength of the 280 nm channel in nm, 0 disables the correction.
+ */
+DLLEXPORT void parametersSetCenterWavelength280(Parameters_t * parameters, double centerWavelength280);
+
 /**
  * @struct Measurement_t
  * @brief Represents a measurement with baseline, air, and sample values.
@@ -177,6 +188,98 @@ DLLEXPORT double measurement_purityRatio260_230(const Measurement_t * self, cons
  */
 DLLEXPORT double measurement_purityRatio260_280(const Measurement_t * self, const Quadruple_t * factorAbsorbanceBufferBlank, const Parameters_t * parameters);
 
+/**
+ * @struct Results_t
+ * @brief Holds all values derived from a measurement.
+ */
+typedef struct
+{
+    double dsDNA; /**< dsDNA concentration. */
+    double ssDNA; /**< ssDNA concentration. */
+    double ssRNA; /**< ssRNA concentration. */
+    Quadruple_t absorbance; /**< Absorbance of all four channels without A340 correction. */
+    double purityRatio260_230; /**< 260/230 purity ratio. */
+    double purityRatio260_280; /**< 260/280 purity ratio. */
+} Results_t;
+
+/**
+ * @brief Computes all derived values of the measurement in a single pass.
+ *
+ * The results are identical to the ones of the single value functions like
+ * measurement_dsDNA(), but the absorbance is computed only once.
+ *
+ * @param self Pointer to the Measurement_t structure.
+ * @param factorAbsorbanceBufferBlank Correction value for air to blank. If NULL, no correction is applied.
+ * @param cuvettePathLength Pointer to cuvette path length. If NULL, a default value is used.
+ * @param parameters Optional device-specific parameters used for purity correction.
+ * @return The derived values.
+ */
+DLLEXPORT Results_t measurement_calculateAll(const Measurement_t * self, const Quadruple_t * factorAbsorbanceBufferBlank, const double * cuvettePathLength, const Parameters_t * parameters);
+
+/**
+ * @struct SingleMeasurementArray_t
+ * @brief Channel values of several single measurements, one array per value.
+ */
+typedef struct
+{
+    const uint32_t * sample230; /**< Sample values at 230 nm. */
+    const uint32_t * reference230; /**< Reference values at 230 nm. */
+    const uint32_t * sample260; /**< Sample values at 260 nm. */
+    const uint32_t * reference260; /**< Reference values at 260 nm. */
+    const uint32_t * sample280; /**< Sample values at 280 nm. */
+    const uint32_t * reference280; /**< Reference values at 280 nm. */
+    const uint32_t * sample340; /**< Sample values at 340 nm. */
+    const uint32_t * reference340; /**< Reference values at 340 nm. */
+} SingleMeasurementArray_t;
+
+/**
+ * @struct MeasurementBatch_t
+ * @brief Several measurements in a structure-of-arrays layout.
+ *
+ * The derived values depend on the air and sample measurements only, the
+ * baseline arrays may be NULL for measurement_calculateBatch().
+ */
+typedef struct
+{
+    size_t count; /**< Number of measurements, i.e. the length of every array. */
+    SingleMeasurementArray_t baseline; /**< Baseline measurements. */
+    SingleMeasurementArray_t air; /**< Air measurements. */
+    SingleMeasurementArray_t sample; /**< Sample measurements. */
+} MeasurementBatch_t;
+
+/**
+ * @struct ResultsBatch_t
+ * @brief Output arrays of measurement_calculateBatch(), each with one value per measurement.
+ */
+typedef struct
+{
+    double * dsDNA; /**< dsDNA concentrations. */
+    double * ssDNA; /**< ssDNA concentrations. */
+    double * ssRNA; /**< ssRNA concentrations. */
+    double * a230; /**< Absorbances at 230 nm without A340 correction. */
+    double * a260; /**< Absorbances at 260 nm without A340 correction. */
+    double * a280; /**< Absorbances at 280 nm without A340 correction. */
+    double * a340; /**< Absorbances at 340 nm without A340 correction. */
+    double * purityRatio260_230; /**< 260/230 purity ratios. */
+    double * purityRatio260_280; /**< 260/280 purity ratios. */
+} ResultsBatch_t;
+
+/**
+ * @brief Computes the derived values of many measurements.
+ *
+ * The results are identical to the ones of measurement_calculateAll() for
+ * each measurement. The work is split into passes over blocks of
+ * measurements so the compiler can vectorize the arithmetic between the
+ * log10 calls.
+ *
+ * @param batch Measurements in a structure-of-arrays layout.
+ * @param factorAbsorbanceBufferBlank Correction value for air to blank. If NULL, no correction is applied.
+ * @param cuvettePathLength Pointer to cuvette path length. If NULL, a default value is used.
+ * @param parameters Optional device-specific parameters used for purity correction.
+ * @param results Arrays receiving batch->count values each.
+ */
+DLLEXPORT void measurement_calculateBatch(const MeasurementBatch_t * batch, const Quadruple_t * factorAbsorbanceBufferBlank, const double * cuvettePathLength, const Parameters_t * parameters, ResultsBatch_t * results);
+
 /**
  * @brief Prints the contents of a Measurement_t structure to the specified stream.
  *
@@ -226,6 +329,19 @@ DLLEXPORT bool parametersApplyAdjustmentsFromJson(cJSON * node, Parameters_t * p
  */
 DLLEXPORT bool measurement_calculateFactors(cJSON *oMeasurments, const Parameters_t * parameters, Factors_t * factors);
 
+/**
+ * @brief Calculates the derived values of a single measurement entry with known factors.
+ *
+ * Adds or replaces the results of the entry. Together with factors computed once
+ * from the blanks, this extends a data set without recalculating earlier entries.
+ *
+ * @param measurement JSON object of the measurement entry to process.
+ * @param factors Pointer to the factors computed from the blanks.
+ * @param parameters Pointer to the calculation parameters.
+ * @return true if the entry was parsed and its values computed; false otherwise.
+ */
+DLLEXPORT bool measurement_calculateEntry(cJSON * measurement, const Factors_t * factors, const Parameters_t * parameters);
+
 /**
  * @brief Calculates derived measurement values from the provided JSON data.
  *
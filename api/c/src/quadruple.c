@@ -3,6 +3,7 @@
 
 #include "evibase.h"
 #include "quadruple.h"
+#include "dict.h"
 
 Quadruple_t quadruple_initAllTheSame(double value)
 {
@@ -70,3 +71,27 @@ void quadruple_print(const Quadruple_t * self, FILE * stream, bool newLine)
 {
     fprintf_s(stream, "230=%f, 260=%f, 280=%f, 340=%f%s", self->value230, self->value260, self->value280, self->value340, newLine ? "\n" : "");
 }
+
+cJSON* quadruple_toJson(const Quadruple_t * self)
+{
+    cJSON* obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(obj, DICT_230, cJSON_CreateNumber(self->value230));
+    cJSON_AddItemToObject(obj, DICT_260, cJSON_CreateNumber(self->value260));
+    cJSON_AddItemToObject(obj, DICT_280, cJSON_CreateNumber(self->value280));
+    cJSON_AddItemToObject(obj, DICT_340, cJSON_CreateNumber(self->value340));
+    return obj;
+}
+
+bool quadruple_fromJson(cJSON * obj, Quadruple_t * self)
+{
+    cJSON * o230 = cJSON_GetObjectItem(obj, DICT_230);
+    cJSON * o260 = cJSON_GetObjectItem(obj, DICT_260);
+    cJSON * o280 = cJSON_GetObjectItem(obj, DICT_280);
+    cJSON * o340 = cJSON_GetObjectItem(obj, DICT_340);
+    if(cJSON_IsNumber(o230) && cJSON_IsNumber(o260) && cJSON_IsNumber(o280) && cJSON_IsNumber(o340))
+    {
+        *self = quadruple_init(cJSON_GetNumberValue(o230), cJSON_GetNumberValue(o260), cJSON_GetNumberValue(o280), cJSON_GetNumberValue(o340));
+        return true;
+    }
+    return false;
+}
@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include "cJSON.h"
 
 #if defined(_WIN64) || defined(_WIN32)
 #include <windows.h>
@@ -91,3 +92,20 @@ DLLEXPORT Quadruple_t quadruple_mul(const Quadruple_t * self, const Quadruple_t
  * @param newLine Whether to add a newline at the end of the output.
  */
 DLLEXPORT void quadruple_print(const Quadruple_t * self, FILE * stream, bool newLine);
+
+/**
+ * @brief Converts a Quadruple_t structure to its JSON representation.
+ *
+ * @param self Pointer to the Quadruple_t structure to serialize.
+ * @return Newly allocated cJSON object with one number per wavelength.
+ */
+DLLEXPORT cJSON* quadruple_toJson(const Quadruple_t * self);
+
+/**
+ * @brief Populates a Quadruple_t structure from a JSON object.
+ *
+ * @param obj JSON object with one number per wavelength.
+ * @param self Pointer to the structure that will receive the parsed values.
+ * @return true if all four values were found; false otherwise.
+ */
+DLLEXPORT bool quadruple_fromJson(cJSON * obj, Quadruple_t * self);
@@ -229,6 +229,9 @@ class SimulationBase:
         rx_buffer = bytearray()
         read_state = ReadState.IDLE
 
+        # like a serial line, answer pipelined commands without waiting for acknowledgements
+        conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
         with conn:
             while not self._should_abort:
                 data = conn.recv(1024)
@@ -242,7 +245,7 @@ class SimulationBase:
                             read_state = ReadState.READ
                     elif read_state == ReadState.READ:
                         if byte == (b"\n")[0] or byte == (b"\r")[0]:
-                            del byte_array[0]
+                            read_state = ReadState.IDLE
                             request = rx_buffer.decode("utf-8")
                             response = self.handle_command(shlex.split(request))
                             if self._verbose: